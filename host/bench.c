@@ -0,0 +1,574 @@
+/*------------------------------------------------------------------------------
+
+	bench: micro-benchmarks of the platform independent code
+
+	usage: bench [-b baseline] [-w file] [-t percent] [-m ms] [name prefix]
+
+	Times the decode, conditioning, control and storage paths of main/ on
+	the host and compares them against a stored baseline
+	(host/bench_baseline.txt unless -b is given). Each benchmark runs in
+	batches that double until one takes at least -m ms (default 50), then
+	all of them run BENCH_REPEATS more batches in turn, so clock and load
+	drift hit every benchmark alike, and the best batch counts. Reports
+	  ns/op      host CPU time of one operation
+	  allocs/op  malloc, calloc and realloc calls from the host library
+	  base       ns/op of the baseline, and the delta to it
+	A benchmark regresses when it is more than -t percent (default 15)
+	slower than the baseline or allocates more; bench then exits with 1.
+	-w writes the results as a new baseline with the build type. Times
+	are only compared against a baseline of the same build type, other
+	builds check the allocations alone. Only compare builds of the same
+	machine, the stored baseline is a reference, not a limit.
+
+---------------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "DHT.h"
+#include "DHT_decode.h"
+#include "controller.h"
+#include "dht_sim.h"
+#include "duty.h"
+#include "filter.h"
+#include "hal_host.h"
+#include "history.h"
+#include "sample_bus.h"
+#include "sensor_log.h"
+#include "telemetry.h"
+#include "zones.h"
+
+#define BENCH_REPEATS 5
+#define BENCH_MAX_BASELINE 64
+#define SIM_PIN 4
+#define SIM_SAMPLES 6144
+#define SIM_LINES 4
+#define CONTROL_ZONES 8
+
+typedef struct
+{
+    const char *name;
+    void (*setup)(void);
+    void (*run)(uint32_t k);
+} bench_t;
+
+typedef struct
+{
+    char name[32];
+    double ns;
+    double allocs;
+    uint32_t iterations;
+} bench_result_t;
+
+static volatile uint32_t sink;
+
+// == allocation counter =========================================
+
+// linked with --wrap for malloc, calloc and realloc where the linker has it
+static unsigned long allocations;
+
+#if BENCH_WRAP_ALLOC
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    allocations++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    allocations++;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *p, size_t size)
+{
+    allocations++;
+    return __real_realloc(p, size);
+}
+#endif
+
+static double nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// == decode =====================================================
+
+static dht_sim_t sim;
+static uint8_t frame[MAXdhtData];
+static dht_pulse_t pulses[DHT_SIM_MAX_EDGES / 2];
+static int pulseCount;
+static uint32_t edgeUs[DHT_SIM_MAX_EDGES];
+static uint8_t edgeLevel[DHT_SIM_MAX_EDGES];
+static int edgeCount;
+static uint32_t words[SIM_SAMPLES / 32];
+static uint8_t raw[SIM_SAMPLES * SIM_LINES / 8];
+
+static void setupDecode(void)
+{
+    dht_sim_config_t config = {.humidity = 65.2f, .temperature = 21.5f};
+
+    simDHTInit(&sim, &config);
+    simDHTFrame(&sim, 0);
+    memcpy(frame, sim.truth, MAXdhtData);
+
+    edgeCount = simDHTEdges(&sim, edgeUs, edgeLevel, DHT_SIM_MAX_EDGES);
+    pulseCount = edgesToDHTPulses(edgeUs, edgeLevel, edgeCount, pulses, DHT_SIM_MAX_EDGES / 2);
+    simDHTBitstream(&sim, words, SIM_SAMPLES);
+
+    // the same sensor on all four lines of a quad capture
+    memset(raw, 0, sizeof(raw));
+    for (int i = 0; i < SIM_SAMPLES; i++)
+        if (words[i / 32] & (0x80000000u >> (i % 32)))
+            raw[i * SIM_LINES / 8] |= (i & 1) ? 0x0F : 0xF0;
+}
+
+static void runChecksum(uint32_t k)
+{
+    frame[0] = k;
+    frame[4] = frame[0] + frame[1] + frame[2] + frame[3];
+    sink += verifyDHTChecksum(frame);
+}
+
+static void runPulses(uint32_t k)
+{
+    uint8_t data[MAXdhtData];
+
+    (void)k;
+    sink += decodeDHTPulses(pulses, pulseCount, data) + data[1];
+}
+
+static void runEdges(uint32_t k)
+{
+    dht_pulse_t out[DHT_SIM_MAX_EDGES / 2];
+    uint8_t data[MAXdhtData];
+
+    (void)k;
+    int count = edgesToDHTPulses(edgeUs, edgeLevel, edgeCount, out, DHT_SIM_MAX_EDGES / 2);
+    sink += decodeDHTPulses(out, count, data) + data[1];
+}
+
+static void runBitstream(uint32_t k)
+{
+    uint8_t data[MAXdhtData];
+
+    (void)k;
+    sink += decodeDHTBitstream(words, SIM_SAMPLES, data) + data[1];
+}
+
+static void runSplit(uint32_t k)
+{
+    static uint32_t line[SIM_SAMPLES / 32];
+
+    splitDHTBitstream(raw, SIM_SAMPLES, SIM_LINES, k % SIM_LINES, line);
+    sink += line[k % (SIM_SAMPLES / 32)];
+}
+
+static void setupReadDHT(void)
+{
+    setupDecode();
+    halHostAttach(SIM_PIN, &sim);
+    setDHTgpio(SIM_PIN);
+}
+
+// the busy-wait read on the virtual clock, its host cost is the polling loop
+static void runReadDHT(uint32_t k)
+{
+    (void)k;
+    sink += readDHT();
+}
+
+// == conditioning ===============================================
+
+static filter_t filter;
+
+static void setupFilter(void)
+{
+    filterInit(&filter);
+}
+
+static void runFilter(uint32_t k)
+{
+    int16_t in[FILTER_CHANNELS] = {650 + (int)((k * 7919u) % 41) - 20, 215 + (int)(k / 64 % 7)};
+    int16_t out[FILTER_CHANNELS];
+
+    filterAdd(&filter, k * 10, in, out);
+    sink += out[0];
+}
+
+// == control ====================================================
+
+static zone_config_t configs[CONTROL_ZONES];
+static controller_t controller;
+static zones_t zones;
+
+static void setupZones(void)
+{
+    for (int k = 0; k < CONTROL_ZONES; k++)
+        configs[k] = (zone_config_t){
+            .name = "bench",
+            .sensors = {k},
+            .sensorCount = 1,
+            .relay = k,
+            .highDeci = 750,
+            .lowDeci = 650,
+            .pumpDurationS = 60,
+        };
+    zonesInit(&zones, configs, CONTROL_ZONES, 2, 5);
+    controllerInit(&controller, configs, CONTROL_ZONES, 2, 5);
+}
+
+// one sample per zone and a step, humidity sweeps through the band
+static void runZones(uint32_t k)
+{
+    zone_action_t actions[ZONES_MAX];
+    uint32_t nowS = k * 10;
+
+    for (int z = 0; z < CONTROL_ZONES; z++)
+        zonesSensor(&zones, z, nowS, 600 + (int)((k + z * 13) % 200));
+    sink += zonesStep(&zones, nowS, actions);
+}
+
+// the dht_task path: filter the sample, then step
+static void runController(uint32_t k)
+{
+    zone_action_t actions[ZONES_MAX];
+    int16_t filtered[FILTER_CHANNELS];
+    uint32_t nowS = k * 10;
+    int sensor = k % CONTROL_ZONES;
+    int16_t in[FILTER_CHANNELS] = {600 + (int)((k / CONTROL_ZONES + sensor * 13) % 200), 215};
+
+    controllerSample(&controller, sensor, nowS, in, filtered);
+    sink += controllerStep(&controller, nowS, actions) + filtered[0];
+}
+
+// == storage ====================================================
+
+static log_segment_t segment;
+static uint8_t sealed[LOG_SEGMENT_SIZE];
+static history_t history;
+static telemetry_t telemetry;
+static sample_bus_t bus;
+static bus_subscriber_t *subscriber;
+static duty_t duty;
+
+static void fillSegment(void)
+{
+    logSegmentStart(&segment, 1, 0);
+    for (uint32_t k = 0; logSegmentAppend(&segment, k * 10, LOG_SAMPLE, 600 + (k * 7919u) % 23, 215 + k / 64 % 7); k++)
+        ;
+    logSegmentSeal(&segment, sealed);
+}
+
+static void runLogAppend(uint32_t k)
+{
+    if (!logSegmentAppend(&segment, k * 10, LOG_SAMPLE, 600 + (k * 7919u) % 23, 215 + k / 64 % 7))
+        logSegmentStart(&segment, 1, k * 10);
+    sink += segment.used;
+}
+
+static void runLogSeal(uint32_t k)
+{
+    (void)k;
+    logSegmentSeal(&segment, sealed);
+    sink += sealed[LOG_HEADER_SIZE - 1];
+}
+
+static void runLogDecode(uint32_t k)
+{
+    log_record_t records[LOG_PAYLOAD_SIZE];
+
+    (void)k;
+    sink += logDecodeSegment(sealed, records, LOG_PAYLOAD_SIZE);
+}
+
+static void setupHistory(void)
+{
+    historyInit(&history);
+}
+
+static void runHistoryAdd(uint32_t k)
+{
+    int16_t values[HISTORY_CHANNELS] = {600 + (int)((k * 7919u) % 23), 215};
+
+    historyAdd(&history, k * HISTORY_RAW_PERIOD_S, values);
+    sink += history.countTotal;
+}
+
+static void setupHistoryWindow(void)
+{
+    historyInit(&history);
+    for (uint32_t k = 0; k < 2 * 86400 / HISTORY_RAW_PERIOD_S; k++)
+        runHistoryAdd(k);
+}
+
+static void runHistoryWindow(uint32_t k)
+{
+    history_stats_t stats;
+
+    (void)k;
+    historyWindow(&history, 2 * 86400, 3600, HISTORY_HUMIDITY, &stats);
+    sink += stats.mean;
+}
+
+static int discard(void *context, const uint8_t *batch, int len)
+{
+    (void)context;
+    sink += batch[0] + len;
+    return 0;
+}
+
+static void setupTelemetry(void)
+{
+    telemetryOpen(&telemetry, NULL, 0, 1, discard, NULL);
+}
+
+static void runTelemetry(uint32_t k)
+{
+    uint32_t nowS = k * 10;
+
+    telemetrySample(&telemetry, nowS, 600 + (k * 7919u) % 23, 215 + k / 64 % 7);
+    sink += telemetryPoll(&telemetry, nowS * 1000, nowS);
+}
+
+static void setupBus(void)
+{
+    busInit(&bus, "bench");
+    subscriber = busSubscribe(&bus, "bench", NULL, NULL);
+}
+
+static void runBus(uint32_t k)
+{
+    bus_record_t record = {.timeUs = k, .type = BUS_SAMPLE, .humidity10 = 650, .temperature10 = 215};
+
+    busPublish(&bus, &record);
+    busRead(&bus, subscriber, &record);
+    sink += record.humidity10;
+}
+
+static void setupDuty(void)
+{
+    dutyInit(&duty);
+}
+
+static void runDuty(uint32_t k)
+{
+    dutyAdd(&duty, k * 10, LOG_SAMPLE, 0, 650, 215);
+    if (dutyFlushDue(&duty, 6))
+        dutyFlushed(&duty, 0);
+    sink += duty.count;
+}
+
+static const bench_t benches[] = {
+    {"decode.checksum", setupDecode, runChecksum},
+    {"decode.pulses", setupDecode, runPulses},
+    {"decode.edges", setupDecode, runEdges},
+    {"decode.bitstream", setupDecode, runBitstream},
+    {"decode.split_x4", setupDecode, runSplit},
+    {"decode.readDHT", setupReadDHT, runReadDHT},
+    {"filter.add", setupFilter, runFilter},
+    {"control.zones_8", setupZones, runZones},
+    {"control.controller", setupZones, runController},
+    {"storage.log_append", fillSegment, runLogAppend},
+    {"storage.log_seal", fillSegment, runLogSeal},
+    {"storage.log_decode", fillSegment, runLogDecode},
+    {"storage.history_add", setupHistory, runHistoryAdd},
+    {"storage.history_window", setupHistoryWindow, runHistoryWindow},
+    {"storage.telemetry", setupTelemetry, runTelemetry},
+    {"storage.bus", setupBus, runBus},
+    {"storage.duty", setupDuty, runDuty},
+};
+
+#define BENCHES (sizeof(benches) / sizeof(benches[0]))
+
+// == timing =====================================================
+
+// every batch starts from the setup, so the order of the runs does not matter
+static double runBatch(const bench_t *b, uint32_t iterations, unsigned long *allocs)
+{
+    b->setup();
+
+    unsigned long before = allocations;
+    double start = nowNs();
+    for (uint32_t k = 0; k < iterations; k++)
+        b->run(k);
+    double ns = nowNs() - start;
+
+    *allocs += allocations - before;
+    return ns;
+}
+
+// doubles the batch until it takes minNs, this also warms up caches and clock
+static uint32_t sizeBatch(const bench_t *b, double minNs)
+{
+    unsigned long allocs = 0;
+    uint32_t iterations = 1;
+
+    while (runBatch(b, iterations, &allocs) < minNs && iterations < (1u << 30))
+        iterations *= 2;
+    return iterations;
+}
+
+// == baseline ===================================================
+
+// the build type comes from the header bench -w writes, "unknown" without one
+static int readBaseline(const char *path, bench_result_t *baseline, char buildType[16])
+{
+    FILE *f = fopen(path, "r");
+    char line[128];
+    int count = 0;
+
+    snprintf(buildType, 16, "unknown");
+    if (f == NULL)
+        return -1;
+
+    while (count < BENCH_MAX_BASELINE && fgets(line, sizeof(line), f) != NULL)
+    {
+        bench_result_t *b = &baseline[count];
+
+        if (line[0] == '#')
+        {
+            sscanf(line, "# bench baseline: name ns/op allocs/op, %15s build", buildType);
+            continue;
+        }
+        if (sscanf(line, "%31s %lf %lf", b->name, &b->ns, &b->allocs) == 3)
+            ++count;
+    }
+
+    fclose(f);
+    return count;
+}
+
+static const bench_result_t *findBaseline(const bench_result_t *baseline, int count, const char *name)
+{
+    for (int k = 0; k < count; k++)
+        if (strcmp(baseline[k].name, name) == 0)
+            return &baseline[k];
+    return NULL;
+}
+
+static int writeBaseline(const char *path, const bench_result_t *results, int count)
+{
+    FILE *f = fopen(path, "w");
+
+    if (f == NULL)
+        return -1;
+
+    fprintf(f, "# bench baseline: name ns/op allocs/op, %s build, written by bench -w\n", BENCH_BUILD_TYPE);
+    for (int k = 0; k < count; k++)
+        fprintf(f, "%s %.2f %.3f\n", results[k].name, results[k].ns, results[k].allocs);
+
+    return fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+    const char *baselinePath = BENCH_BASELINE;
+    const char *writePath = NULL;
+    const char *prefix = "";
+    double threshold = 15, minMs = 50;
+    static bench_result_t baseline[BENCH_MAX_BASELINE];
+    static bench_result_t results[BENCHES];
+    int count = 0, regressions = 0;
+    char baselineType[16];
+
+    for (int k = 1; k < argc; k++)
+    {
+        if (strcmp(argv[k], "-b") == 0 && k + 1 < argc)
+            baselinePath = argv[++k];
+        else if (strcmp(argv[k], "-w") == 0 && k + 1 < argc)
+            writePath = argv[++k];
+        else if (strcmp(argv[k], "-t") == 0 && k + 1 < argc)
+            threshold = atof(argv[++k]);
+        else if (strcmp(argv[k], "-m") == 0 && k + 1 < argc)
+            minMs = atof(argv[++k]);
+        else if (argv[k][0] != '-')
+            prefix = argv[k];
+        else
+        {
+            fprintf(stderr, "usage: %s [-b baseline] [-w file] [-t percent] [-m ms] [name prefix]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    int baselineCount = readBaseline(baselinePath, baseline, baselineType);
+    if (baselineCount < 0)
+        printf("no baseline at %s\n", baselinePath);
+    printf("%s build, allocations %s\n", BENCH_BUILD_TYPE, BENCH_WRAP_ALLOC ? "counted" : "not counted");
+
+    // other optimization flags make every delta meaningless, the allocations still compare
+    bool compareTimes = strcmp(baselineType, BENCH_BUILD_TYPE) == 0;
+    if (baselineCount >= 0 && !compareTimes)
+        printf("baseline is a %s build: times not compared, build with -DCMAKE_BUILD_TYPE=%s\n", baselineType,
+               baselineType);
+    printf("%-24s %10s %10s %10s %8s\n", "benchmark", "ns/op", "allocs/op", "base", "delta%");
+
+    const bench_t *selected[BENCHES];
+    for (size_t k = 0; k < BENCHES; k++)
+        if (strncmp(benches[k].name, prefix, strlen(prefix)) == 0)
+        {
+            bench_result_t *r = &results[count];
+
+            snprintf(r->name, sizeof(r->name), "%s", benches[k].name);
+            r->iterations = sizeBatch(&benches[k], minMs * 1e6);
+            selected[count++] = &benches[k];
+        }
+
+    for (int repeat = 0; repeat < BENCH_REPEATS; repeat++)
+        for (int k = 0; k < count; k++)
+        {
+            bench_result_t *r = &results[k];
+            unsigned long allocs = 0;
+            double ns = runBatch(selected[k], r->iterations, &allocs) / r->iterations;
+
+            if (repeat == 0 || ns < r->ns)
+                r->ns = ns;
+            r->allocs += (double)allocs / r->iterations / BENCH_REPEATS;
+        }
+
+    for (int k = 0; k < count; k++)
+    {
+        const bench_result_t *r = &results[k];
+        const bench_result_t *b = findBaseline(baseline, baselineCount, r->name);
+
+        if (b == NULL)
+        {
+            printf("%-24s %10.2f %10.3f %10s %8s\n", r->name, r->ns, r->allocs, "-", "-");
+            continue;
+        }
+
+        double delta = b->ns > 0 ? 100.0 * (r->ns - b->ns) / b->ns : 0;
+        int regressed = (compareTimes && delta > threshold) || r->allocs > b->allocs;
+
+        regressions += regressed;
+        if (compareTimes)
+            printf("%-24s %10.2f %10.3f %10.2f %+8.1f%s\n", r->name, r->ns, r->allocs, b->ns, delta,
+                   regressed ? "  REGRESSED" : "");
+        else
+            printf("%-24s %10.2f %10.3f %10s %8s%s\n", r->name, r->ns, r->allocs, "-", "-",
+                   regressed ? "  REGRESSED" : "");
+    }
+
+    if (writePath != NULL && writeBaseline(writePath, results, count) != 0)
+    {
+        perror(writePath);
+        return 2;
+    }
+
+    if (regressions > 0)
+    {
+        printf("%d regression%s beyond %.0f%% or in allocations\n", regressions, regressions > 1 ? "s" : "",
+               threshold);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,199 @@
+/*------------------------------------------------------------------------------
+
+	bus_sim: correctness and publish cost of the sample bus
+
+	usage: bus_sim [records] [subscribers] [bound_cycles]
+
+	One producer thread publishes numbered records, yielding every few of
+	them, every subscriber thread reads them back; one of them is slowed down
+	on purpose so the producer laps it. Checked per subscriber
+	  order     sequence numbers only ever increase
+	  torn      every field of a record belongs to the same sequence
+	  count     records read + overruns = records published
+	Then the publish cost, each call timed on its own with the cycle
+	counter (x86) or the monotonic clock, while the subscribers keep
+	reading. The run fails when the 99th percentile is above bound_cycles
+	(default 300), or when a check fails.
+
+---------------------------------------------------------------------------------*/
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "sample_bus.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES 1
+static inline uint64_t now(void) { return __rdtsc(); }
+#else
+#define CYCLES 0
+static inline uint64_t now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+#define SLOW_EVERY 64 // the slow subscriber sleeps after this many records
+#define YIELD_EVERY 8 // the producer lets the subscribers run, outside the timed call
+
+static sample_bus_t bus;
+static atomic_bool done;
+
+typedef struct
+{
+    bus_subscriber_t *sub;
+    int slow;
+    uint32_t read; // slow subscriber only, paces the sleeps
+    uint32_t outOfOrder;
+    uint32_t torn;
+} reader_t;
+
+static bus_record_t make(uint32_t seq)
+{
+    return (bus_record_t){
+        .timeUs = seq,
+        .type = BUS_SAMPLE,
+        .source = seq & 0xff,
+        .status = (int8_t)(seq >> 8),
+        .on = seq >> 16,
+        .humidity10 = (int16_t)seq,
+        .temperature10 = (int16_t)~seq,
+    };
+}
+
+static int consistent(const bus_record_t *r)
+{
+    bus_record_t expected = make((uint32_t)r->timeUs);
+
+    return r->source == expected.source && r->status == expected.status && r->on == expected.on &&
+           r->humidity10 == expected.humidity10 && r->temperature10 == expected.temperature10;
+}
+
+static void *reader(void *arg)
+{
+    reader_t *r = arg;
+    bus_record_t record;
+    int64_t last = -1;
+
+    while (1)
+    {
+        // the flag before the read, so the last records are drained after it is set
+        int finished = atomic_load(&done);
+
+        while (busRead(&bus, r->sub, &record))
+        {
+            if (record.timeUs <= last)
+                r->outOfOrder++;
+            if (!consistent(&record))
+                r->torn++;
+            last = record.timeUs;
+
+            if (r->slow && ++r->read % SLOW_EVERY == 0)
+                nanosleep(&(struct timespec){.tv_nsec = 100000}, NULL);
+        }
+
+        if (finished)
+            return NULL;
+        sched_yield();
+    }
+}
+
+static int compare(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t records = argc > 1 ? strtoul(argv[1], NULL, 0) : 2000000;
+    int subscribers = argc > 2 ? atoi(argv[2]) : 3;
+    uint64_t bound = argc > 3 ? strtoull(argv[3], NULL, 0) : 300;
+    reader_t readers[BUS_SUBSCRIBERS] = {{0}};
+    pthread_t threads[BUS_SUBSCRIBERS];
+    uint64_t *cost = malloc(records * sizeof(*cost));
+    int failed = 0;
+
+    if (subscribers < 1 || subscribers > BUS_SUBSCRIBERS || records == 0 || cost == NULL)
+    {
+        fprintf(stderr, "usage: bus_sim [records] [1..%d subscribers] [bound_cycles]\n", BUS_SUBSCRIBERS);
+        return 2;
+    }
+
+    busInit(&bus, "sim");
+    for (int k = 0; k < subscribers; k++)
+    {
+        readers[k].sub = busSubscribe(&bus, k == 0 ? "slow" : "fast", NULL, NULL);
+        readers[k].slow = k == 0;
+        pthread_create(&threads[k], NULL, reader, &readers[k]);
+    }
+
+    // what reading the clock twice costs, taken off every measurement
+    uint64_t overhead = UINT64_MAX;
+    for (int k = 0; k < 1000; k++)
+    {
+        uint64_t t0 = now();
+        uint64_t t1 = now();
+        if (t1 - t0 < overhead)
+            overhead = t1 - t0;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t seq = 0; seq < records; seq++)
+    {
+        bus_record_t record = make(seq);
+
+        uint64_t t0 = now();
+        busPublish(&bus, &record);
+        uint64_t t1 = now();
+        cost[seq] = t1 - t0 > overhead ? t1 - t0 - overhead : 0;
+
+        if (seq % YIELD_EVERY == 0)
+            sched_yield();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    atomic_store(&done, true);
+    for (int k = 0; k < subscribers; k++)
+        pthread_join(threads[k], NULL);
+
+    bus_subscriber_stats_t stats[BUS_SUBSCRIBERS];
+    busGetStats(&bus, stats);
+
+    printf("%-6s %10s %10s %8s %6s %s\n", "sub", "received", "overruns", "order", "torn", "count");
+    for (int k = 0; k < subscribers; k++)
+    {
+        int countOk = stats[k].received + stats[k].overruns == records;
+
+        printf("%-6s %10u %10u %8u %6u %s\n", stats[k].name, stats[k].received, stats[k].overruns,
+               readers[k].outOfOrder, readers[k].torn, countOk ? "ok" : "MISMATCH");
+        failed |= !countOk || readers[k].outOfOrder || readers[k].torn;
+    }
+
+    qsort(cost, records, sizeof(*cost), compare);
+    uint64_t p50 = cost[records / 2], p99 = cost[records / 100 * 99], max = cost[records - 1];
+    double wallNs = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / records;
+
+    printf("publish: %s p50 %llu p99 %llu max %llu (clock overhead %llu removed), %.1f ns/record with yields\n",
+           CYCLES ? "cycles" : "ns", (unsigned long long)p50, (unsigned long long)p99, (unsigned long long)max,
+           (unsigned long long)overhead, wallNs);
+    printf("bus: %zu bytes, %d slots of %zu bytes\n", sizeof(bus), BUS_LENGTH, sizeof(bus_slot_t));
+
+    if (CYCLES && p99 > bound)
+    {
+        printf("FAIL: p99 publish %llu cycles above the bound of %llu\n", (unsigned long long)p99,
+               (unsigned long long)bound);
+        failed = 1;
+    }
+
+    free(cost);
+    return failed;
+}
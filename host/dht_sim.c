@@ -0,0 +1,210 @@
+/*------------------------------------------------------------------------------
+
+	Simulated DHT22
+
+	Timing follows the datasheet copied in main/DHT.cpp: after the host
+	releases the line the sensor answers 80us low / 80us high, then sends
+	40 bits of 50us low followed by 26~28us ("0") or 70us ("1") high, and
+	a final 50us low before the line goes back to idle high.
+
+---------------------------------------------------------------------------------*/
+
+#include <math.h>
+#include <string.h>
+
+#include "dht_sim.h"
+
+#define SIM_WAKE_LOW_NS 1000000ULL // host low needed to wake the sensor
+#define SIM_RESPONSE_DELAY_US 30   // 20~40 us after release
+
+// == xorshift32, deterministic per seed =========================
+
+static uint32_t nextRandom(dht_sim_t *sim)
+{
+    uint32_t x = sim->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return sim->rng = x;
+}
+
+static float randomUnit(dht_sim_t *sim)
+{
+    return (nextRandom(sim) >> 8) * (1.0f / 16777216.0f);
+}
+
+static int chance(dht_sim_t *sim, float rate)
+{
+    return rate > 0 && randomUnit(sim) < rate;
+}
+
+// == frame bytes from the configured values =====================
+
+static void buildFrame(dht_sim_t *sim)
+{
+    int hum = (int)lroundf(sim->config.humidity * 10);
+    int temp = (int)lroundf(fabsf(sim->config.temperature) * 10);
+
+    if (sim->config.temperature < 0)
+        temp |= 0x8000;
+
+    sim->truth[0] = hum >> 8;
+    sim->truth[1] = hum & 0xFF;
+    sim->truth[2] = temp >> 8;
+    sim->truth[3] = temp & 0xFF;
+    sim->truth[4] = (sim->truth[0] + sim->truth[1] + sim->truth[2] + sim->truth[3]) & 0xFF;
+
+    memcpy(sim->frame, sim->truth, sizeof(sim->frame));
+    if (chance(sim, sim->config.corruptRate))
+        sim->frame[4] ^= 1 << (nextRandom(sim) & 7);
+}
+
+void simDHTInit(dht_sim_t *sim, const dht_sim_config_t *config)
+{
+    memset(sim, 0, sizeof(*sim));
+    sim->config = *config;
+    if (sim->config.clockScale <= 0)
+        sim->config.clockScale = 1.0f;
+    sim->rng = config->seed ? config->seed : 0x2545F491;
+    sim->hostLevel = 1;
+}
+
+// == one pulse of nominal length with the configured impairments
+
+static uint64_t pulseNs(dht_sim_t *sim, float nominalUs)
+{
+    float us = nominalUs * sim->config.clockScale;
+
+    if (sim->config.jitterUs > 0)
+        us += (2 * randomUnit(sim) - 1) * sim->config.jitterUs;
+    if (chance(sim, sim->config.stretchRate))
+        us += sim->config.stretchUs;
+
+    return us < 1 ? 1000 : (uint64_t)(us * 1000);
+}
+
+static void addEdge(dht_sim_t *sim, uint64_t ns, int level)
+{
+    if (sim->edgeCount < DHT_SIM_MAX_EDGES)
+    {
+        sim->edgeNs[sim->edgeCount] = ns;
+        sim->edgeLevel[sim->edgeCount] = level;
+        ++sim->edgeCount;
+    }
+}
+
+/*----------------------------------------------------------------------------
+;
+;	generate the response to a start signal released at releaseNs
+
+	A dropped rising edge keeps the line low through the following high,
+	the low then merges with the next bit's low.
+
+;----------------------------------------------------------------------------*/
+
+void simDHTFrame(dht_sim_t *sim, uint64_t releaseNs)
+{
+    uint64_t t = releaseNs + pulseNs(sim, SIM_RESPONSE_DELAY_US);
+    int dropped = 0;
+
+    buildFrame(sim);
+    sim->edgeCount = 0;
+    sim->cursor = 0;
+
+    addEdge(sim, t, 0);
+    t += pulseNs(sim, 80);
+    addEdge(sim, t, 1);
+    t += pulseNs(sim, 80);
+
+    for (int k = 0; k < 40; k++)
+    {
+        int bit = (sim->frame[k / 8] >> (7 - k % 8)) & 1;
+
+        if (!dropped)
+            addEdge(sim, t, 0);
+        t += pulseNs(sim, 50);
+
+        dropped = chance(sim, sim->config.dropEdgeRate);
+        if (!dropped)
+            addEdge(sim, t, 1);
+        t += pulseNs(sim, bit ? 70 : 27);
+    }
+
+    if (!dropped)
+        addEdge(sim, t, 0);
+    t += pulseNs(sim, 50);
+    addEdge(sim, t, 1);
+}
+
+// == host drives or releases the line ===========================
+
+void simDHTHostDrive(dht_sim_t *sim, uint64_t nowNs, int driving, int level)
+{
+    int wasLow = sim->hostDriving && sim->hostLevel == 0;
+    int isLow = driving && level == 0;
+
+    if (isLow && !wasLow)
+        sim->hostLowSinceNs = nowNs;
+
+    // a long enough low followed by a release is a start signal
+    if (wasLow && !isLow && nowNs - sim->hostLowSinceNs >= SIM_WAKE_LOW_NS)
+        simDHTFrame(sim, nowNs);
+
+    sim->hostDriving = driving;
+    sim->hostLevel = level;
+}
+
+// == line level seen by the host at nowNs =======================
+
+int simDHTLevel(dht_sim_t *sim, uint64_t nowNs)
+{
+    if (sim->hostDriving)
+        return sim->hostLevel;
+
+    if (sim->cursor > 0 && sim->edgeNs[sim->cursor - 1] > nowNs)
+        sim->cursor = 0;
+
+    while (sim->cursor < sim->edgeCount && sim->edgeNs[sim->cursor] <= nowNs)
+        ++sim->cursor;
+
+    return sim->cursor == 0 ? 1 : sim->edgeLevel[sim->cursor - 1];
+}
+
+// == the last frame as edges in us, as the async ISR records them
+
+int simDHTEdges(const dht_sim_t *sim, uint32_t *edgeUs, uint8_t *edgeLevel, int maxEdges)
+{
+    int n = sim->edgeCount < maxEdges ? sim->edgeCount : maxEdges;
+
+    for (int k = 0; k < n; k++)
+    {
+        edgeUs[k] = (uint32_t)(sim->edgeNs[k] / 1000);
+        edgeLevel[k] = sim->edgeLevel[k];
+    }
+
+    return n;
+}
+
+// == the last frame sampled at 1 MHz, MSB first, from its first edge
+
+int simDHTBitstream(const dht_sim_t *sim, uint32_t *words, int maxSamples)
+{
+    uint64_t t0 = sim->edgeCount ? sim->edgeNs[0] - 20000 : 0;
+    int level = 1;
+    int edge = 0;
+
+    memset(words, 0, (maxSamples + 31) / 32 * sizeof(uint32_t));
+
+    for (int k = 0; k < maxSamples; k++)
+    {
+        uint64_t t = t0 + (uint64_t)k * 1000;
+
+        while (edge < sim->edgeCount && sim->edgeNs[edge] <= t)
+            level = sim->edgeLevel[edge++];
+
+        if (level)
+            words[k >> 5] |= 1UL << (31 - (k & 31));
+    }
+
+    return maxSamples;
+}
@@ -0,0 +1,56 @@
+/*
+	Simulated DHT22 for the host build
+
+	Produces the protocol waveform of one sensor as a list of edges on a
+	nanosecond time base, with configurable impairments. The same waveform
+	can be read as a live line level (through the host HAL), as timestamped
+	edges or as a 1 MHz oversampled bitstream.
+*/
+
+#ifndef DHT_SIM_H_
+#define DHT_SIM_H_
+
+#include <stdint.h>
+
+#define DHT_SIM_MAX_EDGES 96
+
+typedef struct
+{
+    float humidity;     // %RH reported by the sensor
+    float temperature;  // degree Celsius reported by the sensor
+    float clockScale;   // sensor clock against datasheet timing, 1.0 = nominal
+    float jitterUs;     // every pulse is off by a uniform +-jitterUs
+    float stretchRate;  // probability a pulse is stretched ...
+    float stretchUs;    // ... by this many microseconds
+    float dropEdgeRate; // probability a rising data edge is lost
+    float corruptRate;  // probability the checksum byte is corrupted
+    uint32_t seed;
+} dht_sim_config_t;
+
+typedef struct
+{
+    dht_sim_config_t config;
+    uint32_t rng;
+
+    uint8_t frame[5]; // bytes as sent, after any corruption
+    uint8_t truth[5]; // bytes the sensor meant to send
+
+    int edgeCount;
+    uint64_t edgeNs[DHT_SIM_MAX_EDGES];
+    uint8_t edgeLevel[DHT_SIM_MAX_EDGES]; // level right after the edge
+    int cursor;
+
+    // host side of the open-drain line
+    int hostDriving;
+    int hostLevel;
+    uint64_t hostLowSinceNs;
+} dht_sim_t;
+
+void simDHTInit(dht_sim_t *sim, const dht_sim_config_t *config);
+void simDHTFrame(dht_sim_t *sim, uint64_t releaseNs);
+void simDHTHostDrive(dht_sim_t *sim, uint64_t nowNs, int driving, int level);
+int simDHTLevel(dht_sim_t *sim, uint64_t nowNs);
+int simDHTEdges(const dht_sim_t *sim, uint32_t *edgeUs, uint8_t *edgeLevel, int maxEdges);
+int simDHTBitstream(const dht_sim_t *sim, uint32_t *words, int maxSamples);
+
+#endif
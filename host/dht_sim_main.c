@@ -0,0 +1,371 @@
+/*------------------------------------------------------------------------------
+
+	dht_sim: decode error rates and CPU cost per read against the simulator
+
+	usage: dht_sim [reads per profile]
+
+	Every impairment profile is run through three paths:
+	  busywait   readDHTSample() from main/DHT.cpp on the host HAL, as the
+	             sampler runs it with the busy-wait backend
+	  edges      edgesToDHTPulses(), as fed by the interrupt driven read
+	  bitstream  decodeDHTBitstream(), as fed by an oversampling capture
+	  spi x4     splitDHTBitstream() and decodeDHTBitstream() on line 0 of a
+	             quad SPI capture, three clean sensors on the other lines
+	  multi x4   splitDHTTrace() and decodeDHTPulses() on the first pin of a
+	             shared input register trace, as readDHTMulti() records it,
+	             with the same three clean sensors on other pins
+
+	After the decode table, the retry schedule of main/DHT_retry.c is checked
+	for several periods and failure streaks: no two reads closer than the
+	sensor's minimum interval, every read that is not an early retry on the
+	period grid. A violation makes the exit status non-zero.
+
+	ns/read is host CPU time of the decode (the whole readDHTSample() for busywait,
+	which runs on the virtual clock). "wrong" counts frames that passed the checksum with values that differ
+	from what the sensor meant to send.
+
+---------------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "DHT.h"
+#include "DHT_decode.h"
+#include "DHT_retry.h"
+#include "DHT_trace.h"
+#include "dht_sim.h"
+#include "hal_host.h"
+
+#define SIM_PIN 4
+#define SIM_BITSTREAM_SAMPLES 6144
+#define SIM_SPI_LINES 4
+#define SIM_MULTI_SENSORS 4
+#define SIM_MULTI_PULSES 48 // DHT_MULTI_MAX_PULSES
+
+static const int multiGpios[SIM_MULTI_SENSORS] = {SIM_PIN, 5, 18, 19};
+
+typedef struct
+{
+    const char *name;
+    dht_sim_config_t config;
+} sim_profile_t;
+
+static const sim_profile_t profiles[] = {
+    {"clean", {.humidity = 65.2f, .temperature = 35.1f}},
+    {"jitter 3us", {.humidity = 48.7f, .temperature = -4.3f, .jitterUs = 3}},
+    {"jitter 8us", {.humidity = 48.7f, .temperature = -4.3f, .jitterUs = 8}},
+    {"clock -15%", {.humidity = 71.0f, .temperature = 22.5f, .clockScale = 0.85f, .jitterUs = 2}},
+    {"clock +15%", {.humidity = 71.0f, .temperature = 22.5f, .clockScale = 1.15f, .jitterUs = 2}},
+    {"stretched", {.humidity = 55.5f, .temperature = 18.0f, .stretchRate = 0.02f, .stretchUs = 15}},
+    {"dropped edges", {.humidity = 55.5f, .temperature = 18.0f, .dropEdgeRate = 0.002f}},
+    {"bad checksum", {.humidity = 99.9f, .temperature = 40.0f, .corruptRate = 0.05f}},
+};
+
+typedef struct
+{
+    int ok, checksum, timeout, wrong;
+    double ns;
+} sim_result_t;
+
+typedef int (*sim_path_t)(dht_sim_t *sim, uint8_t *dhtData, double *ns);
+
+static double nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// == the three paths under test =================================
+
+static int pathBusyWait(dht_sim_t *sim, uint8_t *dhtData, double *ns)
+{
+    halHostAttach(SIM_PIN, sim);
+    setDHTgpio(SIM_PIN);
+
+    dht_sample_t sample;
+
+    double start = nowNs();
+    int ret = readDHTSample(&sample);
+    *ns += nowNs() - start;
+
+    // the sample only keeps the converted values, compare on those
+    int hum = sample.humidity10;
+    int temp = sample.temperature10 < 0 ? -sample.temperature10 | 0x8000 : sample.temperature10;
+
+    dhtData[0] = hum >> 8;
+    dhtData[1] = hum & 0xFF;
+    dhtData[2] = temp >> 8;
+    dhtData[3] = temp & 0xFF;
+    return ret;
+}
+
+static int pathEdges(dht_sim_t *sim, uint8_t *dhtData, double *ns)
+{
+    uint32_t edgeUs[DHT_SIM_MAX_EDGES];
+    uint8_t edgeLevel[DHT_SIM_MAX_EDGES];
+    dht_pulse_t pulses[DHT_SIM_MAX_EDGES / 2];
+
+    simDHTFrame(sim, 0);
+
+    int n = simDHTEdges(sim, edgeUs, edgeLevel, DHT_SIM_MAX_EDGES);
+
+    double start = nowNs();
+    int count = edgesToDHTPulses(edgeUs, edgeLevel, n, pulses, DHT_SIM_MAX_EDGES / 2);
+    int ret = decodeDHTPulses(pulses, count, dhtData);
+    if (ret == DHT_OK)
+        ret = verifyDHTChecksum(dhtData);
+    *ns += nowNs() - start;
+
+    return ret;
+}
+
+static int pathBitstream(dht_sim_t *sim, uint8_t *dhtData, double *ns)
+{
+    static uint32_t words[SIM_BITSTREAM_SAMPLES / 32];
+
+    simDHTFrame(sim, 0);
+    simDHTBitstream(sim, words, SIM_BITSTREAM_SAMPLES);
+
+    double start = nowNs();
+    int ret = decodeDHTBitstream(words, SIM_BITSTREAM_SAMPLES, dhtData);
+    *ns += nowNs() - start;
+
+    return ret;
+}
+
+// clean sensors next to the one under test, read together with it
+static dht_sim_t *otherSensors(void)
+{
+    static dht_sim_t others[SIM_SPI_LINES - 1];
+    static int initialized = 0;
+
+    if (!initialized)
+    {
+        for (int k = 0; k < SIM_SPI_LINES - 1; k++)
+        {
+            dht_sim_config_t config = {.humidity = 40.0f + 10 * k, .temperature = 20.0f + k};
+            simDHTInit(&others[k], &config);
+        }
+        initialized = 1;
+    }
+
+    return others;
+}
+
+// the profile's sensor on line 0, interleaved like the DMA buffer of a quad transfer
+static int pathSpiQuad(dht_sim_t *sim, uint8_t *dhtData, double *ns)
+{
+    static uint32_t lineWords[SIM_SPI_LINES][SIM_BITSTREAM_SAMPLES / 32];
+    static uint8_t raw[SIM_BITSTREAM_SAMPLES * SIM_SPI_LINES / 8];
+    static uint32_t words[SIM_BITSTREAM_SAMPLES / 32];
+    dht_sim_t *others = otherSensors();
+
+    simDHTFrame(sim, 0);
+    simDHTBitstream(sim, lineWords[0], SIM_BITSTREAM_SAMPLES);
+    for (int k = 1; k < SIM_SPI_LINES; k++)
+    {
+        simDHTFrame(&others[k - 1], 0);
+        simDHTBitstream(&others[k - 1], lineWords[k], SIM_BITSTREAM_SAMPLES);
+    }
+
+    // line n - 1 is the most significant bit of each sample group
+    memset(raw, 0, sizeof(raw));
+    for (int i = 0; i < SIM_BITSTREAM_SAMPLES; i++)
+        for (int k = 0; k < SIM_SPI_LINES; k++)
+            if (lineWords[k][i / 32] & (0x80000000u >> (i % 32)))
+            {
+                int bit = i * SIM_SPI_LINES + SIM_SPI_LINES - 1 - k;
+                raw[bit / 8] |= 0x80 >> (bit % 8);
+            }
+
+    double start = nowNs();
+    splitDHTBitstream(raw, SIM_BITSTREAM_SAMPLES, SIM_SPI_LINES, 0, words);
+    int ret = decodeDHTBitstream(words, SIM_BITSTREAM_SAMPLES, dhtData);
+    *ns += nowNs() - start;
+
+    return ret;
+}
+
+// the profile's sensor on the first pin, all edges merged into one register trace by time
+static int pathMulti(dht_sim_t *sim, uint8_t *dhtData, double *ns)
+{
+    static uint32_t edgeUs[SIM_MULTI_SENSORS][DHT_SIM_MAX_EDGES];
+    static uint8_t edgeLevel[SIM_MULTI_SENSORS][DHT_SIM_MAX_EDGES];
+    static uint32_t traceUs[SIM_MULTI_SENSORS * DHT_SIM_MAX_EDGES];
+    static uint32_t traceLevels[SIM_MULTI_SENSORS * DHT_SIM_MAX_EDGES];
+    static dht_pulse_t pulses[SIM_MULTI_SENSORS * SIM_MULTI_PULSES];
+    dht_sim_t *others = otherSensors();
+    int counts[SIM_MULTI_SENSORS], next[SIM_MULTI_SENSORS] = {0};
+    int pulseCounts[SIM_MULTI_SENSORS];
+    uint32_t levels = 0;
+    int traceLen = 0;
+
+    for (int s = 0; s < SIM_MULTI_SENSORS; s++)
+    {
+        dht_sim_t *sensor = s == 0 ? sim : &others[s - 1];
+
+        simDHTFrame(sensor, 0);
+        counts[s] = simDHTEdges(sensor, edgeUs[s], edgeLevel[s], DHT_SIM_MAX_EDGES);
+
+        // the line idles high unless its first edge is a rising one
+        if (counts[s] == 0 || edgeLevel[s][0] == 0)
+            levels |= 1UL << multiGpios[s];
+    }
+    uint32_t initialLevels = levels;
+
+    // edges at the same microsecond land in one register sample
+    for (;;)
+    {
+        uint32_t t = UINT32_MAX;
+        for (int s = 0; s < SIM_MULTI_SENSORS; s++)
+            if (next[s] < counts[s] && edgeUs[s][next[s]] < t)
+                t = edgeUs[s][next[s]];
+        if (t == UINT32_MAX)
+            break;
+
+        for (int s = 0; s < SIM_MULTI_SENSORS; s++)
+            while (next[s] < counts[s] && edgeUs[s][next[s]] == t)
+            {
+                uint32_t bit = 1UL << multiGpios[s];
+                levels = edgeLevel[s][next[s]] ? levels | bit : levels & ~bit;
+                next[s]++;
+            }
+
+        traceUs[traceLen] = t;
+        traceLevels[traceLen++] = levels;
+    }
+
+    double start = nowNs();
+    splitDHTTrace(traceUs, traceLevels, traceLen, initialLevels, multiGpios, SIM_MULTI_SENSORS, pulses,
+                  SIM_MULTI_PULSES, pulseCounts);
+    int ret = decodeDHTPulses(pulses, pulseCounts[0], dhtData);
+    if (ret == DHT_OK)
+        ret = verifyDHTChecksum(dhtData);
+    *ns += nowNs() - start;
+
+    return ret;
+}
+
+// == run one profile through one path ===========================
+
+static sim_result_t runPath(const sim_profile_t *profile, sim_path_t path, int reads)
+{
+    sim_result_t result = {0};
+    dht_sim_t sim;
+    double elapsed = 0;
+
+    simDHTInit(&sim, &profile->config);
+
+    for (int k = 0; k < reads; k++)
+    {
+        uint8_t dhtData[MAXdhtData] = {0};
+
+        int ret = path(&sim, dhtData, &elapsed);
+
+        if (ret == DHT_TIMEOUT_ERROR)
+            ++result.timeout;
+        else if (ret == DHT_CHECKSUM_ERROR)
+            ++result.checksum;
+        else if (memcmp(dhtData, sim.truth, 4) != 0)
+            ++result.wrong;
+        else
+            ++result.ok;
+    }
+
+    result.ns = elapsed / reads;
+    return result;
+}
+
+// == retry schedule, failed reads then good ones =================
+
+static bool checkRetrySchedule(uint32_t minIntervalMs, uint32_t periodMs, int failures)
+{
+    dht_retry_t retry;
+    uint32_t t = 0, last = 0;
+    bool early = false;
+
+    initDHTRetry(&retry, minIntervalMs, periodMs);
+
+    for (int k = 0; k < failures + 4; k++)
+    {
+        dht_sample_t sample = {.status = k < failures ? DHT_TIMEOUT_ERROR : DHT_OK, .timestamp = t * 1000LL};
+
+        if ((k > 0 && t - last < minIntervalMs) || (!early && t % periodMs != 0))
+        {
+            printf("  min %u ms, period %u ms, %d failed: read %d at %u ms %s\n", (unsigned)minIntervalMs,
+                   (unsigned)periodMs, failures, k, (unsigned)t,
+                   t - last < minIntervalMs ? "too early" : "off the grid");
+            return false;
+        }
+
+        uint32_t retries = retry.health.retries;
+        uint32_t delay = updateDHTRetry(&retry, &sample);
+
+        early = retry.health.retries != retries;
+        last = t;
+        t += delay;
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int reads = argc > 1 ? atoi(argv[1]) : 2000;
+    const struct
+    {
+        const char *name;
+        sim_path_t path;
+    } paths[] = {
+        {"busywait", pathBusyWait},
+        {"edges", pathEdges},
+        {"bitstream", pathBitstream},
+        {"spi x4", pathSpiQuad},
+        {"multi x4", pathMulti},
+    };
+
+    if (reads <= 0)
+    {
+        fprintf(stderr, "usage: %s [reads per profile]\n", argv[0]);
+        return 1;
+    }
+
+    printf("%-14s %-10s %8s %8s %8s %8s %10s\n", "profile", "path", "ok%", "cksum%", "tmout%", "wrong%", "ns/read");
+
+    for (size_t p = 0; p < sizeof(profiles) / sizeof(profiles[0]); p++)
+    {
+        for (size_t k = 0; k < sizeof(paths) / sizeof(paths[0]); k++)
+        {
+            sim_result_t r = runPath(&profiles[p], paths[k].path, reads);
+
+            printf("%-14s %-10s %8.2f %8.2f %8.2f %8.2f %10.0f\n", profiles[p].name, paths[k].name,
+                   100.0 * r.ok / reads, 100.0 * r.checksum / reads, 100.0 * r.timeout / reads,
+                   100.0 * r.wrong / reads, r.ns);
+        }
+    }
+
+    const uint32_t minIntervals[] = {1000, 2000};             // DHT11, DHT22 / AM2301
+    const uint32_t periods[] = {2000, 3000, 4000, 5000, 8000}; // the sampler's period
+    int schedules = 0, failed = 0;
+
+    printf("\nretry schedule\n");
+    for (size_t m = 0; m < sizeof(minIntervals) / sizeof(minIntervals[0]); m++)
+        for (size_t p = 0; p < sizeof(periods) / sizeof(periods[0]); p++)
+            for (int failures = 1; failures <= DHT_RETRY_MAX_EARLY + 2; failures++)
+            {
+                ++schedules;
+                if (!checkRetrySchedule(minIntervals[m], periods[p], failures))
+                    ++failed;
+            }
+    printf("  %d of %d schedules keep the grid and the minimum interval\n", schedules - failed, schedules);
+
+#if CONFIG_DHT_TRACE
+    printf("\n");
+    dumpDHTTrace();
+#endif
+
+    return failed ? 1 : 0;
+}
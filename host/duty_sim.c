@@ -0,0 +1,116 @@
+/*------------------------------------------------------------------------------
+
+	duty_sim: average current of deep sleep policies
+
+	usage: duty_sim [awake_ms] [wake_ms] [flush_ms] [active_ma] [sleep_ua]
+
+	Runs main/duty.c over a simulated day for a grid of sample periods and
+	flush intervals (wakes per flush). A cycle is the wake overhead (ROM
+	and bootloader), the app awake time and, every few wakes, the flush;
+	once an hour a pump run keeps the device awake for PUMP_RUN_S. The
+	defaults are the times the device prints in its "Duty" line; put in
+	your own to compare policies for a board. Reports per policy
+	  awake     mean and longest awake time per cycle
+	  flushes   flushes per day, records lost to a full buffer
+	  current   average from the accounting, and dutyEstimateUa() for the
+	            same policy without pump runs
+	  days      what a BATTERY_MAH cell lasts at that average
+
+---------------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "duty.h"
+#include "sensor_log.h"
+
+#define SIM_US (86400LL * 1000000)
+#define PUMP_EVERY_US (3600LL * 1000000)
+#define PUMP_RUN_S 10
+#define BATTERY_MAH 2000
+
+static const uint32_t periodsS[] = {2, 10, 30, 60, 300};
+static const int flushWakes[] = {1, 6, 30};
+
+#define PERIODS (sizeof(periodsS) / sizeof(periodsS[0]))
+#define FLUSHES (sizeof(flushWakes) / sizeof(flushWakes[0]))
+
+typedef struct
+{
+    uint32_t awakeUs;
+    uint32_t wakeUs;
+    uint32_t flushUs;
+    uint32_t activeUa;
+    uint32_t sleepUa;
+} costs_t;
+
+static void run(const costs_t *c, uint32_t periodS, int flushEvery)
+{
+    duty_t d;
+    int64_t nowUs = 0, pumpAtUs = PUMP_EVERY_US;
+    uint32_t periodUs = periodS * 1000000;
+
+    dutyInit(&d);
+    while (nowUs < SIM_US)
+    {
+        // the first cycle is a power-on, its boot time is not known
+        dutyWake(&d, d.wakes ? (int64_t)c->wakeUs : -1);
+        if (d.wakes > 1)
+            nowUs += c->wakeUs;
+
+        uint32_t appUs = c->awakeUs;
+        dutyAdd(&d, nowUs / 1000000, LOG_SAMPLE, 0, 650, 215);
+
+        // awake through the run, sampling on the grid
+        if (nowUs >= pumpAtUs)
+        {
+            dutyAdd(&d, nowUs / 1000000, LOG_PUMP_ON, 0, 0, 0);
+            for (uint32_t s = periodS; s < PUMP_RUN_S; s += periodS)
+                dutyAdd(&d, nowUs / 1000000 + s, LOG_SAMPLE, 0, 650, 215);
+            dutyAdd(&d, nowUs / 1000000 + PUMP_RUN_S, LOG_PUMP_OFF, 0, 0, 0);
+            appUs += PUMP_RUN_S * 1000000;
+            pumpAtUs += PUMP_EVERY_US;
+        }
+
+        if (dutyFlushDue(&d, flushEvery))
+        {
+            appUs += c->flushUs;
+            dutyFlushed(&d, c->flushUs);
+        }
+
+        nowUs += appUs;
+        nowUs += dutySleep(&d, nowUs, appUs, periodUs, 0);
+    }
+
+    uint32_t averageUa = dutyAverageUa(&d, c->activeUa, c->sleepUa);
+    uint32_t estimateUa =
+        dutyEstimateUa(c->awakeUs + c->wakeUs, c->flushUs, flushEvery, periodUs, c->activeUa, c->sleepUa);
+
+    printf("%6lu %6d %7lu %9.1f %9.1f %8lu %7lu %10lu %10lu %8.0f\n", (unsigned long)periodS, flushEvery,
+           (unsigned long)d.wakes, d.awakeUs / 1000.0 / d.wakes, d.maxAwakeUs / 1000.0, (unsigned long)d.flushes,
+           (unsigned long)d.dropped, (unsigned long)averageUa, (unsigned long)estimateUa,
+           BATTERY_MAH * 1000.0 / averageUa / 24);
+}
+
+int main(int argc, char **argv)
+{
+    costs_t c = {
+        .awakeUs = (argc > 1 ? atof(argv[1]) : 60) * 1000,
+        .wakeUs = (argc > 2 ? atof(argv[2]) : 40) * 1000,
+        .flushUs = (argc > 3 ? atof(argv[3]) : 150) * 1000,
+        .activeUa = (argc > 4 ? atof(argv[4]) : 40) * 1000,
+        .sleepUa = argc > 5 ? atoi(argv[5]) : 150,
+    };
+
+    printf("awake %.1f ms, wake %.1f ms, flush %.1f ms, active %.1f mA, sleep %lu uA, a %d s pump run every hour\n",
+           c.awakeUs / 1000.0, c.wakeUs / 1000.0, c.flushUs / 1000.0, c.activeUa / 1000.0, (unsigned long)c.sleepUa,
+           PUMP_RUN_S);
+    printf("%6s %6s %7s %9s %9s %8s %7s %10s %10s %8s\n", "period", "flush", "wakes", "awake_ms", "max_ms", "flushes",
+           "dropped", "avg_ua", "est_ua", "days");
+    for (size_t p = 0; p < PERIODS; p++)
+        for (size_t f = 0; f < FLUSHES; f++)
+            run(&c, periodsS[p], flushWakes[f]);
+    printf("days: a %d mAh cell at the average, self-discharge and regulator losses not included\n", BATTERY_MAH);
+    printf("duty_t: %zu bytes of RTC memory\n", sizeof(duty_t));
+    return 0;
+}
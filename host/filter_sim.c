@@ -0,0 +1,126 @@
+/*------------------------------------------------------------------------------
+
+	filter_sim: latency and outlier rejection of the conditioning stage
+
+	usage: filter_sim
+
+	Feeds main/filter.c with synthetic 2 s humidity series and reports
+	  step    samples until the output covers 50% / 90% of a 10% step,
+	          and the delay the filter measured itself
+	  spike   largest output excursion caused by outlier frames
+	  ramp    lag behind a steady 1%/min drift, in samples
+	and the host CPU time per filterAdd().
+
+---------------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "filter.h"
+
+#define SAMPLE_PERIOD_S 2
+#define BASE_HUMIDITY 600 // deci-percent
+#define RUN_SAMPLES 200
+#define BENCH_SAMPLES 10000000
+
+static int16_t run(filter_t *filter, int k, int16_t humidity)
+{
+    int16_t raw[FILTER_CHANNELS] = {humidity, 215};
+    int16_t out[FILTER_CHANNELS];
+
+    filterAdd(filter, k * SAMPLE_PERIOD_S, raw, out);
+    return out[FILTER_HUMIDITY];
+}
+
+static void stepResponse(void)
+{
+    filter_t filter;
+    int half = -1, ninety = -1;
+
+    filterInit(&filter);
+    for (int k = 0; k < RUN_SAMPLES; k++)
+    {
+        int stepped = k >= RUN_SAMPLES / 2;
+        int16_t out = run(&filter, k, BASE_HUMIDITY + (stepped ? 100 : 0));
+
+        if (stepped && half < 0 && out >= BASE_HUMIDITY + 50)
+            half = k - RUN_SAMPLES / 2;
+        if (stepped && ninety < 0 && out >= BASE_HUMIDITY + 90)
+            ninety = k - RUN_SAMPLES / 2;
+    }
+
+    printf("step    50%% after %d samples (%d s), 90%% after %d samples (%d s), expected delay %d samples\n",
+           half, half * SAMPLE_PERIOD_S, ninety, ninety * SAMPLE_PERIOD_S, FILTER_DELAY_SAMPLES);
+    printf("        filter measured %lu s over %lu step(s)\n", (unsigned long)filter.latency[FILTER_HUMIDITY].lastS,
+           (unsigned long)filter.latency[FILTER_HUMIDITY].steps);
+}
+
+static void spikeRejection(int burst)
+{
+    filter_t filter;
+    int worst = 0;
+
+    filterInit(&filter);
+    for (int k = 0; k < RUN_SAMPLES; k++)
+    {
+        int spike = k >= RUN_SAMPLES / 2 && k < RUN_SAMPLES / 2 + burst;
+        int16_t out = run(&filter, k, spike ? 999 : BASE_HUMIDITY);
+
+        if (abs(out - BASE_HUMIDITY) > worst)
+            worst = abs(out - BASE_HUMIDITY);
+    }
+
+    printf("spike   %d frame(s) of 99.9%%: output moved %d.%d%%\n", burst, worst / 10, worst % 10);
+}
+
+static void rampLag(void)
+{
+    filter_t filter;
+    double lag = 0;
+    int counted = 0;
+
+    // 1%/min = 10 deci-percent per 30 samples
+    filterInit(&filter);
+    for (int k = 0; k < RUN_SAMPLES; k++)
+    {
+        int16_t in = BASE_HUMIDITY + k * 10 / 30;
+        int16_t out = run(&filter, k, in);
+
+        if (k >= RUN_SAMPLES / 2)
+        {
+            lag += (in - out) * 30.0 / 10;
+            ++counted;
+        }
+    }
+
+    printf("ramp    lag %.1f samples\n", lag / counted);
+}
+
+static void bench(void)
+{
+    filter_t filter;
+    struct timespec t0, t1;
+    volatile int16_t sink = 0;
+
+    filterInit(&filter);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int k = 0; k < BENCH_SAMPLES; k++)
+        sink += run(&filter, k, BASE_HUMIDITY + (int)((k * 7919u) % 41) - 20);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+    printf("cost    %.1f ns per sample (both channels)\n", ns / BENCH_SAMPLES);
+}
+
+int main(void)
+{
+    stepResponse();
+    spikeRejection(1);
+    spikeRejection(2);
+    spikeRejection(3);
+    rampLag();
+    bench();
+
+    return 0;
+}
@@ -0,0 +1,112 @@
+/*------------------------------------------------------------------------------
+
+	HAL for the host build, on a virtual clock
+
+---------------------------------------------------------------------------------*/
+
+#include <stddef.h>
+
+#include "hal_host.h"
+
+static uint64_t nowNs = 0;
+static uint32_t pollCostNs = 100; // roughly one GPIO register read plus loop overhead
+static dht_sim_t *sims[HAL_HOST_MAX_PINS];
+static uint8_t outputLevel[HAL_HOST_MAX_PINS];
+static uint8_t outputEnabled[HAL_HOST_MAX_PINS];
+
+// == host controls ==============================================
+
+void halHostAttach(int pin, dht_sim_t *sim)
+{
+    sims[pin] = sim;
+}
+
+void halHostSetPollCost(uint32_t costNs)
+{
+    pollCostNs = costNs;
+}
+
+uint64_t halHostNowNs(void)
+{
+    return nowNs;
+}
+
+int halHostPinLevel(int pin)
+{
+    return outputLevel[pin];
+}
+
+static void drive(int pin)
+{
+    if (sims[pin] != NULL)
+        simDHTHostDrive(sims[pin], nowNs, outputEnabled[pin], outputLevel[pin]);
+}
+
+// == pins =======================================================
+
+void halPinOutput(int pin)
+{
+    outputEnabled[pin] = 1;
+    drive(pin);
+}
+
+void halPinInput(int pin)
+{
+    outputEnabled[pin] = 0;
+    drive(pin);
+}
+
+void halPinWrite(int pin, int level)
+{
+    outputLevel[pin] = level ? 1 : 0;
+    drive(pin);
+}
+
+int halPinRead(int pin)
+{
+    nowNs += pollCostNs;
+
+    if (sims[pin] == NULL)
+        return outputEnabled[pin] ? outputLevel[pin] : 1;
+
+    return simDHTLevel(sims[pin], nowNs);
+}
+
+// == clocks and delays ==========================================
+
+void halDelayUs(uint32_t us)
+{
+    nowNs += (uint64_t)us * 1000;
+}
+
+void halDelayMs(uint32_t ms)
+{
+    nowNs += (uint64_t)ms * 1000000;
+}
+
+uint32_t halCycles(void)
+{
+    nowNs += pollCostNs;
+    return (uint32_t)(nowNs * HAL_HOST_CYCLES_PER_US / 1000);
+}
+
+uint32_t halCyclesPerUs(void)
+{
+    return HAL_HOST_CYCLES_PER_US;
+}
+
+int64_t halMicros(void)
+{
+    return nowNs / 1000;
+}
+
+// nothing interrupts the virtual clock
+uint32_t halMaskInterrupts(void)
+{
+    return 0;
+}
+
+void halUnmaskInterrupts(uint32_t state)
+{
+    (void)state;
+}
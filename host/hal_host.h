@@ -0,0 +1,26 @@
+/*
+	Host HAL controls
+
+	The host HAL runs on a virtual clock: delays advance it instantly and
+	every pin read or cycle counter read costs pollCostNs, the way a polling
+	loop costs time on the target. Pins with an attached simulator read the
+	simulated line, all other pins read high.
+*/
+
+#ifndef HAL_HOST_H_
+#define HAL_HOST_H_
+
+#include <stdint.h>
+
+#include "dht_sim.h"
+#include "hal.h"
+
+#define HAL_HOST_MAX_PINS 40
+#define HAL_HOST_CYCLES_PER_US 240 // ESP32 at 240 MHz
+
+void halHostAttach(int pin, dht_sim_t *sim);
+void halHostSetPollCost(uint32_t pollCostNs);
+uint64_t halHostNowNs(void);
+int halHostPinLevel(int pin);
+
+#endif
@@ -0,0 +1,151 @@
+/*------------------------------------------------------------------------------
+
+	http_load: latency and heap usage of the HTTP metrics endpoint
+
+	usage: http_load <host> [port] [requests] [path]
+
+	Sends the requests one after the other (a new connection each, like
+	a Prometheus scrape) and reports the latency percentiles and bytes per
+	response. Before and after the run /metrics is fetched and the
+	device's free heap and low-water mark are compared, so heap growth
+	under load shows up as a delta.
+
+---------------------------------------------------------------------------------*/
+
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RESPONSE_MAX (64 * 1024)
+
+static char response[RESPONSE_MAX];
+
+static double nowMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// one GET, returns the response length (headers included) or -1
+static int get(const char *host, const char *port, const char *path)
+{
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *addr;
+    char request[256];
+    int len = 0;
+
+    if (getaddrinfo(host, port, &hints, &addr) != 0)
+        return -1;
+
+    int fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+    if (fd < 0 || connect(fd, addr->ai_addr, addr->ai_addrlen) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        freeaddrinfo(addr);
+        return -1;
+    }
+    freeaddrinfo(addr);
+
+    int n = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n", path, host);
+    if (write(fd, request, n) != n)
+    {
+        close(fd);
+        return -1;
+    }
+
+    while (len < RESPONSE_MAX - 1 && (n = read(fd, response + len, RESPONSE_MAX - 1 - len)) > 0)
+        len += n;
+    response[len] = '\0';
+
+    close(fd);
+    return strncmp(response, "HTTP/1.1 200", 12) == 0 ? len : -1;
+}
+
+static long metric(const char *name)
+{
+    char key[64];
+    snprintf(key, sizeof(key), "\n%s ", name);
+
+    const char *p = strstr(response, key);
+    return p ? atol(p + strlen(key)) : -1;
+}
+
+static int heap(const char *host, const char *port, long *freeBytes, long *minFree)
+{
+    if (get(host, port, "/metrics") < 0)
+        return -1;
+
+    *freeBytes = metric("ibaum_heap_bytes{region=\"internal\",stat=\"free\"}");
+    *minFree = metric("ibaum_heap_bytes{region=\"internal\",stat=\"min_free\"}");
+    return 0;
+}
+
+static int compareDouble(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv)
+{
+    const char *host = argc > 1 ? argv[1] : NULL;
+    const char *port = argc > 2 ? argv[2] : "80";
+    int count = argc > 3 ? atoi(argv[3]) : 100;
+    const char *path = argc > 4 ? argv[4] : "/metrics";
+    long freeBefore, minBefore, freeAfter, minAfter;
+
+    if (host == NULL || count <= 0)
+    {
+        fprintf(stderr, "usage: %s <host> [port] [requests] [path]\n", argv[0]);
+        return 1;
+    }
+
+    if (heap(host, port, &freeBefore, &minBefore) != 0)
+    {
+        fprintf(stderr, "%s:%s/metrics not reachable\n", host, port);
+        return 1;
+    }
+
+    double *latency = malloc(count * sizeof(double));
+    long bytes = 0;
+    int failed = 0, ok = 0;
+
+    for (int k = 0; k < count; k++)
+    {
+        double start = nowMs();
+        int len = get(host, port, path);
+
+        if (len < 0)
+        {
+            ++failed;
+            continue;
+        }
+        latency[ok++] = nowMs() - start;
+        bytes += len;
+    }
+
+    heap(host, port, &freeAfter, &minAfter);
+
+    if (ok == 0)
+    {
+        printf("%s: all %d requests failed\n", path, count);
+        free(latency);
+        return 1;
+    }
+
+    qsort(latency, ok, sizeof(double), compareDouble);
+    printf("%s: %d ok, %d failed, %ld bytes per response\n", path, ok, failed, bytes / ok);
+    printf("latency ms: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n", latency[ok / 2], latency[ok * 9 / 10],
+           latency[ok * 99 / 100], latency[ok - 1]);
+    printf("device heap: free %ld -> %ld (%+ld), low-water %ld -> %ld\n", freeBefore, freeAfter, freeAfter - freeBefore,
+           minBefore, minAfter);
+
+    free(latency);
+    return 0;
+}
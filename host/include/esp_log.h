@@ -0,0 +1,16 @@
+/*
+	Host stand-in for the ESP-IDF log macros
+*/
+
+#ifndef ESP_LOG_H_HOST_
+#define ESP_LOG_H_HOST_
+
+#include <stdio.h>
+
+#define ESP_LOGE(tag, format, ...) fprintf(stderr, "E (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) fprintf(stderr, "W (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) fprintf(stdout, "I (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ((void)(tag))
+#define ESP_LOGV(tag, format, ...) ((void)(tag))
+
+#endif
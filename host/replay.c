@@ -0,0 +1,441 @@
+/*------------------------------------------------------------------------------
+
+	replay: evaluate irrigation policies against recorded humidity traces
+
+	usage: replay [options] trace... > policies.csv
+
+	  trace             sensor logs (samples.log.old samples.log) or log2csv CSV
+	  -s days           synthetic trace instead: daily cycle, drift and noise
+	  -t from:to:step   HUMIDITY_THRESHOLD grid, percent   (default 60:80:2.5)
+	  -y from:to:step   HYSTERESIS grid, percent           (default 2:10:2)
+	  -d from:to:step   PUMP_DURATION_SECONDS grid         (default 5:60:5)
+	  -j threads        parallel workers                   (default: all cores)
+	  -e deci           pump effect, deci-percent per pump second (default 3)
+	  -r seconds        time constant the effect fades with       (default 1800)
+	  -f litres         pump flow per minute                      (default 2)
+	  -a                adaptive zones, the durations are the first pulses
+	  -m seconds        maxOnS of adaptive zones                  (default 60)
+	  -o seconds        minOffS                                   (default 0)
+
+	Every policy of the grid runs main/controller.c, the device's filters
+	and zones, over the whole trace with the recorded timestamps. Zone
+	timer events between samples are replayed from controllerNextDue(), so
+	the only thing simulated is the time in between.
+
+	A recorded trace already holds the effect of the pumps that ran when
+	it was taken. The replayed humidity is the recorded one plus the effect
+	of the simulated pump minus the effect of the recorded pump events,
+	both through the same first order model: while a pump runs humidity
+	moves by -e per second, and that offset fades with time constant r.
+
+	One CSV line per policy on stdout: pump cycles, pump time, water,
+	the largest and the integrated excess over the upper threshold, and
+	the time spent above it. Trace length, workers and the replay speed
+	go to stderr.
+
+---------------------------------------------------------------------------------*/
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "controller.h"
+#include "sensor_log.h"
+
+#define SAMPLE_PERIOD_S 10 // synthetic traces, and the gap assumed between two boots
+#define WORKERS_MAX 64
+
+typedef struct
+{
+    uint32_t timeS; // continuous over boots
+    uint8_t type;   // LOG_SAMPLE, LOG_PUMP_ON, LOG_PUMP_OFF
+    int16_t humidity;
+    int16_t temperature;
+} trace_record_t;
+
+typedef struct
+{
+    int16_t highDeci;
+    int16_t lowDeci;
+    uint16_t durationS;
+} policy_t;
+
+typedef struct
+{
+    uint32_t cycles;
+    uint32_t pumpS;
+    int overshootMaxDeci;
+    double overshootDeciS; // excess over highDeci integrated over time
+    uint32_t aboveS;
+} result_t;
+
+typedef struct
+{
+    double offset; // deci-percent
+    bool on;
+} pump_model_t;
+
+static trace_record_t *trace;
+static long traceCount, traceSize;
+
+static double effectDeci = 3;
+static double fadeS = 1800;
+static double flowLitres = 2;
+static bool adaptive;
+static int maxOnS = 60;
+static int minOffS;
+
+static policy_t *policies;
+static result_t *results;
+static long policyCount;
+static atomic_long nextPolicy;
+
+// == trace loading ================================================
+
+static void addRecord(uint16_t boot, uint32_t timeS, int type, int16_t humidity, int16_t temperature)
+{
+    static int lastBoot = -1;
+    static uint32_t base, lastS;
+
+    // every boot starts again at 0 s, continue where the previous one ended
+    if (boot != lastBoot)
+    {
+        base = traceCount ? lastS + SAMPLE_PERIOD_S - timeS : -timeS;
+        lastBoot = boot;
+    }
+
+    uint32_t continuousS = timeS + base;
+    if (traceCount && continuousS < lastS)
+        continuousS = lastS;
+    lastS = continuousS;
+
+    if (traceCount == traceSize)
+    {
+        traceSize = traceSize ? 2 * traceSize : 1 << 16;
+        trace = realloc(trace, traceSize * sizeof(*trace));
+        if (trace == NULL)
+        {
+            perror("replay");
+            exit(1);
+        }
+    }
+
+    trace[traceCount++] = (trace_record_t){continuousS, type, humidity, temperature};
+}
+
+static void loadLog(FILE *file)
+{
+    uint8_t slot[LOG_SEGMENT_SIZE];
+    log_record_t records[LOG_PAYLOAD_SIZE];
+
+    while (fread(slot, LOG_SEGMENT_SIZE, 1, file) == 1)
+    {
+        int count = logDecodeSegment(slot, records, LOG_PAYLOAD_SIZE);
+
+        for (int k = 0; k < count; k++)
+            addRecord(records[k].boot, records[k].timeS, records[k].type, records[k].humidity,
+                      records[k].temperature);
+    }
+}
+
+static void loadCsv(FILE *file)
+{
+    char line[128], event[16];
+    unsigned boot, timeS;
+    double humidity, temperature;
+
+    while (fgets(line, sizeof(line), file))
+    {
+        int n = sscanf(line, "%u,%u,%15[^,],%lf,%lf", &boot, &timeS, event, &humidity, &temperature);
+
+        if (n == 5 && strcmp(event, "sample") == 0)
+            addRecord(boot, timeS, LOG_SAMPLE, lround(humidity * 10), lround(temperature * 10));
+        else if (n >= 3 && strcmp(event, "pump_on") == 0)
+            addRecord(boot, timeS, LOG_PUMP_ON, 0, 0);
+        else if (n >= 3 && strcmp(event, "pump_off") == 0)
+            addRecord(boot, timeS, LOG_PUMP_OFF, 0, 0);
+    }
+}
+
+static int loadFile(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    char start[5] = {0};
+
+    if (file == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+
+    // log2csv output starts with its header, anything else is taken for a sensor log
+    if (fread(start, 1, 5, file) == 5 && memcmp(start, "boot,", 5) == 0)
+    {
+        rewind(file);
+        loadCsv(file);
+    }
+    else
+    {
+        rewind(file);
+        loadLog(file);
+    }
+
+    fclose(file);
+    return 0;
+}
+
+static void synthesize(int days)
+{
+    uint32_t seed = 12345;
+    double drift = 0;
+
+    for (uint32_t t = 0; t < days * 86400u; t += SAMPLE_PERIOD_S)
+    {
+        seed = seed * 1103515245 + 12345;
+        double noise = (int)(seed >> 16 & 0xFF) / 32.0 - 4;
+
+        seed = seed * 1103515245 + 12345;
+        drift += ((int)(seed >> 16 & 0xFF) - 127.5) / 256.0;
+        drift *= 0.999;
+
+        double humidity = 700 + 100 * sin(2 * M_PI * t / 86400) + drift + noise;
+        addRecord(0, t, LOG_SAMPLE, lround(humidity), 215);
+    }
+}
+
+// == one policy over the whole trace ==============================
+
+static void advance(pump_model_t *model, double dtS)
+{
+    double fade = exp(-dtS / fadeS);
+
+    model->offset *= fade;
+    if (model->on)
+        model->offset -= effectDeci * fadeS * (1 - fade);
+}
+
+static void step(controller_t *c, uint32_t nowS, pump_model_t *simulated)
+{
+    zone_action_t actions[ZONES_MAX];
+    int n = controllerStep(c, nowS, actions);
+
+    for (int k = 0; k < n; k++)
+        simulated->on = actions[k].on;
+}
+
+static void evaluate(const policy_t *policy, result_t *result)
+{
+    const zone_config_t config = {
+        .name = "replay",
+        .sensors = {0},
+        .sensorCount = 1,
+        .relay = 0,
+        .highDeci = policy->highDeci,
+        .lowDeci = policy->lowDeci,
+        .pumpDurationS = policy->durationS,
+        .adaptive = adaptive,
+        .maxOnS = adaptive && maxOnS > policy->durationS ? maxOnS : 0,
+        .minOffS = minOffS,
+    };
+    controller_t c;
+    pump_model_t simulated = {0}, recorded = {0};
+    uint32_t nowS = trace[0].timeS;
+    uint32_t lastSampleS = nowS;
+
+    memset(result, 0, sizeof(*result));
+    controllerInit(&c, &config, 1, 1, 0);
+
+    for (long k = 0; k < traceCount; k++)
+    {
+        const trace_record_t *r = &trace[k];
+        uint32_t dueS;
+
+        // pump stops and ends of minOffS due before this record
+        while ((dueS = controllerNextDue(&c, nowS)) != ZONES_NOT_DUE && dueS > nowS && dueS < r->timeS)
+        {
+            advance(&simulated, dueS - nowS);
+            advance(&recorded, dueS - nowS);
+            nowS = dueS;
+            step(&c, nowS, &simulated);
+        }
+
+        advance(&simulated, r->timeS - nowS);
+        advance(&recorded, r->timeS - nowS);
+        nowS = r->timeS;
+
+        if (r->type != LOG_SAMPLE)
+        {
+            recorded.on = r->type == LOG_PUMP_ON;
+            continue;
+        }
+
+        long humidity = r->humidity + lround(simulated.offset - recorded.offset);
+        humidity = humidity < 0 ? 0 : humidity > 1000 ? 1000 : humidity;
+
+        int excess = humidity - policy->highDeci;
+        if (excess > 0)
+        {
+            if (excess > result->overshootMaxDeci)
+                result->overshootMaxDeci = excess;
+            result->overshootDeciS += (double)excess * (nowS - lastSampleS);
+            result->aboveS += nowS - lastSampleS;
+        }
+        lastSampleS = nowS;
+
+        int16_t raw[FILTER_CHANNELS] = {humidity, r->temperature};
+        int16_t filtered[FILTER_CHANNELS];
+        controllerSample(&c, 0, nowS, raw, filtered);
+        step(&c, nowS, &simulated);
+    }
+
+    const zone_t *zone = &c.zones.zones[0];
+    result->cycles = zone->pumpCycles;
+    result->pumpS = zone->pumpSeconds + (zone->state == ZONE_PUMPING ? nowS - zone->sinceS : 0);
+}
+
+static void *worker(void *arg)
+{
+    long k;
+
+    (void)arg;
+    while ((k = atomic_fetch_add(&nextPolicy, 1)) < policyCount)
+        evaluate(&policies[k], &results[k]);
+
+    return NULL;
+}
+
+// == parameter grid ===============================================
+
+typedef struct
+{
+    double from, to, step;
+} range_t;
+
+static int parseRange(const char *text, range_t *range)
+{
+    int n = sscanf(text, "%lf:%lf:%lf", &range->from, &range->to, &range->step);
+
+    if (n == 1)
+    {
+        range->to = range->from;
+        range->step = 1;
+    }
+    else if (n != 3 || range->step <= 0 || range->to < range->from)
+        return -1;
+
+    return 0;
+}
+
+static int rangeCount(const range_t *range)
+{
+    return (int)((range->to - range->from) / range->step + 1e-9) + 1;
+}
+
+static double rangeValue(const range_t *range, int k)
+{
+    return range->from + k * range->step;
+}
+
+int main(int argc, char **argv)
+{
+    range_t thresholds = {60, 80, 2.5}, hystereses = {2, 10, 2}, durations = {5, 60, 5};
+    int workers = sysconf(_SC_NPROCESSORS_ONLN);
+    int days = 0, opt;
+
+    while ((opt = getopt(argc, argv, "s:t:y:d:j:e:r:f:am:o:")) != -1)
+    {
+        int bad = 0;
+
+        switch (opt)
+        {
+        case 's': days = atoi(optarg); break;
+        case 't': bad = parseRange(optarg, &thresholds); break;
+        case 'y': bad = parseRange(optarg, &hystereses); break;
+        case 'd': bad = parseRange(optarg, &durations); break;
+        case 'j': workers = atoi(optarg); break;
+        case 'e': effectDeci = atof(optarg); break;
+        case 'r': fadeS = atof(optarg); break;
+        case 'f': flowLitres = atof(optarg); break;
+        case 'a': adaptive = true; break;
+        case 'm': maxOnS = atoi(optarg); break;
+        case 'o': minOffS = atoi(optarg); break;
+        default: bad = 1;
+        }
+
+        if (bad)
+        {
+            fprintf(stderr, "usage: %s [-s days] [-t|-y|-d from:to:step] [-j threads] [-e deci] [-r s] [-f l] [-a] [-m s] [-o s] trace...\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    if (days > 0)
+        synthesize(days);
+    for (int k = optind; k < argc; k++)
+        if (loadFile(argv[k]) != 0)
+            return 1;
+
+    if (traceCount == 0)
+    {
+        fprintf(stderr, "no samples, pass a trace or -s days\n");
+        return 1;
+    }
+
+    // the grid, in the units of ibaum.c: thresholds and hysteresis in percent
+    int nt = rangeCount(&thresholds), ny = rangeCount(&hystereses), nd = rangeCount(&durations);
+    policyCount = (long)nt * ny * nd;
+    policies = calloc(policyCount, sizeof(*policies));
+    results = calloc(policyCount, sizeof(*results));
+
+    for (long k = 0; k < policyCount; k++)
+    {
+        double threshold = rangeValue(&thresholds, k / (ny * nd));
+        double hysteresis = rangeValue(&hystereses, k / nd % ny);
+
+        policies[k] = (policy_t){
+            .highDeci = lround((threshold + hysteresis) * 10),
+            .lowDeci = lround((threshold - hysteresis) * 10),
+            .durationS = lround(rangeValue(&durations, k % nd)),
+        };
+    }
+
+    workers = workers < 1 ? 1 : workers > WORKERS_MAX ? WORKERS_MAX : workers;
+    pthread_t threads[WORKERS_MAX];
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int k = 0; k < workers; k++)
+        pthread_create(&threads[k], NULL, worker, NULL);
+    for (int k = 0; k < workers; k++)
+        pthread_join(threads[k], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double spanS = trace[traceCount - 1].timeS - trace[0].timeS;
+    double spanDays = spanS > 0 ? spanS / 86400 : 1;
+
+    printf("threshold,hysteresis,duration_s,cycles,cycles_per_day,pump_s,water_l,water_l_per_day,"
+           "overshoot_max,overshoot_pct_h,above_threshold_h\n");
+    for (long k = 0; k < policyCount; k++)
+    {
+        const policy_t *p = &policies[k];
+        const result_t *r = &results[k];
+        double water = r->pumpS * flowLitres / 60;
+
+        printf("%.2f,%.2f,%u,%u,%.1f,%u,%.1f,%.2f,%.1f,%.2f,%.2f\n", (p->highDeci + p->lowDeci) / 20.0,
+               (p->highDeci - p->lowDeci) / 20.0, p->durationS, r->cycles, r->cycles / spanDays, r->pumpS, water,
+               water / spanDays, r->overshootMaxDeci / 10.0, r->overshootDeciS / 10 / 3600, r->aboveS / 3600.0);
+    }
+
+    double wallS = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "%ld records over %.1f days, %ld policies on %d workers in %.2f s, %.0fx real time\n", traceCount,
+            spanS / 86400, policyCount, workers, wallS, policyCount * spanS / wallS);
+
+    return 0;
+}
@@ -0,0 +1,320 @@
+/*------------------------------------------------------------------------------
+
+	telemetry_sim: the upload queue against a flaky receiver
+
+	usage: telemetry_sim [days]
+
+	Drives main/telemetry.c on a virtual clock with 10 s samples and a pump
+	cycle every two hours. The link goes down for 5 minutes, 1 hour, 12
+	hours and 3 days, and while it is up 5% of the sends fail. The device
+	reboots in the middle of the 12 hour outage. The receiver stand-in
+	decodes every batch, drops duplicates on (boot, baseTimeS) and checks
+	that records arrive in capture order, then reports
+	  delivery  records produced, delivered, lost with dropped batches
+	  memory    RAM of the queue, ring and spool high-water marks
+	  drain     time to empty the backlog after each outage
+	and the host CPU time and wire bytes per record with the link always up.
+	  storage   records delivered with SPIFFS down, no spool and a reboot
+	            every 6 hours, with the sensor log's boot number (0) and
+	            with the NVS counter
+	The spool file is created in the current directory and removed.
+
+---------------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "telemetry.h"
+
+#define SAMPLE_PERIOD_S 10
+#define PUMP_PERIOD_S 7200
+#define POLL_MS 500
+#define SPOOL_PATH "telemetry_sim.q"
+#define SPOOL_BYTES (32 * 1024) // TELEMETRY_SPOOL_BYTES in ibaum.c
+#define FAIL_PERCENT 5
+#define SEEN_SLOTS (1 << 16)
+#define BENCH_RECORDS 10000000
+
+static const struct
+{
+    uint32_t startS;
+    uint32_t lengthS;
+} outages[] = {{3600, 300}, {6 * 3600, 3600}, {12 * 3600, 12 * 3600}, {36 * 3600, 72 * 3600}};
+
+#define OUTAGES (sizeof(outages) / sizeof(outages[0]))
+#define REBOOT_S (18 * 3600)
+#define BROKEN_BOOTS 8
+#define BROKEN_UPTIME_S (6 * 3600)
+
+// == receiver stand-in ===========================================
+
+typedef struct
+{
+    uint32_t nowS;
+    bool steady; // no outages and no failed sends
+    uint32_t random;
+    uint64_t seen[SEEN_SLOTS]; // (boot, baseTimeS) + 1 of every delivered batch
+    uint64_t lastKey;          // (boot, timeS) of the newest record
+    long batches, duplicates, records, outOfOrder, failures;
+    uint32_t maxLatencyS;
+    uint32_t lastDeliveryS;
+} receiver_t;
+
+static bool linkUp(uint32_t nowS)
+{
+    for (size_t k = 0; k < OUTAGES; k++)
+        if (nowS >= outages[k].startS && nowS < outages[k].startS + outages[k].lengthS)
+            return false;
+
+    return true;
+}
+
+static uint32_t nextRandom(receiver_t *r)
+{
+    r->random ^= r->random << 13;
+    r->random ^= r->random >> 17;
+    r->random ^= r->random << 5;
+    return r->random;
+}
+
+// returns true when the batch was seen before
+static bool remember(receiver_t *r, uint64_t key)
+{
+    uint32_t slot = (uint32_t)(key * 0x9E3779B97F4A7C15ULL >> 48) & (SEEN_SLOTS - 1);
+
+    while (r->seen[slot])
+    {
+        if (r->seen[slot] == key + 1)
+            return true;
+        slot = (slot + 1) & (SEEN_SLOTS - 1);
+    }
+    r->seen[slot] = key + 1;
+
+    return false;
+}
+
+static int receive(void *context, const uint8_t *batch, int len)
+{
+    receiver_t *r = context;
+    log_record_t records[LOG_PAYLOAD_SIZE];
+    uint8_t slot[LOG_SEGMENT_SIZE];
+
+    if (!r->steady && (!linkUp(r->nowS) || nextRandom(r) % 100 < FAIL_PERCENT))
+    {
+        r->failures++;
+        return -1;
+    }
+
+    // batches come without their padding
+    memset(slot, 0xFF, sizeof(slot));
+    memcpy(slot, batch, len < LOG_SEGMENT_SIZE ? len : LOG_SEGMENT_SIZE);
+
+    int count = logDecodeSegment(slot, records, LOG_PAYLOAD_SIZE);
+    if (count <= 0)
+        return 0; // accepted and thrown away, like a broken upload on a real server
+
+    // the segment header carries the boot and the base time at bytes 6 and 8
+    if (remember(r, (uint64_t)records[0].boot << 32 | (slot[8] | slot[9] << 8 | slot[10] << 16 | (uint32_t)slot[11] << 24)))
+    {
+        r->duplicates++;
+        return 0;
+    }
+
+    r->batches++;
+    for (int k = 0; k < count; k++)
+    {
+        uint64_t key = (uint64_t)records[k].boot << 32 | records[k].timeS;
+
+        if (key < r->lastKey)
+            r->outOfOrder++;
+        r->lastKey = key;
+
+        if (r->nowS - records[k].timeS > r->maxLatencyS)
+            r->maxLatencyS = r->nowS - records[k].timeS;
+    }
+    r->records += count;
+    r->lastDeliveryS = r->nowS;
+
+    return 0;
+}
+
+// == the scenario ================================================
+
+// telemetry.c counts per boot, the scenario sums over the reboot
+static void addStats(telemetry_stats_t *total, const telemetry_stats_t *stats)
+{
+    total->dropped += stats->dropped;
+    total->spilled += stats->spilled;
+    total->batches += stats->batches;
+    if (stats->queuedMax > total->queuedMax)
+        total->queuedMax = stats->queuedMax;
+    if (stats->spoolBytesMax > total->spoolBytesMax)
+        total->spoolBytesMax = stats->spoolBytesMax;
+}
+
+static void scenario(int days)
+{
+    static receiver_t receiver;
+    static telemetry_t telemetry;
+    receiver_t *r = &receiver;
+    telemetry_stats_t stats, total = {0};
+    uint16_t boot = 1;
+    long produced = 0;
+    uint32_t endS = days * 86400;
+    int32_t drainS[OUTAGES];
+
+    for (size_t k = 0; k < OUTAGES; k++)
+        drainS[k] = -1;
+
+    remove(SPOOL_PATH);
+    r->random = 2463534242u;
+    telemetryOpen(&telemetry, SPOOL_PATH, SPOOL_BYTES, boot, receive, r);
+
+    // a day more than the samples, for the backlog to drain
+    for (uint64_t ms = 0; ms < (endS + 86400ULL) * 1000; ms += POLL_MS)
+    {
+        uint32_t nowS = ms / 1000;
+        r->nowS = nowS;
+
+        if (ms % 1000 == 0 && nowS < endS)
+        {
+            if (nowS % SAMPLE_PERIOD_S == 0)
+            {
+                telemetrySample(&telemetry, nowS, 600 + nowS / 60 % 50, 215 - nowS / 600 % 30);
+                ++produced;
+            }
+            if (nowS % PUMP_PERIOD_S == 5)
+            {
+                telemetryPump(&telemetry, nowS, true);
+                ++produced;
+            }
+            if (nowS % PUMP_PERIOD_S == 65)
+            {
+                telemetryPump(&telemetry, nowS, false);
+                ++produced;
+            }
+        }
+
+        if (ms == REBOOT_S * 1000ULL)
+        {
+            // the ring and the open batch go to the spool, the next boot sends them
+            telemetryClose(&telemetry);
+            telemetryGetStats(&telemetry, &stats);
+            addStats(&total, &stats);
+            telemetryOpen(&telemetry, SPOOL_PATH, SPOOL_BYTES, ++boot, receive, r);
+        }
+
+        telemetryPoll(&telemetry, ms, nowS);
+
+        // backlog gone: nothing in the ring or the spool
+        telemetryGetStats(&telemetry, &stats);
+        for (size_t k = 0; k < OUTAGES; k++)
+        {
+            uint32_t upS = outages[k].startS + outages[k].lengthS;
+
+            if (drainS[k] < 0 && nowS >= upS && upS < endS && stats.queued == 0 && stats.spoolBytes == 0)
+                drainS[k] = nowS - upS;
+        }
+    }
+
+    telemetryGetStats(&telemetry, &stats);
+    addStats(&total, &stats);
+    telemetryClose(&telemetry);
+    remove(SPOOL_PATH);
+
+    printf("delivery: %ld records produced, %ld delivered, %ld lost in %lu dropped batches\n", produced, r->records,
+           produced - r->records, (unsigned long)total.dropped);
+    printf("          %ld batches, %ld duplicates, %ld out of order, %ld failed sends\n", r->batches,
+           r->duplicates, r->outOfOrder, r->failures);
+    printf("          longest record delay %lu s\n", (unsigned long)r->maxLatencyS);
+    printf("memory:   telemetry_t %zu bytes RAM, ring max %u of %d batches, spool max %ld of %d bytes\n",
+           sizeof(telemetry_t), total.queuedMax, TELEMETRY_QUEUE_BATCHES, total.spoolBytesMax, SPOOL_BYTES);
+    for (size_t k = 0; k < OUTAGES; k++)
+        if (outages[k].startS + outages[k].lengthS < endS)
+            printf("drain:    %5lu min outage, backlog sent %ld s after the link came back\n",
+                   (unsigned long)outages[k].lengthS / 60, (long)drainS[k]);
+}
+
+// == SPIFFS down: no spool, and the uptime starts over with every boot ==
+
+static void brokenStorage(bool counted)
+{
+    static receiver_t receiver;
+    static telemetry_t telemetry;
+    long produced = 0;
+
+    memset(&receiver, 0, sizeof(receiver));
+    receiver.steady = true;
+
+    for (int boot = 0; boot < BROKEN_BOOTS; boot++)
+    {
+        // the sensor log numbers the boots only when it could be opened
+        telemetryOpen(&telemetry, NULL, 0, counted ? boot + 1 : 0, receive, &receiver);
+
+        for (uint32_t nowS = 0; nowS < BROKEN_UPTIME_S + 2 * TELEMETRY_BATCH_INTERVAL_S; nowS++)
+        {
+            receiver.nowS = nowS;
+            if (nowS < BROKEN_UPTIME_S && nowS % SAMPLE_PERIOD_S == 0)
+            {
+                telemetrySample(&telemetry, nowS, 600 + nowS / 60 % 40, 215);
+                produced++;
+            }
+            telemetryPoll(&telemetry, nowS * 1000, nowS);
+        }
+        telemetryClose(&telemetry);
+    }
+
+    printf("storage:  SPIFFS down, boot number from %s: %ld of %ld records delivered, %ld batches taken for "
+           "duplicates\n",
+           counted ? "NVS" : "the log", receiver.records, produced, receiver.duplicates);
+}
+
+// == CPU time and wire size with the link always up ===============
+
+static long benchBatches;
+static long benchBytes;
+
+static int sink(void *context, const uint8_t *batch, int len)
+{
+    (void)context;
+    (void)batch;
+    benchBatches++;
+    benchBytes += len;
+    return 0;
+}
+
+static void bench(void)
+{
+    static telemetry_t telemetry;
+    struct timespec t0, t1;
+
+    telemetryOpen(&telemetry, NULL, 0, 1, sink, NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (uint32_t k = 0; k < BENCH_RECORDS; k++)
+    {
+        uint32_t nowS = k * SAMPLE_PERIOD_S;
+
+        telemetrySample(&telemetry, nowS, 600 + (k * 7919u) % 23, 215 + k / 64 % 7);
+        telemetryPoll(&telemetry, nowS * 1000, nowS);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    telemetryClose(&telemetry);
+
+    double ns = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / BENCH_RECORDS;
+    printf("bench:    %.1f ns per record with a poll each, %.1f records per batch, %.1f bytes per record sent\n", ns,
+           (double)BENCH_RECORDS / benchBatches, (double)benchBytes / BENCH_RECORDS);
+}
+
+int main(int argc, char **argv)
+{
+    int days = argc > 1 ? atoi(argv[1]) : 6;
+
+    scenario(days > 0 ? days : 6);
+    brokenStorage(false);
+    brokenStorage(true);
+    bench();
+    return 0;
+}
@@ -0,0 +1,177 @@
+/*------------------------------------------------------------------------------
+
+	telemetry_sink: local receiver for the telemetry upload
+
+	usage: telemetry_sink [port] [fail_percent] > uploads.csv
+
+	Accepts the POSTs of main/uploader.c on any path, one connection at a
+	time with keep-alive, decodes every batch and writes the records as CSV
+	in the columns of log2csv. Batches seen before, by (boot, baseTimeS),
+	are acknowledged and skipped. With fail_percent some requests are
+	answered with 503 to exercise the device's retry and spool. Totals go
+	to stderr after every batch.
+
+---------------------------------------------------------------------------------*/
+
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "sensor_log.h"
+
+#define REQUEST_MAX 2048
+#define SEEN_MAX 65536
+
+static uint64_t seen[SEEN_MAX];
+static int seenCount;
+static long batches, duplicates, records, failed;
+
+static int isDuplicate(uint64_t key)
+{
+    for (int k = 0; k < seenCount; k++)
+        if (seen[k] == key)
+            return 1;
+
+    if (seenCount < SEEN_MAX)
+        seen[seenCount++] = key;
+    return 0;
+}
+
+static void printBatch(const uint8_t *body, int len)
+{
+    static const char *const events[] = {"sample", "pump_on", "pump_off", "unknown"};
+    log_record_t decoded[LOG_PAYLOAD_SIZE];
+    uint8_t slot[LOG_SEGMENT_SIZE];
+
+    // batches arrive without the slot padding
+    memset(slot, 0xFF, sizeof(slot));
+    memcpy(slot, body, len < LOG_SEGMENT_SIZE ? len : LOG_SEGMENT_SIZE);
+
+    int count = logDecodeSegment(slot, decoded, LOG_PAYLOAD_SIZE);
+    if (count <= 0)
+    {
+        fprintf(stderr, "invalid batch of %d bytes\n", len);
+        return;
+    }
+
+    uint32_t baseTimeS = slot[8] | slot[9] << 8 | slot[10] << 16 | (uint32_t)slot[11] << 24;
+    if (isDuplicate((uint64_t)decoded[0].boot << 32 | baseTimeS))
+    {
+        ++duplicates;
+        return;
+    }
+
+    for (int k = 0; k < count; k++)
+    {
+        const log_record_t *r = &decoded[k];
+
+        printf("%u,%u,%s,", r->boot, r->timeS, events[r->type]);
+        if (r->type == LOG_SAMPLE)
+            printf("%.1f,%.1f\n", r->humidity / 10.0, r->temperature / 10.0);
+        else
+            printf(",\n");
+    }
+    fflush(stdout);
+
+    ++batches;
+    records += count;
+}
+
+// bytes read from the connection, a request may arrive with the start of the next one
+typedef struct
+{
+    int fd;
+    char request[REQUEST_MAX];
+    int len;
+} connection_t;
+
+// one request from the connection, returns 0 when the peer closed it
+static int serve(connection_t *c, int failPercent)
+{
+    char *request = c->request;
+    int len = c->len, n;
+    int fd = c->fd;
+    char *body;
+
+    // headers, then as much of the body as Content-Length says
+    while ((body = strstr(request, "\r\n\r\n")) == NULL)
+    {
+        if (len == REQUEST_MAX - 1 || (n = read(fd, request + len, REQUEST_MAX - 1 - len)) <= 0)
+            return 0;
+        len += n;
+        request[len] = '\0';
+    }
+    body += 4;
+
+    int contentLength = 0;
+    for (char *p = request; p < body; p = strstr(p, "\r\n") + 2)
+        if (strncasecmp(p, "Content-Length:", 15) == 0)
+            contentLength = atoi(p + 15);
+
+    int headerLen = body - request;
+    if (headerLen + contentLength > REQUEST_MAX - 1)
+        return 0;
+    while (len < headerLen + contentLength)
+    {
+        if ((n = read(fd, request + len, headerLen + contentLength - len)) <= 0)
+            return 0;
+        len += n;
+    }
+
+    const char *reply = "HTTP/1.1 204 No Content\r\nContent-Length: 0\r\n\r\n";
+    if (rand() % 100 < failPercent)
+    {
+        reply = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n";
+        ++failed;
+    }
+    else
+        printBatch((const uint8_t *)body, contentLength);
+
+    fprintf(stderr, "\r%ld batches, %ld records, %ld duplicates, %ld failed on purpose", batches, records, duplicates,
+            failed);
+
+    // the next request may already be in the buffer
+    c->len = len - (headerLen + contentLength);
+    memmove(request, body + contentLength, c->len);
+    request[c->len] = '\0';
+
+    return write(fd, reply, strlen(reply)) > 0;
+}
+
+int main(int argc, char **argv)
+{
+    int port = argc > 1 ? atoi(argv[1]) : 8080;
+    int failPercent = argc > 2 ? atoi(argv[2]) : 0;
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = INADDR_ANY};
+    int one = 1;
+
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(server, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(server, 4) != 0)
+    {
+        perror("telemetry_sink");
+        return 1;
+    }
+
+    printf("boot,time_s,event,humidity,temperature\n");
+    fflush(stdout);
+
+    while (1)
+    {
+        static connection_t c;
+
+        c.fd = accept(server, NULL, NULL);
+        if (c.fd < 0)
+            continue;
+
+        c.len = 0;
+        c.request[0] = '\0';
+        while (serve(&c, failPercent))
+            ;
+        close(c.fd);
+    }
+}
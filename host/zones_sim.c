@@ -0,0 +1,183 @@
+/*------------------------------------------------------------------------------
+
+	zones_sim: fairness and pump budget of the zone controller
+
+	usage: zones_sim [zones] [max_pumps] [stagger_s] [reset_every_s]
+
+	Runs main/zones.c over a simulated day with one sensor per zone read
+	every 10 s. Humidity of a zone rises at its own rate and drops while
+	its pump runs, so fast zones compete with slow ones for the pump
+	slots. Reports
+	  budget    most pumps on at once and the shortest gap between starts
+	  fairness  pump cycles and seconds per zone, min / max
+	  wait      longest and mean time a zone spent queued
+	  resets    with reset_every_s, the controller is reset that often:
+	            relays drop for RESET_DOWN_S, the clock restarts at 0 and
+	            the zones come back from zonesSave() / zonesRestore()
+	and the host CPU time and RAM of the controller.
+
+---------------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "zones.h"
+
+#define SIM_SECONDS 86400
+#define SAMPLE_PERIOD_S 10
+#define HIGH_DECI 750
+#define LOW_DECI 650
+#define PUMP_DURATION_S 60
+#define DROP_PER_PUMP_S 3 // deci-percent per second of watering
+#define BENCH_STEPS 1000000
+#define RESET_DOWN_S 3 // reset to the first step of the restarted controller
+
+static zone_config_t configs[ZONES_MAX];
+static char names[ZONES_MAX][8];
+static int humidity[ZONES_MAX];
+static int risePerSample[ZONES_MAX];
+
+static void setup(int count)
+{
+    for (int k = 0; k < count; k++)
+    {
+        snprintf(names[k], sizeof(names[k]), "z%d", k);
+        configs[k] = (zone_config_t){
+            .name = names[k],
+            .sensors = {k},
+            .sensorCount = 1,
+            .relay = k,
+            .highDeci = HIGH_DECI,
+            .lowDeci = LOW_DECI,
+            .pumpDurationS = PUMP_DURATION_S,
+        };
+        humidity[k] = LOW_DECI + k * 7 % 100;
+        risePerSample[k] = 1 + k % 4; // 0.1 .. 0.4 % per sample
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : ZONES_MAX;
+    int maxPumps = argc > 2 ? atoi(argv[2]) : 4;
+    int staggerS = argc > 3 ? atoi(argv[3]) : 5;
+    uint32_t resetEveryS = argc > 4 ? strtoul(argv[4], NULL, 0) : 0;
+    static zones_t zones;
+    zone_snapshot_t snapshots[ZONES_MAX];
+    zone_action_t actions[2 * ZONES_MAX]; // a restore and a step in the same second
+    uint32_t bootS = 0, downUntilS = 0;
+    int resets = 0, resumed = 0, saved = 0;
+    int on[ZONES_MAX] = {0};
+    int running = 0, maxRunning = 0, starts = 0;
+    long lastStart = -1, minGap = SIM_SECONDS;
+
+    setup(count);
+    if (zonesInit(&zones, configs, count, maxPumps, staggerS) != 0)
+    {
+        fprintf(stderr, "invalid configuration\n");
+        return 1;
+    }
+
+    for (uint32_t t = 0; t < SIM_SECONDS; t++)
+    {
+        // the controller's clock counts from its last boot
+        uint32_t nowS = t - bootS;
+
+        if (resetEveryS && t > 0 && t % resetEveryS == 0)
+        {
+            saved = zonesSave(&zones, nowS, snapshots);
+            for (int k = 0; k < count; k++)
+                on[k] = 0;
+            running = 0;
+            downUntilS = t + RESET_DOWN_S;
+            resets++;
+        }
+
+        for (int k = 0; k < count; k++)
+        {
+            if (on[k])
+                humidity[k] -= DROP_PER_PUMP_S;
+            if (t % SAMPLE_PERIOD_S == 0)
+                humidity[k] += risePerSample[k];
+        }
+        if (t < downUntilS)
+            continue;
+
+        int n = 0, restored = 0;
+        if (resets && t == downUntilS)
+        {
+            bootS = t;
+            nowS = 0;
+            zonesInit(&zones, configs, count, maxPumps, staggerS);
+            n = restored = zonesRestore(&zones, nowS, snapshots, saved, RESET_DOWN_S, true, actions);
+            resumed += n;
+        }
+
+        if (t % SAMPLE_PERIOD_S == 0)
+            for (int k = 0; k < count; k++)
+                zonesSensor(&zones, k, nowS, humidity[k]);
+
+        // the device steps on every sample and when zonesNextDue() says so, every second covers both
+        n += zonesStep(&zones, nowS, actions + n);
+        for (int a = 0; a < n; a++)
+        {
+            on[actions[a].relay] = actions[a].on;
+            running += actions[a].on ? 1 : -1;
+            if (actions[a].on && a >= restored) // a resumed run is no new start
+            {
+                if (lastStart >= 0 && t - lastStart < minGap)
+                    minGap = t - lastStart;
+                lastStart = t;
+                ++starts;
+            }
+        }
+        if (running > maxRunning)
+            maxRunning = running;
+    }
+
+    uint32_t minCycles = UINT32_MAX, maxCycles = 0, minSeconds = UINT32_MAX, maxSeconds = 0, maxWait = 0;
+    uint64_t waitSum = 0;
+    for (int k = 0; k < count; k++)
+    {
+        const zone_t *zone = &zones.zones[k];
+
+        if (zone->pumpCycles < minCycles)
+            minCycles = zone->pumpCycles;
+        if (zone->pumpCycles > maxCycles)
+            maxCycles = zone->pumpCycles;
+        if (zone->pumpSeconds < minSeconds)
+            minSeconds = zone->pumpSeconds;
+        if (zone->pumpSeconds > maxSeconds)
+            maxSeconds = zone->pumpSeconds;
+        if (zone->maxWaitS > maxWait)
+            maxWait = zone->maxWaitS;
+        waitSum += zone->maxWaitS;
+    }
+
+    printf("%d zones, %d pumps, %d s stagger, %d s simulated\n", count, maxPumps, staggerS, SIM_SECONDS);
+    printf("budget    %d pumps on at most, %d starts, shortest gap between starts %ld s\n", maxRunning, starts,
+           starts > 1 ? minGap : 0);
+    printf("fairness  pump cycles %u .. %u per zone, pump time %u .. %u s per zone\n", minCycles, maxCycles,
+           minSeconds, maxSeconds);
+    printf("wait      longest %u s, mean of the per zone longest %.0f s\n", maxWait, (double)waitSum / count);
+    if (resetEveryS)
+        printf("resets    %d, %d runs resumed\n", resets, resumed);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t t = SIM_SECONDS; t < SIM_SECONDS + BENCH_STEPS; t++)
+    {
+        if (t % SAMPLE_PERIOD_S == 0)
+            for (int k = 0; k < count; k++)
+                zonesSensor(&zones, k, t, LOW_DECI + (t / 600 + k) % 3 * 100); // below, inside, above the band
+        zonesStep(&zones, t, actions);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    printf("cpu       %.1f ns per zonesStep(), %.2f ns per zone\n", ns / BENCH_STEPS, ns / BENCH_STEPS / count);
+    printf("ram       zones_t %zu bytes, %zu per zone\n", sizeof(zones_t), sizeof(zones_t) / ZONES_MAX);
+
+    return maxRunning > maxPumps;
+}
@@ -5,19 +5,51 @@
 #ifndef DHT_H_
 #define DHT_H_
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #define DHT_OK 0
 #define DHT_CHECKSUM_ERROR -1
 #define DHT_TIMEOUT_ERROR -2
+#define DHT_BUSY_ERROR -3
+#define DHT_TYPE_DHT11 11
 #define DHT_TYPE_DHT22 22
+#define DHT_TYPE_AM2301 21
+
 
+// one completed read
+typedef struct
+{
+    float humidity;
+    float temperature;
+    int16_t humidity10;    // the same reading in fixed point, deci-percent
+    int16_t temperature10; // deci-degree
+    int status;        // DHT_OK, DHT_CHECKSUM_ERROR or DHT_TIMEOUT_ERROR
+    uint8_t pulseCount; // complete pulses captured, response + 40 bits for a full frame
+    uint16_t maskedUs;  // time the read kept interrupts masked (the edge ISRs for the async read)
+    int64_t timestamp; // esp_timer_get_time() when the frame was decoded
+} dht_sample_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 // == function prototypes =======================================
 
 void setDHTgpio(int gpio);
 void errorHandler(int response);
 int readDHT();
+int readDHTSample(dht_sample_t *sample);
 float getHumidity();
 float getTemperature();
+uint32_t getDHTMaskedUs();
+uint32_t getDHTStartLowUs();
+uint32_t getDHTMinIntervalMs();
+void convertDHTSample(const uint8_t *dhtData, dht_sample_t *sample);
 int getSignalLevel(int usTimeOut, bool state);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
\ No newline at end of file
@@ -1,31 +1,307 @@
-/* 
-	DHT22 temperature sensor driver
+/*
+	DHT11 / DHT22 / AM2301 temperature sensor driver, header only
+
+	DHTSensor<Type, Pin, Backend> resolves the sensor timings, the data
+	format and the capture backend at compile time. With a fixed pin the
+	busy-wait loop reads one constant input register bit, with
+	DHT_RUNTIME_PIN the pin is set with setPin(). Values are kept in the
+	sensor's own tenths, the float getters convert on demand.
+
+	The C API of DHT.h is a thin shim over one instance, see DHT.cpp.
 */
 
 #ifndef DHT_HPP
 #define DHT_HPP
 
-#define DHT_OK 0
-#define DHT_CHECKSUM_ERROR -1
-#define DHT_TIMEOUT_ERROR -2
+#include <stdint.h>
+
+#include "DHT.h"
+#include "DHT_decode.h"
+#include "DHT_rmt.h"
+#include "DHT_spi.h"
+#include "DHT_trace.h"
+#include "hal.h"
+
+enum class DHTType : uint8_t
+{
+    DHT11 = DHT_TYPE_DHT11,
+    DHT22 = DHT_TYPE_DHT22,
+    AM2301 = DHT_TYPE_AM2301,
+};
+
+enum class DHTBackend : uint8_t
+{
+    BusyWait,
+    Rmt,
+    Spi,
+};
+
+#if CONFIG_DHT_BACKEND_RMT
+constexpr DHTBackend DHT_DEFAULT_BACKEND = DHTBackend::Rmt;
+#elif CONFIG_DHT_BACKEND_SPI
+constexpr DHTBackend DHT_DEFAULT_BACKEND = DHTBackend::Spi;
+#else
+// also with the edge interrupts, which the sampler runs through DHT_async.c instead of readDHT()
+constexpr DHTBackend DHT_DEFAULT_BACKEND = DHTBackend::BusyWait;
+#endif
+
+constexpr int DHT_RUNTIME_PIN = -1;
+constexpr int DHT_DEFAULT_PIN = 4; // my default DHT pin = 4
+
+// == per sensor timings and data format =========================
+
+template <DHTType Type>
+struct DHTTraits;
+
+template <>
+struct DHTTraits<DHTType::DHT22>
+{
+    static constexpr uint32_t startLowUs = 3000; // 1~10 ms, 3 ms for a smooth and nice wake up
+    static constexpr uint32_t releaseUs = 25;    // 20~40 us high before the sensor answers
+    static constexpr uint32_t minIntervalMs = 2000;
+    static constexpr bool signMagnitude = true; // 16 bit tenths, sign in the top bit of the temperature
+};
+
+template <>
+struct DHTTraits<DHTType::AM2301> : DHTTraits<DHTType::DHT22>
+{
+    // same wire format and timings as the DHT22, its start low is 1~10 ms as well
+};
+
+template <>
+struct DHTTraits<DHTType::DHT11>
+{
+    static constexpr uint32_t startLowUs = 20000; // at least 18 ms
+    static constexpr uint32_t releaseUs = 25;
+    static constexpr uint32_t minIntervalMs = 1000;
+    static constexpr bool signMagnitude = false; // integral byte + tenths byte, sign in bit 7 of the tenths
+};
+
+// == frame bytes to tenths =======================================
+
+template <DHTType Type>
+constexpr void convertDHT(const uint8_t *dhtData, int16_t &humidity10, int16_t &temperature10)
+{
+    if constexpr (DHTTraits<Type>::signMagnitude)
+    {
+        humidity10 = (dhtData[0] << 8) | dhtData[1];
+        temperature10 = ((dhtData[2] & 0x7F) << 8) | dhtData[3];
+        if (dhtData[2] & 0x80)
+            temperature10 = -temperature10;
+    }
+    else
+    {
+        humidity10 = dhtData[0] * 10 + dhtData[1] % 10;
+        temperature10 = dhtData[2] * 10 + (dhtData[3] & 0x7F) % 10;
+        if (dhtData[3] & 0x80)
+            temperature10 = -temperature10;
+    }
+}
+
+/*-----------------------------------------------------------------------
+;
+;	the driver
+;
+;------------------------------------------------------------------------*/
 
-class DHT
+template <DHTType Type = DHTType::DHT22, int Pin = DHT_RUNTIME_PIN, DHTBackend Backend = DHT_DEFAULT_BACKEND>
+class DHTSensor
 {
   public:
-	DHT();
+    using Traits = DHTTraits<Type>;
+
+    static constexpr DHTType type = Type;
+    static constexpr uint32_t minIntervalMs = Traits::minIntervalMs;
+
+    constexpr DHTSensor() = default;
+
+    void setPin(int pin)
+    {
+        static_assert(Pin == DHT_RUNTIME_PIN, "the pin is fixed by the template argument");
+        pin_ = pin;
+    }
+
+    constexpr int pin() const
+    {
+        if constexpr (Pin == DHT_RUNTIME_PIN)
+            return pin_;
+        else
+            return Pin;
+    }
+
+    uint32_t maskedUs() const { return maskedUs_; } // interrupts masked during the last busy-wait read
+    int pulseCount() const { return pulseCount_; }   // response + data bits of the last read, 0 without answer
+    int16_t humidity10() const { return humidity10_; }
+    int16_t temperature10() const { return temperature10_; }
+    float getHumidity() const { return humidity10_ / 10.0f; }
+    float getTemperature() const { return temperature10_ / 10.0f; }
+
+    // == capture with the backend, then convert and verify ==========
+
+    int read()
+    {
+        uint8_t dhtData[MAXdhtData];
+        int ret;
+
+        pulseCount_ = -1;
+        if constexpr (Backend == DHTBackend::Rmt)
+            ret = readRmt(dhtData);
+        else if constexpr (Backend == DHTBackend::Spi)
+            ret = readDHTSpi(pin(), Traits::startLowUs, dhtData);
+        else
+        {
+            ret = readBusyWait(dhtData);
+            DHT_TRACE_END();
+        }
 
-	void setDHTgpio(gpio_num_t gpio);
-	void errorHandler(int response);
-	int readDHT();
-	float getHumidity();
-	float getTemperature();
+        // backends that do not count the pulses: a timeout is a sensor that did not answer
+        if (pulseCount_ < 0)
+            pulseCount_ = ret == DHT_TIMEOUT_ERROR ? 0 : DHT_DATA_BITS + 1;
+
+        if (ret != DHT_OK)
+            return ret;
+
+        ret = verifyDHTChecksum(dhtData);
+        if (ret != DHT_OK)
+            return ret;
+
+        convertDHT<Type>(dhtData, humidity10_, temperature10_);
+        return DHT_OK;
+    }
+
+    /*-------------------------------------------------------------------------------
+    ;
+    ;	get next state
+    ;
+    ;	Pulse width is taken from the CPU cycle counter and the pin is read
+    ;	straight from the GPIO input register, so the result is in real
+    ;	microseconds whatever the loop costs. readBusyWait() masks the
+    ;	interrupts over the bit window so the loop runs in realtime.
+    ;
+    ;--------------------------------------------------------------------------------*/
+
+    int getSignalLevel(uint32_t usTimeOut, int state) const
+    {
+        uint32_t start = halCycles();
+        uint32_t cyclesPerUs = halCyclesPerUs();
+        uint32_t timeOut = usTimeOut * cyclesPerUs;
+        uint32_t elapsed = 0;
+
+        while (halPinRead(pin()) == state)
+        {
+            elapsed = halCycles() - start;
+
+            if (elapsed > timeOut)
+                return -1;
+        }
+
+        return elapsed / cyclesPerUs;
+    }
 
   private:
-	gpio_num_t DHTgpio;
-	float humidity = 0.;
-	float temperature = 0.;
+    int pin_ = Pin == DHT_RUNTIME_PIN ? DHT_DEFAULT_PIN : Pin;
+    int16_t humidity10_ = 0;
+    int16_t temperature10_ = 0;
+    uint32_t maskedUs_ = 0;
+    int pulseCount_ = 0;
+
+    // == RMT capture, the pulse count tells a silent sensor from a cut frame
+
+    int readRmt(uint8_t *dhtData)
+    {
+        dht_pulse_t pulses[DHT_RMT_SYMBOLS];
+
+        int count = captureDHTRmt(pin(), Traits::startLowUs, pulses, DHT_RMT_SYMBOLS);
+        if (count < 0)
+            return count;
+
+        pulseCount_ = count;
+        DHT_TRACE_PULSES(pulses, count);
+        return decodeDHTPulses(pulses, count, dhtData);
+    }
+
+    /*----------------------------------------------------------------------------
+    ;
+    ;	busy-wait capture, see the protocol notes in DHT.cpp
+    ;
+    ;----------------------------------------------------------------------------*/
+
+    int readBusyWait(uint8_t *dhtData)
+    {
+        dht_pulse_t pulses[DHT_DATA_BITS];
+
+        // == Send start signal to DHT sensor ===========
+
+        halPinOutput(pin());
+        DHT_TRACE_MARK(DHT_TRACE_START);
+        halPinWrite(pin(), 0);
+        halDelayUs(Traits::startLowUs);
+
+        DHT_TRACE_MARK(DHT_TRACE_RELEASE);
+        halPinWrite(pin(), 1);
+        halDelayUs(Traits::releaseUs);
+
+        halPinInput(pin()); // change to input mode
+        DHT_TRACE_MARK(DHT_TRACE_LISTEN);
+
+        // only the response and the bits run with the interrupts masked, 4~5 ms, 6.7 ms at worst
+        uint32_t state = halMaskInterrupts();
+        uint32_t start = halCycles();
+        int ret = captureBits(pulses);
+        maskedUs_ = (halCycles() - start) / halCyclesPerUs();
+        halUnmaskInterrupts(state);
+
+        if (ret != DHT_OK)
+            return ret;
+
+        // 0 or 1 is decided against the low times of this very frame
+
+        return decodeDHTPulses(pulses, DHT_DATA_BITS, dhtData);
+    }
+
+    int captureBits(dht_pulse_t *pulses)
+    {
+        int uSec;
+
+        pulseCount_ = 0;
+
+        // == DHT answers 20~40 us after the release, then 80 us low and 80 us high ====
+
+        if (getSignalLevel(DHT_WAKE_TIMEOUT_US, 1) < 0)
+            return DHT_TIMEOUT_ERROR;
+        DHT_TRACE_MARK(DHT_TRACE_WAKE);
+
+        if (getSignalLevel(DHT_RESPONSE_TIMEOUT_US, 0) < 0)
+            return DHT_TIMEOUT_ERROR;
+        DHT_TRACE_MARK(DHT_TRACE_RESPONSE);
+
+        if (getSignalLevel(DHT_RESPONSE_TIMEOUT_US, 1) < 0)
+            return DHT_TIMEOUT_ERROR;
+        DHT_TRACE_MARK(DHT_TRACE_BITS);
+        pulseCount_ = 1;
+
+        // == No errors, read the 40 data bits ================
+
+        for (int k = 0; k < DHT_DATA_BITS; k++)
+        {
+            // -- starts new data transmission with >50us low signal
+
+            if ((uSec = getSignalLevel(DHT_BIT_LOW_TIMEOUT_US, 0)) < 0)
+                return DHT_TIMEOUT_ERROR;
+            pulses[k].lowUs = uSec;
+            DHT_TRACE_MARK(DHT_TRACE_BITS + 1 + 2 * k);
+
+            // -- 26~28 us for a 0, 70 us for a 1
+
+            if ((uSec = getSignalLevel(DHT_BIT_HIGH_TIMEOUT_US, 1)) < 0)
+                return DHT_TIMEOUT_ERROR;
+            pulses[k].highUs = uSec;
+            DHT_TRACE_MARK(DHT_TRACE_BITS + 2 + 2 * k);
+            ++pulseCount_;
+        }
 
-	int getSignalLevel(int usTimeOut, bool state);
+        return DHT_OK;
+    }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,175 @@
+/*------------------------------------------------------------------------------
+
+	DHT22 asynchronous read, driven by GPIO edge interrupts
+
+	startReadDHT() pulls the line low and returns right away. An esp_timer
+	ends the start signal of the configured sensor (getDHTStartLowUs()) and arms the edge interrupt, which timestamps
+	every transition with esp_timer_get_time() into a preallocated buffer.
+	When the capture window closes the edges are decoded and a dht_sample_t
+	is posted to the queue given to initDHTAsync().
+
+	Do not mix with the synchronous readDHT() on the same pin.
+
+---------------------------------------------------------------------------------*/
+
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
+#include "hal/gpio_ll.h"
+
+#include "DHT_async.h"
+#include "DHT_decode.h"
+#include "DHT_trace.h"
+
+// == global defines =============================================
+
+static const char *TAG = "DHT_ASYNC";
+
+#define DHT_CAPTURE_US 7000      // response (160 us) + 40 bits (max 120 us each) + margin
+#define DHT_MAX_EDGES 96         // 2 response + 80 data + release and trailing edges
+
+typedef enum
+{
+    DHT_PHASE_IDLE,
+    DHT_PHASE_START,
+    DHT_PHASE_CAPTURE,
+} dht_phase_t;
+
+static int dhtGpio = -1;
+static QueueHandle_t sampleQueue = NULL;
+static esp_timer_handle_t phaseTimer = NULL;
+static volatile dht_phase_t phase = DHT_PHASE_IDLE;
+
+static volatile int edgeCount = 0;
+static uint32_t edgeUs[DHT_MAX_EDGES];
+static uint8_t edgeLevel[DHT_MAX_EDGES];
+static uint32_t isrCycles; // spent in onEdge during this capture, without the dispatch
+
+// == edge interrupt, timestamp and level of every transition =====
+
+static void IRAM_ATTR onEdge(void *arg)
+{
+    uint32_t enter = esp_cpu_get_cycle_count();
+    int n = edgeCount;
+
+    if (n < DHT_MAX_EDGES)
+    {
+        edgeUs[n] = (uint32_t)esp_timer_get_time();
+        edgeLevel[n] = gpio_ll_get_level(&GPIO, dhtGpio);
+        edgeCount = n + 1;
+    }
+
+    isrCycles += esp_cpu_get_cycle_count() - enter;
+}
+
+// == capture window closed, decode and deliver ===================
+
+static void finishRead(void)
+{
+    dht_pulse_t pulses[DHT_MAX_EDGES / 2];
+    uint8_t dhtData[MAXdhtData];
+    dht_sample_t sample = {0};
+
+    int count = edgesToDHTPulses(edgeUs, edgeLevel, edgeCount, pulses, DHT_MAX_EDGES / 2);
+
+    sample.pulseCount = count;
+    DHT_TRACE_PULSES(pulses, count);
+    sample.status = decodeDHTPulses(pulses, count, dhtData);
+    if (sample.status == DHT_OK)
+    {
+        convertDHTSample(dhtData, &sample);
+        sample.status = verifyDHTChecksum(dhtData);
+    }
+    sample.timestamp = esp_timer_get_time();
+    sample.maskedUs = isrCycles / esp_rom_get_cpu_ticks_per_us();
+
+    phase = DHT_PHASE_IDLE;
+
+    if (xQueueSend(sampleQueue, &sample, 0) != pdTRUE)
+        ESP_LOGW(TAG, "Sample queue full, sample dropped");
+}
+
+// == runs in the esp_timer task at the end of each phase =========
+
+static void onPhaseTimer(void *arg)
+{
+    switch (phase)
+    {
+
+    case DHT_PHASE_START:
+        // end of the start signal: listen, then release the line to the sensor
+        edgeCount = 0;
+        isrCycles = 0;
+        phase = DHT_PHASE_CAPTURE;
+        gpio_intr_enable(dhtGpio);
+        gpio_set_level(dhtGpio, 1);
+        esp_timer_start_once(phaseTimer, DHT_CAPTURE_US);
+        break;
+
+    case DHT_PHASE_CAPTURE:
+        gpio_intr_disable(dhtGpio);
+        finishRead();
+        break;
+
+    default:
+        break;
+    }
+}
+
+// == setup pin, edge interrupt and phase timer ===================
+// The edge interrupt is allocated on the core that calls this.
+
+esp_err_t initDHTAsync(int gpio, QueueHandle_t queue)
+{
+    gpio_config_t io_conf = {
+        .pin_bit_mask = (1ULL << gpio),
+        .mode = GPIO_MODE_INPUT_OUTPUT_OD,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .intr_type = GPIO_INTR_ANYEDGE,
+    };
+
+    dhtGpio = gpio;
+    sampleQueue = queue;
+
+    esp_err_t err = gpio_config(&io_conf);
+    if (err != ESP_OK)
+        return err;
+    gpio_set_level(gpio, 1);
+    gpio_intr_disable(gpio);
+
+    // the ISR service may already be installed by another driver
+    err = gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE)
+        return err;
+
+    err = gpio_isr_handler_add(gpio, onEdge, NULL);
+    if (err != ESP_OK)
+        return err;
+
+    if (phaseTimer == NULL)
+    {
+        const esp_timer_create_args_t timerArgs = {
+            .callback = onPhaseTimer,
+            .name = "dht_phase",
+        };
+        err = esp_timer_create(&timerArgs, &phaseTimer);
+    }
+
+    return err;
+}
+
+// == start a read, the result arrives on the sample queue ========
+
+int startReadDHT(void)
+{
+    if (phase != DHT_PHASE_IDLE)
+        return DHT_BUSY_ERROR;
+
+    phase = DHT_PHASE_START;
+    gpio_set_level(dhtGpio, 0);
+    esp_timer_start_once(phaseTimer, getDHTStartLowUs());
+
+    return DHT_OK;
+}
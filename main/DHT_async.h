@@ -0,0 +1,27 @@
+/*
+	DHT22 interrupt driven, non-blocking read
+
+	Completed reads are posted as dht_sample_t to the queue given to initDHTAsync().
+*/
+
+#ifndef DHT_ASYNC_H_
+#define DHT_ASYNC_H_
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#include "DHT.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t initDHTAsync(int gpio, QueueHandle_t sampleQueue);
+int startReadDHT(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,376 @@
+/*------------------------------------------------------------------------------
+
+	DHT22 frame decoder, shared by all capture backends
+
+	A capture backend measures the 40 data bits as (low, high) pulse pairs
+	in microseconds and hands them over here. Nothing in this file touches
+	the hardware, so it can be built and exercised on a Linux host.
+
+---------------------------------------------------------------------------------*/
+
+#include "DHT_decode.h"
+
+/*----------------------------------------------------------------------------
+;
+;	turn timestamped edges into (low, high) pulse pairs
+
+	level is the line level right after the edge. A pulse runs from a
+	falling edge over the next rising edge to the following falling edge.
+	A missed edge restarts the pairing, so the pulse is dropped instead of
+	being measured across two bits.
+
+;----------------------------------------------------------------------------*/
+
+typedef struct
+{
+    uint32_t fallUs;
+    uint32_t riseUs;
+    int8_t phase; // -1: wait for falling edge, 0: line low, 1: line high
+} dht_edge_tracker_t;
+
+static inline uint16_t clampUs(uint32_t us)
+{
+    return us > UINT16_MAX ? UINT16_MAX : us;
+}
+
+// returns 1 when the edge completed a pulse
+static int trackDHTEdge(dht_edge_tracker_t *tracker, uint32_t us, int level, dht_pulse_t *pulse)
+{
+    int complete = 0;
+
+    if (level == 0)
+    {
+        if (tracker->phase == 1)
+        {
+            pulse->lowUs = clampUs(tracker->riseUs - tracker->fallUs);
+            pulse->highUs = clampUs(us - tracker->riseUs);
+            complete = 1;
+        }
+        tracker->fallUs = us;
+        tracker->phase = 0;
+    }
+    else if (tracker->phase == 0)
+    {
+        tracker->riseUs = us;
+        tracker->phase = 1;
+    }
+    else
+        tracker->phase = -1;
+
+    return complete;
+}
+
+int edgesToDHTPulses(const uint32_t *edgeUs, const uint8_t *edgeLevel, int edgeCount, dht_pulse_t *pulses, int maxPulses)
+{
+    dht_edge_tracker_t tracker = {.phase = -1};
+    int count = 0;
+
+    for (int k = 0; k < edgeCount && count < maxPulses; k++)
+        count += trackDHTEdge(&tracker, edgeUs[k], edgeLevel[k], &pulses[count]);
+
+    return count;
+}
+
+/*----------------------------------------------------------------------------
+;
+;	split a shared multi-pin trace into per-sensor pulses
+
+	traceLevels[k] is the whole input register sampled when any watched
+	pin changed, at time traceUs[k]. One pass over the trace: the changed
+	bits of each entry are walked with count-trailing-zeros and every set
+	bit feeds the edge tracker of the sensor on that pin.
+	pulses holds maxPulses entries per sensor, sensor s at s * maxPulses.
+
+;----------------------------------------------------------------------------*/
+
+void splitDHTTrace(const uint32_t *traceUs, const uint32_t *traceLevels, int traceLen, uint32_t initialLevels,
+                   const int *gpios, int sensorCount, dht_pulse_t *pulses, int maxPulses, int *pulseCounts)
+{
+    dht_edge_tracker_t trackers[DHT_MAX_SENSORS];
+    int8_t sensorOfPin[32];
+    uint32_t mask = 0;
+    uint32_t prev = initialLevels;
+
+    for (int k = 0; k < 32; k++)
+        sensorOfPin[k] = -1;
+
+    for (int s = 0; s < sensorCount; s++)
+    {
+        trackers[s].phase = -1;
+        pulseCounts[s] = 0;
+        sensorOfPin[gpios[s]] = s;
+        mask |= 1UL << gpios[s];
+    }
+
+    for (int k = 0; k < traceLen; k++)
+    {
+        uint32_t changed = (traceLevels[k] ^ prev) & mask;
+        prev = traceLevels[k];
+
+        while (changed)
+        {
+            int pin = __builtin_ctz(changed);
+            int s = sensorOfPin[pin];
+            changed &= changed - 1;
+
+            if (pulseCounts[s] < maxPulses)
+                pulseCounts[s] += trackDHTEdge(&trackers[s], traceUs[k], (traceLevels[k] >> pin) & 1,
+                                               &pulses[s * maxPulses + pulseCounts[s]]);
+        }
+    }
+}
+
+/*----------------------------------------------------------------------------
+;
+;	0/1 threshold of one frame
+
+	Every bit starts with the same ~50us low, so its mean over the frame
+	measures the sensor clock against ours. The threshold sits at the
+	midpoint of a "0" (27us) and a "1" (70us) scaled to that clock, which
+	keeps the bits apart when either side runs fast or slow.
+
+;----------------------------------------------------------------------------*/
+
+int thresholdDHTPulses(const dht_pulse_t *pulses)
+{
+    uint32_t lowSum = 0;
+
+    for (int k = 0; k < DHT_DATA_BITS; k++)
+        lowSum += pulses[k].lowUs;
+
+    int threshold = lowSum * DHT_BIT_THRESHOLD_PERCENT / (100 * DHT_DATA_BITS);
+
+    if (threshold < DHT_BIT_THRESHOLD_MIN_US)
+        return DHT_BIT_THRESHOLD_MIN_US;
+    if (threshold > DHT_BIT_THRESHOLD_MAX_US)
+        return DHT_BIT_THRESHOLD_MAX_US;
+
+    return threshold;
+}
+
+/*----------------------------------------------------------------------------
+;
+;	decode the 40 data bits
+
+	The capture may contain leading pulses (the tail of the start signal and
+	the 80us/80us response), so the frame is taken from the last 40 complete
+	pulses. Bits are MSB first, a "1" has a high time above the threshold.
+
+;----------------------------------------------------------------------------*/
+
+int decodeDHTPulses(const dht_pulse_t *pulses, int count, uint8_t *dhtData)
+{
+    for (int k = 0; k < MAXdhtData; k++)
+        dhtData[k] = 0;
+
+    if (count < DHT_DATA_BITS)
+        return DHT_TIMEOUT_ERROR;
+
+    pulses += count - DHT_DATA_BITS;
+
+    int threshold = thresholdDHTPulses(pulses);
+
+    for (int k = 0; k < DHT_DATA_BITS; k++)
+    {
+        if (pulses[k].highUs > threshold)
+            dhtData[k / 8] |= (1 << (7 - k % 8));
+    }
+
+    return DHT_OK;
+}
+
+// == verify if checksum is ok ===========================================
+// Checksum is the sum of Data 8 bits masked out 0xFF
+
+int verifyDHTChecksum(const uint8_t *dhtData)
+{
+    if (dhtData[4] == ((dhtData[0] + dhtData[1] + dhtData[2] + dhtData[3]) & 0xFF))
+        return DHT_OK;
+
+    else
+        return DHT_CHECKSUM_ERROR;
+}
+
+// == get humidity from Data[0] and Data[1], temp from Data[2] and Data[3]
+
+void convertDHTData(const uint8_t *dhtData, float *humidity, float *temperature)
+{
+    *humidity = dhtData[0];
+    *humidity *= 0x100; // >> 8
+    *humidity += dhtData[1];
+    *humidity /= 10; // get the decimal
+
+    *temperature = dhtData[2] & 0x7F;
+    *temperature *= 0x100; // >> 8
+    *temperature += dhtData[3];
+    *temperature /= 10;
+
+    if (dhtData[2] & 0x80) // negative temp, brrr it's freezing
+        *temperature *= -1;
+}
+
+// == the same in tenths, the sensor's own fixed point, no float math
+
+void convertDHTDataDeci(const uint8_t *dhtData, int16_t *humidity10, int16_t *temperature10)
+{
+    *humidity10 = (dhtData[0] << 8) | dhtData[1];
+    *temperature10 = ((dhtData[2] & 0x7F) << 8) | dhtData[3];
+
+    if (dhtData[2] & 0x80)
+        *temperature10 = -*temperature10;
+}
+
+/*----------------------------------------------------------------------------
+;
+;	decode an oversampled line capture
+
+	words holds the line sampled at 1 MHz (DHT_BITSTREAM_HZ), 32 samples
+	per word, first sample in the MSB, as delivered by an SPI/I2S DMA
+	capture or extracted from a multi-pin register trace.
+
+	Runs are found a word at a time: XOR with the current level turns every
+	differing sample into a 1 and count-leading-zeros gives the distance to
+	the next transition, a whole idle word costs one compare. A falling
+	edge only counts when the low run that follows is at least
+	DHT_BITSTREAM_MIN_LOW samples, shorter dips are noise. Each bit is the
+	span between two falling edges and its high time is the popcount of
+	that span, so a glitch inside a pulse does not split it.
+
+;----------------------------------------------------------------------------*/
+
+#define DHT_BITSTREAM_MAX_FALLS (DHT_DATA_BITS + 4)
+
+static inline int sampleAt(const uint32_t *words, int pos)
+{
+    return (words[pos >> 5] >> (31 - (pos & 31))) & 1;
+}
+
+// first position >= pos whose sample differs from level, or sampleCount
+static int nextTransition(const uint32_t *words, int sampleCount, int pos, int level)
+{
+    uint32_t flip = level ? 0xFFFFFFFF : 0;
+    uint32_t w = (words[pos >> 5] ^ flip) << (pos & 31);
+
+    if (w)
+        pos += __builtin_clz(w);
+    else
+    {
+        pos = (pos | 31) + 1;
+        while (pos < sampleCount && (w = words[pos >> 5] ^ flip) == 0)
+            pos += 32;
+        if (pos < sampleCount)
+            pos += __builtin_clz(w);
+    }
+
+    return pos < sampleCount ? pos : sampleCount;
+}
+
+// number of high samples in [from, to)
+static int countHigh(const uint32_t *words, int from, int to)
+{
+    int high = 0;
+
+    while (from < to)
+    {
+        int offset = from & 31;
+        int len = 32 - offset < to - from ? 32 - offset : to - from;
+        uint32_t w = words[from >> 5] << offset;
+
+        if (len < 32)
+            w &= ~(0xFFFFFFFF >> len);
+
+        high += __builtin_popcount(w);
+        from += len;
+    }
+
+    return high;
+}
+
+int decodeDHTBitstream(const uint32_t *words, int sampleCount, uint8_t *dhtData)
+{
+    int falls[DHT_BITSTREAM_MAX_FALLS];
+    dht_pulse_t pulses[DHT_BITSTREAM_MAX_FALLS];
+    int fallCount = 0;
+    int pulseCount = 0;
+
+    if (sampleCount <= 0)
+        return DHT_TIMEOUT_ERROR;
+
+    int pos = 0;
+    int level = sampleAt(words, 0);
+
+    while (pos < sampleCount)
+    {
+        int next = nextTransition(words, sampleCount, pos, level);
+
+        if (level == 1 && next < sampleCount)
+        {
+            int end = nextTransition(words, sampleCount, next, 0);
+
+            if (end - next >= DHT_BITSTREAM_MIN_LOW)
+            {
+                // keep the newest falls, the frame is at the end of the capture
+                if (fallCount == DHT_BITSTREAM_MAX_FALLS)
+                {
+                    for (int k = 1; k < fallCount; k++)
+                        falls[k - 1] = falls[k];
+                    --fallCount;
+                }
+                falls[fallCount++] = next;
+            }
+
+            pos = end;
+            continue;
+        }
+
+        pos = next;
+        level ^= 1;
+    }
+
+    for (int k = 0; k + 1 < fallCount; k++)
+    {
+        int span = falls[k + 1] - falls[k];
+        int high = countHigh(words, falls[k], falls[k + 1]);
+
+        pulses[pulseCount].lowUs = clampUs(span - high);
+        pulses[pulseCount].highUs = clampUs(high);
+        ++pulseCount;
+    }
+
+    int ret = decodeDHTPulses(pulses, pulseCount, dhtData);
+    if (ret != DHT_OK)
+        return ret;
+
+    return verifyDHTChecksum(dhtData);
+}
+
+/*----------------------------------------------------------------------------
+;
+;	one line out of a multi-line capture
+;
+;	An SPI peripheral in dual or quad mode samples 2 or 4 data lines per
+;	clock, each sample is a group of lines bits in the byte stream, first
+;	group in the MSB of the first byte and line n - 1 first within a group.
+;	Gathers the samples of one line into the 32 samples per word layout of
+;	decodeDHTBitstream(). With one line it only turns the byte stream into
+;	words, whatever the byte order of the CPU.
+;
+;----------------------------------------------------------------------------*/
+
+void splitDHTBitstream(const uint8_t *raw, int sampleCount, int lines, int line, uint32_t *words)
+{
+    int offset = lines - 1 - line;
+
+    for (int w = 0; w < (sampleCount + 31) / 32; w++)
+    {
+        uint32_t word = 0;
+        int end = sampleCount - w * 32 < 32 ? sampleCount - w * 32 : 32;
+
+        for (int k = 0; k < end; k++)
+        {
+            int bit = (w * 32 + k) * lines + offset;
+            word |= (uint32_t)((raw[bit >> 3] >> (7 - (bit & 7))) & 1) << (31 - k);
+        }
+        words[w] = word;
+    }
+}
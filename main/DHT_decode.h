@@ -0,0 +1,60 @@
+/*
+	DHT22 frame decoder
+
+	Pure functions over measured pulse durations, no ESP-IDF dependencies,
+	so the same code runs behind every capture backend and on a host build.
+*/
+
+#ifndef DHT_DECODE_H_
+#define DHT_DECODE_H_
+
+#include <stdint.h>
+
+#include "DHT.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MAXdhtData 5 // to complete 40 = 5*8 Bits
+#define DHT_DATA_BITS 40
+#define DHT_MAX_SENSORS 8 // sensors sharing one multi-pin capture
+
+// bit threshold, derived per frame from the ~50 us low pulses (0: 26~28 us, 1: 70 us)
+#define DHT_BIT_THRESHOLD_PERCENT 97 // midpoint of 27 and 70 us, relative to the low time
+#define DHT_BIT_THRESHOLD_MIN_US 35
+#define DHT_BIT_THRESHOLD_MAX_US 60
+
+// oversampled captures, see decodeDHTBitstream()
+#define DHT_BITSTREAM_HZ 1000000 // one sample per microsecond
+#define DHT_BITSTREAM_MIN_LOW 10 // shortest low run taken as a falling edge, in samples
+
+// busy-wait timeouts, in real microseconds with some margin over the datasheet
+#define DHT_WAKE_TIMEOUT_US 60      // sensor pulls low 20~40 us after the release
+#define DHT_RESPONSE_TIMEOUT_US 100 // 80 us low, then 80 us high
+#define DHT_BIT_LOW_TIMEOUT_US 70   // 50 us low before every bit
+#define DHT_BIT_HIGH_TIMEOUT_US 90  // 26~28 us or 70 us high
+
+// one data bit on the wire: >50us low followed by a 26~28us (0) or 70us (1) high
+typedef struct
+{
+    uint16_t lowUs;
+    uint16_t highUs;
+} dht_pulse_t;
+
+int edgesToDHTPulses(const uint32_t *edgeUs, const uint8_t *edgeLevel, int edgeCount, dht_pulse_t *pulses, int maxPulses);
+void splitDHTTrace(const uint32_t *traceUs, const uint32_t *traceLevels, int traceLen, uint32_t initialLevels,
+                   const int *gpios, int sensorCount, dht_pulse_t *pulses, int maxPulses, int *pulseCounts);
+int thresholdDHTPulses(const dht_pulse_t *pulses);
+int decodeDHTPulses(const dht_pulse_t *pulses, int count, uint8_t *dhtData);
+int verifyDHTChecksum(const uint8_t *dhtData);
+void convertDHTData(const uint8_t *dhtData, float *humidity, float *temperature);
+void convertDHTDataDeci(const uint8_t *dhtData, int16_t *humidity10, int16_t *temperature10);
+int decodeDHTBitstream(const uint32_t *words, int sampleCount, uint8_t *dhtData);
+void splitDHTBitstream(const uint8_t *raw, int sampleCount, int lines, int line, uint32_t *words);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,163 @@
+/*------------------------------------------------------------------------------
+
+	DHT22 multi-sensor capture
+
+	All data pins are open-drain with pull-up. The start signal is written
+	to every pin at once through the GPIO set/clear registers, then one
+	loop samples the whole GPIO input register and appends an entry to the
+	trace whenever any watched pin changes. The trace is timestamped with
+	the CPU cycle counter and split per sensor by splitDHTTrace(). As in the
+	busy-wait read, interrupts on this core are masked over the capture
+	(8 ms at most) and the masked time is reported in every sample.
+
+---------------------------------------------------------------------------------*/
+
+#include "esp_log.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
+#include "soc/gpio_reg.h"
+
+#include "hal.h"
+#include "DHT_multi.h"
+
+// == global defines =============================================
+
+static const char *TAG = "DHT_MULTI";
+
+#define DHT_MULTI_IDLE_US 500    // no edge on any pin for this long ends the frame
+#define DHT_MULTI_WINDOW_US 8000 // hard limit for the whole capture
+
+// == setup all data pins =========================================
+
+esp_err_t initDHTMulti(dht_multi_t *multi, const int *gpios, int sensorCount)
+{
+    if (sensorCount < 1 || sensorCount > DHT_MAX_SENSORS)
+        return ESP_ERR_INVALID_ARG;
+
+    multi->sensorCount = sensorCount;
+    multi->mask = 0;
+
+    for (int s = 0; s < sensorCount; s++)
+    {
+        // the capture reads GPIO_IN_REG, which only holds GPIO 0..31
+        if (gpios[s] < 0 || gpios[s] > 31 || (multi->mask & (1UL << gpios[s])))
+            return ESP_ERR_INVALID_ARG;
+
+        multi->gpios[s] = gpios[s];
+        multi->mask |= 1UL << gpios[s];
+    }
+
+    gpio_config_t io_conf = {
+        .pin_bit_mask = multi->mask,
+        .mode = GPIO_MODE_INPUT_OUTPUT_OD,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+    };
+    REG_WRITE(GPIO_OUT_W1TS_REG, multi->mask); // released
+
+    return gpio_config(&io_conf);
+}
+
+// == sample the input register until all lines went idle ==========
+
+static void IRAM_ATTR captureTrace(dht_multi_t *multi, uint32_t cyclesPerUs)
+{
+    uint32_t mask = multi->mask;
+    uint32_t idleCycles = DHT_MULTI_IDLE_US * cyclesPerUs;
+    uint32_t windowCycles = DHT_MULTI_WINDOW_US * cyclesPerUs;
+    int n = 0;
+
+    // release all lines together, then listen
+    REG_WRITE(GPIO_OUT_W1TS_REG, mask);
+
+    uint32_t start = esp_cpu_get_cycle_count();
+    uint32_t lastEdge = start;
+    uint32_t prev = REG_READ(GPIO_IN_REG) & mask;
+    multi->initialLevels = prev;
+
+    while (n < DHT_MULTI_MAX_EDGES)
+    {
+        uint32_t now = esp_cpu_get_cycle_count();
+        uint32_t levels = REG_READ(GPIO_IN_REG) & mask;
+
+        if (levels != prev)
+        {
+            multi->traceUs[n] = now - start;
+            multi->traceLevels[n] = levels;
+            prev = levels;
+            lastEdge = now;
+            ++n;
+        }
+        else if (now - lastEdge > idleCycles || now - start > windowCycles)
+            break;
+    }
+
+    multi->traceLen = n;
+}
+
+/*----------------------------------------------------------------------------
+;
+;	read all sensors in one window
+
+	Fills one dht_sample_t per sensor, in the order given to initDHTMulti().
+	Returns DHT_OK when every sensor delivered a valid frame, otherwise the
+	error of the first failing sensor; the per-sensor status is in samples.
+
+;----------------------------------------------------------------------------*/
+
+int readDHTMulti(dht_multi_t *multi, dht_sample_t *samples)
+{
+    uint32_t cyclesPerUs = esp_rom_get_cpu_ticks_per_us();
+    uint8_t dhtData[MAXdhtData];
+    int ret = DHT_OK;
+
+    // == Send start signal to all sensors ===========
+
+    REG_WRITE(GPIO_OUT_W1TC_REG, multi->mask);
+    esp_rom_delay_us(getDHTStartLowUs());
+
+    uint32_t state = halMaskInterrupts();
+    uint32_t start = esp_cpu_get_cycle_count();
+    captureTrace(multi, cyclesPerUs);
+    uint16_t maskedUs = (esp_cpu_get_cycle_count() - start) / cyclesPerUs;
+    halUnmaskInterrupts(state);
+
+    int64_t timestamp = esp_timer_get_time();
+
+    // cycles to microseconds, once for the whole trace
+    for (int k = 0; k < multi->traceLen; k++)
+        multi->traceUs[k] /= cyclesPerUs;
+
+    splitDHTTrace(multi->traceUs, multi->traceLevels, multi->traceLen, multi->initialLevels,
+                  multi->gpios, multi->sensorCount, multi->pulses, DHT_MULTI_MAX_PULSES, multi->pulseCounts);
+
+    for (int s = 0; s < multi->sensorCount; s++)
+    {
+        dht_sample_t *sample = &samples[s];
+
+        sample->humidity = 0;
+        sample->temperature = 0;
+        sample->humidity10 = 0;
+        sample->temperature10 = 0;
+        sample->timestamp = timestamp;
+        sample->pulseCount = multi->pulseCounts[s];
+        sample->maskedUs = maskedUs; // one window for all sensors
+        sample->status = decodeDHTPulses(&multi->pulses[s * DHT_MULTI_MAX_PULSES], multi->pulseCounts[s], dhtData);
+
+        if (sample->status == DHT_OK)
+        {
+            convertDHTSample(dhtData, sample);
+            sample->status = verifyDHTChecksum(dhtData);
+        }
+
+        if (sample->status != DHT_OK)
+        {
+            ESP_LOGD(TAG, "GPIO %d: %d pulses, status %d", multi->gpios[s], multi->pulseCounts[s], sample->status);
+            if (ret == DHT_OK)
+                ret = sample->status;
+        }
+    }
+
+    return ret;
+}
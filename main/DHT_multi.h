@@ -0,0 +1,50 @@
+/*
+	DHT22 multi-sensor driver
+
+	Up to DHT_MAX_SENSORS sensors on GPIO 0..31 are triggered together and
+	captured in one ~5 ms window, so N sensors cost about the time of one.
+	All state lives in the caller's dht_multi_t, the driver is reentrant.
+	dht_multi_t holds the ~8 KB trace, keep it static rather than on a task stack.
+*/
+
+#ifndef DHT_MULTI_H_
+#define DHT_MULTI_H_
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#include "DHT.h"
+#include "DHT_decode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DHT_MULTI_MAX_PULSES 48                       // 40 data + response + spare per sensor
+#define DHT_MULTI_MAX_EDGES (DHT_MAX_SENSORS * 2 * DHT_MULTI_MAX_PULSES)
+
+typedef struct
+{
+    int gpios[DHT_MAX_SENSORS];
+    int sensorCount;
+    uint32_t mask;
+
+    // shared trace of the input register, one entry per change on any pin
+    int traceLen;
+    uint32_t initialLevels;
+    uint32_t traceUs[DHT_MULTI_MAX_EDGES];
+    uint32_t traceLevels[DHT_MULTI_MAX_EDGES];
+
+    dht_pulse_t pulses[DHT_MAX_SENSORS * DHT_MULTI_MAX_PULSES];
+    int pulseCounts[DHT_MAX_SENSORS];
+} dht_multi_t;
+
+esp_err_t initDHTMulti(dht_multi_t *multi, const int *gpios, int sensorCount);
+int readDHTMulti(dht_multi_t *multi, dht_sample_t *samples);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,143 @@
+/*------------------------------------------------------------------------------
+
+	DHT retry policy and fault statistics
+
+	The sensor needs minIntervalMs between two start signals, so the first
+	retry comes after exactly that and every further one waits twice as
+	long, up to DHT_RETRY_MAX_EARLY of them. A retry is only made when the
+	next regular read is still minIntervalMs after it, so whatever happens
+	that read stays on the period grid, a failing sensor is not read more
+	often than once per period plus its retries.
+
+---------------------------------------------------------------------------------*/
+
+#include <string.h>
+
+#include "DHT_retry.h"
+
+void initDHTRetry(dht_retry_t *retry, uint32_t minIntervalMs, uint32_t periodMs)
+{
+    memset(retry, 0, sizeof(*retry));
+    retry->minIntervalMs = minIntervalMs;
+    retry->periodMs = periodMs < minIntervalMs ? minIntervalMs : periodMs;
+}
+
+/*----------------------------------------------------------------------------
+;
+;	classify a failed read
+;
+;	A complete frame has the 80/80 us response pulse and 40 data bits. No
+;	pulse at all means the sensor never answered, otherwise the frame was
+;	cut inside the data (or arrived whole and failed the checksum).
+;
+;----------------------------------------------------------------------------*/
+
+int faultOfDHTSample(const dht_sample_t *sample)
+{
+    if (sample->status == DHT_CHECKSUM_ERROR)
+        return DHT_FAULT_CHECKSUM;
+
+    return sample->pulseCount == 0 ? DHT_FAULT_NO_RESPONSE : DHT_FAULT_DATA_TIMEOUT;
+}
+
+static void countFault(dht_health_t *health, const dht_sample_t *sample)
+{
+    int fault = faultOfDHTSample(sample);
+
+    health->faults[fault]++;
+
+    if (fault == DHT_FAULT_DATA_TIMEOUT)
+    {
+        // the first pulse is the response, the rest are data bits
+        int bits = sample->pulseCount - 1;
+        int byte = bits / 8 < MAXdhtData ? bits / 8 : MAXdhtData - 1;
+        health->cutInByte[byte]++;
+    }
+}
+
+static void countRecovery(dht_health_t *health, uint32_t ms)
+{
+    int bin = 0;
+
+    while (bin < DHT_RECOVERY_BINS - 1 && ms >= (1000u << bin))
+        bin++;
+
+    health->recoveries++;
+    health->recoveryHistogram[bin]++;
+    if (ms > health->maxRecoveryMs)
+        health->maxRecoveryMs = ms;
+}
+
+// == what the next regular read is, counted from now ==============
+
+static uint32_t toNextPeriod(dht_retry_t *retry)
+{
+    uint32_t delay = retry->spentMs < retry->periodMs ? retry->periodMs - retry->spentMs : 0;
+
+    if (delay < retry->minIntervalMs)
+        delay = retry->minIntervalMs;
+
+    retry->spentMs = 0;
+    retry->retries = 0;
+    return delay;
+}
+
+/*----------------------------------------------------------------------------
+;
+;	account one completed read, returns the delay to the next one in ms
+;
+;----------------------------------------------------------------------------*/
+
+uint32_t updateDHTRetry(dht_retry_t *retry, const dht_sample_t *sample)
+{
+    dht_health_t *health = &retry->health;
+
+    health->reads++;
+
+    if (sample->status == DHT_OK)
+    {
+        health->ok++;
+        if (retry->consecutive)
+            countRecovery(health, (sample->timestamp - retry->firstFailureUs) / 1000);
+
+        retry->consecutive = 0;
+        retry->isDegraded = false;
+        return toNextPeriod(retry);
+    }
+
+    countFault(health, sample);
+
+    if (retry->consecutive == 0)
+        retry->firstFailureUs = sample->timestamp;
+    if (retry->consecutive < UINT8_MAX)
+        retry->consecutive++;
+
+    if (!retry->isDegraded && retry->consecutive >= DHT_DEGRADED_AFTER)
+    {
+        retry->isDegraded = true;
+        health->degraded++;
+    }
+
+    uint32_t backoff = retry->minIntervalMs << retry->retries;
+
+    // only retry when the regular read after it is still a minimum interval away
+    if (retry->retries < DHT_RETRY_MAX_EARLY && retry->spentMs + backoff + retry->minIntervalMs <= retry->periodMs)
+    {
+        retry->retries++;
+        retry->spentMs += backoff;
+        health->retries++;
+        return backoff;
+    }
+
+    return toNextPeriod(retry);
+}
+
+bool isDHTDegraded(const dht_retry_t *retry)
+{
+    return retry->isDegraded;
+}
+
+void getDHTHealth(const dht_retry_t *retry, dht_health_t *health)
+{
+    *health = retry->health;
+}
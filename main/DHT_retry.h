@@ -0,0 +1,69 @@
+/*
+	DHT read scheduling with retries, and per sensor fault statistics
+
+	One dht_retry_t per sensor. updateDHTRetry() is fed every completed read
+	and returns when to read next: the regular period after a good read,
+	early retries with backoff (never closer than the sensor's minimum
+	interval) after a failure. A sensor that keeps failing is marked
+	degraded until it delivers a good frame again. Pure C, no IDF calls.
+*/
+
+#ifndef DHT_RETRY_H_
+#define DHT_RETRY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "DHT.h"
+#include "DHT_decode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DHT_RETRY_MAX_EARLY 2 // early retries per period, at 1x, 2x... the minimum interval
+#define DHT_DEGRADED_AFTER 5  // consecutive failed reads
+#define DHT_RECOVERY_BINS 8   // recovery latency histogram, bin k: below 2^k seconds, the last one open
+
+// fault types
+#define DHT_FAULT_NO_RESPONSE 0  // timeout, the sensor never answered the start signal
+#define DHT_FAULT_DATA_TIMEOUT 1 // timeout inside the 40 data bits
+#define DHT_FAULT_CHECKSUM 2
+#define DHT_FAULTS 3
+
+typedef struct
+{
+    uint32_t reads;
+    uint32_t ok;
+    uint32_t faults[DHT_FAULTS];
+    uint32_t cutInByte[MAXdhtData]; // data timeouts by the byte the frame stopped in
+    uint32_t retries;
+    uint32_t degraded;   // times the sensor became degraded
+    uint32_t recoveries; // good reads after at least one failure
+    uint32_t recoveryHistogram[DHT_RECOVERY_BINS];
+    uint32_t maxRecoveryMs;
+} dht_health_t;
+
+typedef struct
+{
+    dht_health_t health;
+    uint32_t minIntervalMs;
+    uint32_t periodMs;
+    uint32_t spentMs; // time since the regular read of this period
+    uint8_t retries;  // early retries used in this period
+    uint8_t consecutive;
+    bool isDegraded;
+    int64_t firstFailureUs;
+} dht_retry_t;
+
+void initDHTRetry(dht_retry_t *retry, uint32_t minIntervalMs, uint32_t periodMs);
+uint32_t updateDHTRetry(dht_retry_t *retry, const dht_sample_t *sample);
+bool isDHTDegraded(const dht_retry_t *retry);
+void getDHTHealth(const dht_retry_t *retry, dht_health_t *health);
+int faultOfDHTSample(const dht_sample_t *sample);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,179 @@
+/*------------------------------------------------------------------------------
+
+	DHT22 capture backend using the ESP32 RMT receiver
+
+	The RMT peripheral records the level/duration of every pulse on the data
+	line into its symbol memory while the CPU waits on a queue. Only the
+	start signal is driven by software, the 40 bits are then decoded from
+	the recorded durations by decodeDHTPulses().
+
+---------------------------------------------------------------------------------*/
+
+#include "esp_log.h"
+#include "esp_rom_sys.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "driver/gpio.h"
+#include "driver/rmt_rx.h"
+
+#include "DHT_rmt.h"
+#include "DHT_trace.h"
+#include "budget.h"
+
+// == global defines =============================================
+
+static const char *TAG = "DHT_RMT";
+
+#define DHT_RMT_RESOLUTION_HZ 1000000 // 1 tick = 1 us
+#define DHT_RMT_MIN_PULSE_NS 1250     // glitch filter, well below the 26 us "0" pulse
+#define DHT_RMT_IDLE_NS 1000000       // line idle for 1 ms ends the frame
+#define DHT_RMT_TIMEOUT_MS 20         // a complete frame takes ~5 ms
+
+static int rxGpio = -1;
+static rmt_channel_handle_t rxChannel = NULL;
+static QueueHandle_t rxDoneQueue = NULL;
+static rmt_symbol_word_t rxSymbols[DHT_RMT_SYMBOLS];
+
+// == receive done callback, runs in ISR context ==================
+
+static bool IRAM_ATTR onRecvDone(rmt_channel_handle_t channel, const rmt_rx_done_event_data_t *edata, void *user_data)
+{
+    BaseType_t taskWoken = pdFALSE;
+    xQueueSendFromISR((QueueHandle_t)user_data, edata, &taskWoken);
+    return taskWoken == pdTRUE;
+}
+
+// == bind the RX channel to the DHT pin ==========================
+
+static esp_err_t setupRmt(int gpio)
+{
+    if (rxChannel != NULL && rxGpio == gpio)
+        return ESP_OK;
+
+    if (rxChannel != NULL)
+    {
+        rmt_disable(rxChannel);
+        rmt_del_channel(rxChannel);
+        rxChannel = NULL;
+    }
+
+    rxDoneQueue = getBudgetQueue(BUDGET_QUEUE_RMT);
+
+    rmt_rx_channel_config_t rxConfig = {
+        .gpio_num = gpio,
+        .clk_src = RMT_CLK_SRC_DEFAULT,
+        .resolution_hz = DHT_RMT_RESOLUTION_HZ,
+        .mem_block_symbols = DHT_RMT_SYMBOLS,
+    };
+    esp_err_t err = rmt_new_rx_channel(&rxConfig, &rxChannel);
+    if (err != ESP_OK)
+        return err;
+
+    rmt_rx_event_callbacks_t callbacks = {
+        .on_recv_done = onRecvDone,
+    };
+    ESP_ERROR_CHECK(rmt_rx_register_event_callbacks(rxChannel, &callbacks, rxDoneQueue));
+    ESP_ERROR_CHECK(rmt_enable(rxChannel));
+
+    // the RMT owns the input path, the start signal is sent open-drain on the same pin
+    gpio_set_pull_mode(gpio, GPIO_PULLUP_ONLY);
+    gpio_set_level(gpio, 1);
+    gpio_set_direction(gpio, GPIO_MODE_INPUT_OUTPUT_OD);
+
+    rxGpio = gpio;
+    return ESP_OK;
+}
+
+/*-------------------------------------------------------------------------------
+;
+;	turn RMT symbols into (low, high) pulse pairs
+;
+;	Each symbol holds two level/duration halves, a zero duration marks
+;	the end of the frame. Every low half followed by a high half is one
+;	pulse, the trailing low of the last bit has no high and is dropped.
+;
+;--------------------------------------------------------------------------------*/
+
+static int symbolsToPulses(const rmt_symbol_word_t *symbols, size_t numSymbols, dht_pulse_t *pulses, int maxPulses)
+{
+    int count = 0;
+    int lowUs = -1;
+
+    for (size_t k = 0; k < numSymbols * 2 && count < maxPulses; k++)
+    {
+        const rmt_symbol_word_t *sym = &symbols[k / 2];
+        unsigned level = (k & 1) ? sym->level1 : sym->level0;
+        unsigned duration = (k & 1) ? sym->duration1 : sym->duration0;
+
+        if (duration == 0)
+            break;
+
+        if (level == 0)
+            lowUs = duration;
+        else if (lowUs >= 0)
+        {
+            pulses[count].lowUs = lowUs;
+            pulses[count].highUs = duration;
+            ++count;
+            lowUs = -1;
+        }
+    }
+
+    return count;
+}
+
+// == capture one frame, returns the number of pulses or DHT_TIMEOUT_ERROR
+
+int captureDHTRmt(int gpio, uint32_t startLowUs, dht_pulse_t *pulses, int maxPulses)
+{
+    rmt_rx_done_event_data_t rxData;
+
+    if (setupRmt(gpio) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "RMT setup failed\n");
+        return DHT_TIMEOUT_ERROR;
+    }
+
+    rmt_receive_config_t receiveConfig = {
+        .signal_range_min_ns = DHT_RMT_MIN_PULSE_NS,
+        .signal_range_max_ns = DHT_RMT_IDLE_NS,
+    };
+
+    xQueueReset(rxDoneQueue);
+
+    // start signal, 3 ms for a DHT22, 18 ms or more for a DHT11
+    gpio_set_level(gpio, 0);
+    esp_rom_delay_us(startLowUs);
+
+    // arm the receiver while the line is still low, then release it
+    if (rmt_receive(rxChannel, rxSymbols, sizeof(rxSymbols), &receiveConfig) != ESP_OK)
+    {
+        gpio_set_level(gpio, 1);
+        return DHT_TIMEOUT_ERROR;
+    }
+    gpio_set_level(gpio, 1);
+
+    if (xQueueReceive(rxDoneQueue, &rxData, pdMS_TO_TICKS(DHT_RMT_TIMEOUT_MS)) != pdTRUE)
+    {
+        // no frame, restart the channel to drop the pending receive
+        rmt_disable(rxChannel);
+        rmt_enable(rxChannel);
+        return DHT_TIMEOUT_ERROR;
+    }
+
+    return symbolsToPulses(rxData.received_symbols, rxData.num_symbols, pulses, maxPulses);
+}
+
+// == capture and decode the 40 data bits =========================
+
+int readDHTRmt(int gpio, uint32_t startLowUs, uint8_t *dhtData)
+{
+    dht_pulse_t pulses[DHT_RMT_SYMBOLS];
+
+    int count = captureDHTRmt(gpio, startLowUs, pulses, DHT_RMT_SYMBOLS);
+    if (count < 0)
+        return count;
+
+    DHT_TRACE_PULSES(pulses, count);
+    return decodeDHTPulses(pulses, count, dhtData);
+}
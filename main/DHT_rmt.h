@@ -0,0 +1,25 @@
+/*
+	DHT22 RMT capture backend
+*/
+
+#ifndef DHT_RMT_H_
+#define DHT_RMT_H_
+
+#include <stdint.h>
+
+#include "DHT_decode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DHT_RMT_SYMBOLS 64 // one RMT memory block, a full frame is ~42 symbols
+
+int captureDHTRmt(int gpio, uint32_t startLowUs, dht_pulse_t *pulses, int maxPulses);
+int readDHTRmt(int gpio, uint32_t startLowUs, uint8_t *dhtData);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
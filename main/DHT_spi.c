@@ -0,0 +1,199 @@
+/*------------------------------------------------------------------------------
+
+	DHT22 capture backend using an SPI host as a sampler
+
+	The SPI master clocks a half-duplex read at DHT_BITSTREAM_HZ with no
+	clock pin and no chip select, the DMA fills the buffer with the level of
+	the data lines, one bit per line and microsecond. The pins keep their
+	input route to the SPI host but their output is taken back as a plain
+	open-drain GPIO, which sends the start signal like the RMT backend.
+	The transfer is queued while the lines are still low, so the capture
+	starts before the sensor answers; decodeDHTBitstream() takes the frame
+	from the end of it.
+
+	One sensor uses MISO. Two or four use data lines 0..n-1 in dual or
+	quad mode, sensor k on line k, and splitDHTBitstream() separates them.
+
+---------------------------------------------------------------------------------*/
+
+#include <string.h>
+
+#include "driver/gpio.h"
+#include "driver/spi_master.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_rom_gpio.h"
+#include "esp_rom_sys.h"
+#include "soc/gpio_sig_map.h"
+
+#include "DHT_spi.h"
+
+// == global defines =============================================
+
+static const char *TAG = "DHT_SPI";
+
+#define DHT_SPI_HOST SPI2_HOST
+#define DHT_SPI_TIMEOUT_MS 20 // the transfer takes ~6 ms
+
+static int busGpios[DHT_SPI_MAX_LINES];
+static int busSensors = 0;
+static spi_device_handle_t device = NULL;
+
+// 3 KB with four lines, word aligned in DMA capable RAM
+DMA_ATTR static uint8_t rxBuffer[DHT_SPI_SAMPLES * DHT_SPI_MAX_LINES / 8];
+static uint32_t words[DHT_SPI_SAMPLES / 32];
+
+static int linesOf(int sensorCount)
+{
+    return sensorCount == 1 ? 1 : sensorCount == 2 ? 2 : 4;
+}
+
+// == bind the SPI host to the DHT pins ===========================
+
+static void releaseSpi(void)
+{
+    if (device == NULL)
+        return;
+
+    spi_bus_remove_device(device);
+    spi_bus_free(DHT_SPI_HOST);
+    device = NULL;
+}
+
+static esp_err_t setupSpi(const int *gpios, int sensorCount)
+{
+    if (device != NULL && sensorCount == busSensors && memcmp(gpios, busGpios, sensorCount * sizeof(int)) == 0)
+        return ESP_OK;
+
+    releaseSpi();
+
+    // one sensor on MISO, otherwise sensor k on data line k
+    int data[DHT_SPI_MAX_LINES] = {-1, -1, -1, -1};
+    if (sensorCount == 1)
+        data[1] = gpios[0];
+    else
+        memcpy(data, gpios, sensorCount * sizeof(int));
+
+    spi_bus_config_t busConfig = {
+        .mosi_io_num = data[0],
+        .miso_io_num = data[1],
+        .sclk_io_num = -1,
+        .quadwp_io_num = data[2],
+        .quadhd_io_num = data[3],
+        .data4_io_num = -1,
+        .data5_io_num = -1,
+        .data6_io_num = -1,
+        .data7_io_num = -1,
+        .max_transfer_sz = sizeof(rxBuffer),
+        .flags = SPICOMMON_BUSFLAG_MASTER | SPICOMMON_BUSFLAG_GPIO_PINS,
+    };
+    esp_err_t err = spi_bus_initialize(DHT_SPI_HOST, &busConfig, SPI_DMA_CH_AUTO);
+    if (err != ESP_OK)
+        return err;
+
+    spi_device_interface_config_t deviceConfig = {
+        .mode = 0,
+        .clock_speed_hz = DHT_BITSTREAM_HZ,
+        .spics_io_num = -1,
+        .flags = SPI_DEVICE_HALFDUPLEX,
+        .queue_size = 1,
+    };
+    err = spi_bus_add_device(DHT_SPI_HOST, &deviceConfig, &device);
+    if (err != ESP_OK)
+    {
+        spi_bus_free(DHT_SPI_HOST);
+        return err;
+    }
+
+    // the SPI host keeps the input, the output goes back to the GPIO as open-drain
+    for (int k = 0; k < sensorCount; k++)
+    {
+        esp_rom_gpio_connect_out_signal(gpios[k], SIG_GPIO_OUT_IDX, false, false);
+        gpio_set_pull_mode(gpios[k], GPIO_PULLUP_ONLY);
+        gpio_set_level(gpios[k], 1);
+        gpio_set_direction(gpios[k], GPIO_MODE_INPUT_OUTPUT_OD);
+        busGpios[k] = gpios[k];
+    }
+
+    busSensors = sensorCount;
+    return ESP_OK;
+}
+
+static void setLines(const int *gpios, int sensorCount, int level)
+{
+    for (int k = 0; k < sensorCount; k++)
+        gpio_set_level(gpios[k], level);
+}
+
+/*-------------------------------------------------------------------------------
+;
+;	trigger the sensors together and capture all lines in one transfer
+;
+;	1, 2 or 4 sensors. Returns DHT_TIMEOUT_ERROR when the transfer could
+;	not run, DHT_OK otherwise with the outcome of every sensor in results.
+;
+;--------------------------------------------------------------------------------*/
+
+int readDHTSpiLines(const int *gpios, int sensorCount, uint32_t startLowUs, uint8_t (*dhtData)[MAXdhtData],
+                    int *results)
+{
+    spi_transaction_t *done;
+    int lines = linesOf(sensorCount);
+
+    if (sensorCount < 1 || sensorCount > DHT_SPI_MAX_LINES || sensorCount == 3)
+        return DHT_TIMEOUT_ERROR;
+
+    if (setupSpi(gpios, sensorCount) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "SPI setup failed");
+        return DHT_TIMEOUT_ERROR;
+    }
+
+    spi_transaction_t trans = {
+        .flags = lines == 4 ? SPI_TRANS_MODE_QIO : lines == 2 ? SPI_TRANS_MODE_DIO : 0,
+        .rxlength = DHT_SPI_SAMPLES * lines,
+        .rx_buffer = rxBuffer,
+    };
+
+    // start signal, 3 ms for a DHT22, 18 ms or more for a DHT11
+    setLines(gpios, sensorCount, 0);
+    esp_rom_delay_us(startLowUs);
+
+    // arm the capture while the lines are still low, then release them
+    if (spi_device_queue_trans(device, &trans, 0) != ESP_OK)
+    {
+        setLines(gpios, sensorCount, 1);
+        return DHT_TIMEOUT_ERROR;
+    }
+    setLines(gpios, sensorCount, 1);
+
+    if (spi_device_get_trans_result(device, &done, pdMS_TO_TICKS(DHT_SPI_TIMEOUT_MS)) != ESP_OK)
+    {
+        // a transfer that never ended leaves the host in an unknown state, set it up again next time
+        releaseSpi();
+        return DHT_TIMEOUT_ERROR;
+    }
+
+    for (int k = 0; k < sensorCount; k++)
+    {
+        splitDHTBitstream(rxBuffer, DHT_SPI_SAMPLES, lines, lines == 1 ? 0 : k, words);
+        results[k] = decodeDHTBitstream(words, DHT_SPI_SAMPLES, dhtData[k]);
+    }
+
+    return DHT_OK;
+}
+
+// == one sensor, the readDHT() backend ===========================
+
+int readDHTSpi(int gpio, uint32_t startLowUs, uint8_t *dhtData)
+{
+    uint8_t data[1][MAXdhtData];
+    int result;
+
+    int ret = readDHTSpiLines(&gpio, 1, startLowUs, data, &result);
+    if (ret != DHT_OK)
+        return ret;
+
+    memcpy(dhtData, data[0], MAXdhtData);
+    return result;
+}
@@ -0,0 +1,37 @@
+/*
+	DHT22 SPI oversampling capture backend
+
+	An SPI host in half-duplex receive samples the data line at
+	DHT_BITSTREAM_HZ into a DMA buffer. In dual or quad mode one transfer
+	samples two or four sensors, one per data line, triggered together.
+	The CPU only sends the start signal, the capture needs no timing from
+	it, and decodes the bitstream once the transfer is done.
+
+	readDHTSpi() is the DHT_BACKEND_SPI read of DHTSensor, which the
+	sampler runs through readDHTSample(). readDHTSpiLines() is the same
+	capture for several sensors, the sampler reads one.
+*/
+
+#ifndef DHT_SPI_H_
+#define DHT_SPI_H_
+
+#include <stdint.h>
+
+#include "DHT_decode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DHT_SPI_SAMPLES 6144 // 6.1 ms, the frame ends ~5 ms after the release
+#define DHT_SPI_MAX_LINES 4  // quad mode
+
+int readDHTSpiLines(const int *gpios, int sensorCount, uint32_t startLowUs, uint8_t (*dhtData)[MAXdhtData],
+                    int *results);
+int readDHTSpi(int gpio, uint32_t startLowUs, uint8_t *dhtData);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,210 @@
+/*------------------------------------------------------------------------------
+
+	DHT read tracing
+
+	Marks are raw cycle counts, everything is turned into durations and
+	histogram entries once the read is over, outside the timed loop. The
+	trace is written by the reading task and read by the console without
+	locking, a dump taken in the middle of a read may mix two reads.
+
+---------------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "DHT_trace.h"
+
+#if CONFIG_DHT_TRACE
+
+#ifdef ESP_PLATFORM
+#include "esp_console.h"
+#endif
+
+#define DHT_TRACE_PHASES (sizeof(dhtTrace.phases) / sizeof(dhtTrace.phases[0]))
+
+static const char *const phaseNames[] = {"start", "release", "wake", "response low", "response high", "data", "total"};
+static const char *const widthNames[DHT_WIDTHS] = {"wake", "response low", "response high", "bit low", "bit high"};
+static const int16_t widthTimeoutUs[DHT_WIDTHS] = {
+    DHT_WAKE_TIMEOUT_US, DHT_RESPONSE_TIMEOUT_US, DHT_RESPONSE_TIMEOUT_US, DHT_BIT_LOW_TIMEOUT_US, DHT_BIT_HIGH_TIMEOUT_US,
+};
+
+#define PHASE_INIT {.minCycles = UINT32_MAX}
+
+dht_trace_t dhtTrace = {
+    .phases = {PHASE_INIT, PHASE_INIT, PHASE_INIT, PHASE_INIT, PHASE_INIT, PHASE_INIT, PHASE_INIT},
+    .minMarginUs = {INT16_MAX, INT16_MAX, INT16_MAX, INT16_MAX, INT16_MAX},
+};
+
+void resetDHTTrace(void)
+{
+    memset(&dhtTrace, 0, sizeof(dhtTrace));
+
+    for (size_t p = 0; p < DHT_TRACE_PHASES; p++)
+        dhtTrace.phases[p].minCycles = UINT32_MAX;
+    for (int w = 0; w < DHT_WIDTHS; w++)
+        dhtTrace.minMarginUs[w] = INT16_MAX;
+}
+
+static void addPhase(int phase, uint32_t cycles)
+{
+    dht_trace_phase_t *p = &dhtTrace.phases[phase];
+
+    if (cycles < p->minCycles)
+        p->minCycles = cycles;
+    if (cycles > p->maxCycles)
+        p->maxCycles = cycles;
+    p->sumCycles += cycles;
+    p->count++;
+}
+
+static void addWidth(int width, uint32_t us)
+{
+    uint16_t *histogram = dhtTrace.histogram[width];
+    int bin = us / DHT_TRACE_BIN_US < DHT_TRACE_BINS ? us / DHT_TRACE_BIN_US : DHT_TRACE_BINS - 1;
+    int margin = widthTimeoutUs[width] - (int)us;
+
+    histogram[bin]++;
+    if (++dhtTrace.histogramTotal[width] >= DHT_TRACE_WINDOW)
+    {
+        // rolling window: halve everything, recent widths keep their weight
+        dhtTrace.histogramTotal[width] = 0;
+        for (int k = 0; k < DHT_TRACE_BINS; k++)
+        {
+            histogram[k] /= 2;
+            dhtTrace.histogramTotal[width] += histogram[k];
+        }
+    }
+
+    if (margin < dhtTrace.minMarginUs[width])
+        dhtTrace.minMarginUs[width] = margin;
+    if (margin < DHT_TRACE_NEAR_US)
+        dhtTrace.nearMisses[width]++;
+}
+
+/*----------------------------------------------------------------------------
+;
+;	close a busy-wait read, also a failed one: only the phases it reached count
+;
+;----------------------------------------------------------------------------*/
+
+void traceDHTEnd(void)
+{
+    const uint32_t *marks = dhtTrace.marks;
+    int n = dhtTrace.markCount;
+    uint32_t cyclesPerUs = halCyclesPerUs();
+
+    dhtTrace.reads++;
+    dhtTrace.lastCount = n;
+    dhtTrace.markCount = 0;
+
+    for (int p = DHT_TRACE_START; p < DHT_TRACE_BITS; p++)
+    {
+        if (p + 1 < n)
+            addPhase(p, marks[p + 1] - marks[p]);
+    }
+    if (n == DHT_TRACE_POINTS)
+        addPhase(5, marks[n - 1] - marks[DHT_TRACE_BITS]);
+    if (n > 1)
+        addPhase(6, marks[n - 1] - marks[DHT_TRACE_START]);
+
+    if (n > DHT_TRACE_WAKE)
+        addWidth(DHT_WIDTH_WAKE, (marks[DHT_TRACE_WAKE] - marks[DHT_TRACE_LISTEN]) / cyclesPerUs);
+    if (n > DHT_TRACE_RESPONSE)
+        addWidth(DHT_WIDTH_RESPONSE_LOW, (marks[DHT_TRACE_RESPONSE] - marks[DHT_TRACE_WAKE]) / cyclesPerUs);
+    if (n > DHT_TRACE_BITS)
+        addWidth(DHT_WIDTH_RESPONSE_HIGH, (marks[DHT_TRACE_BITS] - marks[DHT_TRACE_RESPONSE]) / cyclesPerUs);
+
+    for (int p = DHT_TRACE_BITS + 1; p < n; p++)
+    {
+        int width = (p - DHT_TRACE_BITS) & 1 ? DHT_WIDTH_BIT_LOW : DHT_WIDTH_BIT_HIGH;
+        addWidth(width, (marks[p] - marks[p - 1]) / cyclesPerUs);
+    }
+}
+
+// == widths of a pulse train from the interrupt or RMT capture ======
+
+void traceDHTPulses(const dht_pulse_t *pulses, int count)
+{
+    dhtTrace.frames++;
+
+    if (count > DHT_DATA_BITS)
+    {
+        const dht_pulse_t *response = &pulses[count - DHT_DATA_BITS - 1];
+        addWidth(DHT_WIDTH_RESPONSE_LOW, response->lowUs);
+        addWidth(DHT_WIDTH_RESPONSE_HIGH, response->highUs);
+    }
+
+    for (int k = count > DHT_DATA_BITS ? count - DHT_DATA_BITS : 0; k < count; k++)
+    {
+        addWidth(DHT_WIDTH_BIT_LOW, pulses[k].lowUs);
+        addWidth(DHT_WIDTH_BIT_HIGH, pulses[k].highUs);
+    }
+}
+
+// == print everything ============================================
+
+void dumpDHTTrace(void)
+{
+    uint32_t cyclesPerUs = halCyclesPerUs();
+
+    printf("DHT trace: %lu busy-wait reads (last stopped after %d of %d marks), %lu pulse trains\n",
+           (unsigned long)dhtTrace.reads, dhtTrace.lastCount, DHT_TRACE_POINTS, (unsigned long)dhtTrace.frames);
+
+    printf("%-14s %8s %8s %8s %8s\n", "phase", "reads", "min us", "mean us", "max us");
+    for (size_t p = 0; p < DHT_TRACE_PHASES; p++)
+    {
+        const dht_trace_phase_t *phase = &dhtTrace.phases[p];
+
+        if (phase->count == 0)
+            continue;
+        printf("%-14s %8lu %8.1f %8.1f %8.1f\n", phaseNames[p], (unsigned long)phase->count,
+               (double)phase->minCycles / cyclesPerUs, (double)phase->sumCycles / phase->count / cyclesPerUs,
+               (double)phase->maxCycles / cyclesPerUs);
+    }
+
+    printf("%-14s %8s %8s %8s  histogram (%d us bins, bin:count)\n", "width", "timeout", "margin", "near", DHT_TRACE_BIN_US);
+    for (int w = 0; w < DHT_WIDTHS; w++)
+    {
+        if (dhtTrace.histogramTotal[w] == 0)
+            continue;
+
+        printf("%-14s %8d %8d %8lu ", widthNames[w], widthTimeoutUs[w], dhtTrace.minMarginUs[w],
+               (unsigned long)dhtTrace.nearMisses[w]);
+        for (int k = 0; k < DHT_TRACE_BINS; k++)
+        {
+            if (dhtTrace.histogram[w][k])
+                printf(" %d:%u", k * DHT_TRACE_BIN_US, dhtTrace.histogram[w][k]);
+        }
+        printf("\n");
+    }
+}
+
+// == console command =============================================
+
+#ifdef ESP_PLATFORM
+
+static int traceCommand(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "reset") == 0)
+        resetDHTTrace();
+    else
+        dumpDHTTrace();
+
+    return 0;
+}
+
+int registerDHTTraceCommands(void)
+{
+    const esp_console_cmd_t command = {
+        .command = "dht_trace",
+        .help = "Show DHT read phase timing and pulse width histograms, 'dht_trace reset' clears them",
+        .hint = "[reset]",
+        .func = traceCommand,
+    };
+
+    return esp_console_cmd_register(&command);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,107 @@
+/*
+	DHT read tracing, enabled with CONFIG_DHT_TRACE
+
+	The busy-wait read marks every protocol step with the CPU cycle
+	counter (start signal, release, wake, response low/high, the low and
+	high of each data bit). Every capture path also feeds its measured
+	pulse widths into rolling histograms with the margin left to the
+	busy-wait timeouts. With the option off the DHT_TRACE_* macros are
+	empty and nothing of this is compiled in.
+*/
+
+#ifndef DHT_TRACE_H_
+#define DHT_TRACE_H_
+
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#endif
+
+#include "DHT_decode.h"
+#include "hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// marks of one busy-wait read, bit k ends its low at DHT_TRACE_BITS + 1 + 2k, its high one later
+#define DHT_TRACE_START 0    // line pulled low
+#define DHT_TRACE_RELEASE 1  // start signal over, line released
+#define DHT_TRACE_LISTEN 2   // pin switched to input
+#define DHT_TRACE_WAKE 3     // sensor pulled the line low
+#define DHT_TRACE_RESPONSE 4 // end of the 80 us response low
+#define DHT_TRACE_BITS 5     // end of the 80 us response high, first bit starts
+#define DHT_TRACE_POINTS (DHT_TRACE_BITS + 1 + 2 * DHT_DATA_BITS)
+
+// measured widths, each against its busy-wait timeout
+#define DHT_WIDTH_WAKE 0
+#define DHT_WIDTH_RESPONSE_LOW 1
+#define DHT_WIDTH_RESPONSE_HIGH 2
+#define DHT_WIDTH_BIT_LOW 3
+#define DHT_WIDTH_BIT_HIGH 4
+#define DHT_WIDTHS 5
+
+#define DHT_TRACE_BIN_US 4
+#define DHT_TRACE_BINS 32       // 0..127 us, the last bin open
+#define DHT_TRACE_WINDOW 4096   // histogram counts are halved at this total, old reads fade out
+#define DHT_TRACE_NEAR_US 10    // a margin below this counts as a near miss
+
+typedef struct
+{
+    uint32_t minCycles;
+    uint32_t maxCycles;
+    uint64_t sumCycles;
+    uint32_t count;
+} dht_trace_phase_t;
+
+typedef struct
+{
+    uint32_t reads;  // traced busy-wait reads
+    uint32_t frames; // pulse trains from any path
+    uint32_t marks[DHT_TRACE_POINTS];
+    int markCount;
+    int lastCount; // marks of the last complete or failed read
+
+    // phase durations: start, release, wake, response low, response high, data, total
+    dht_trace_phase_t phases[7];
+
+    uint16_t histogram[DHT_WIDTHS][DHT_TRACE_BINS];
+    uint32_t histogramTotal[DHT_WIDTHS];
+    int16_t minMarginUs[DHT_WIDTHS];
+    uint32_t nearMisses[DHT_WIDTHS];
+} dht_trace_t;
+
+#if CONFIG_DHT_TRACE
+
+extern dht_trace_t dhtTrace;
+
+static inline void traceDHTMark(int point)
+{
+    dhtTrace.marks[point] = halCycles();
+    dhtTrace.markCount = point + 1;
+}
+
+void traceDHTEnd(void);
+void traceDHTPulses(const dht_pulse_t *pulses, int count);
+void resetDHTTrace(void);
+void dumpDHTTrace(void);
+int registerDHTTraceCommands(void);
+
+#define DHT_TRACE_MARK(point) traceDHTMark(point)
+#define DHT_TRACE_END() traceDHTEnd()
+#define DHT_TRACE_PULSES(pulses, count) traceDHTPulses(pulses, count)
+
+#else
+
+#define DHT_TRACE_MARK(point) ((void)0)
+#define DHT_TRACE_END() ((void)0)
+#define DHT_TRACE_PULSES(pulses, count) ((void)0)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,255 @@
+/*------------------------------------------------------------------------------
+
+	Controller state across resets, and where the boot time goes
+
+	One record, the zone snapshots with the system time they were taken
+	at, behind a magic number and a CRC. The RTC copy is rewritten after
+	every step, a memcpy and a CRC over about a kilobyte at most. The NVS
+	copy only when a zone state differs from the last one written, so
+	flash sees a few writes per pump run.
+
+	Only the control task saves. Restoring and the first stages run in
+	app_main() before that task starts, the later stages in the task, so
+	none of it needs a lock.
+
+---------------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_private/esp_clk.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#include "boot_state.h"
+
+static const char *TAG = "BOOT";
+
+#define BOOT_MAGIC 0x54534249 // "IBST"
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t crc;     // of everything after it
+    int64_t savedUs;  // system time, keeps running through all resets but a power-on
+    uint16_t count;
+    zone_snapshot_t zones[ZONES_MAX];
+} boot_state_t;
+
+RTC_NOINIT_ATTR static boot_state_t rtcState;
+RTC_NOINIT_ATTR static uint32_t crashMagic; // BOOT_MAGIC once crashCount is valid
+RTC_NOINIT_ATTR static uint32_t crashCount; // panic and watchdog resets in a row
+static boot_state_t saved;
+static uint8_t nvsStates[ZONES_MAX]; // zone states of the NVS copy
+static nvs_handle_t nvs = 0;
+
+static boot_times_t times = {
+    .preAppMs = -1,
+    .stageMs = {-1, -1, -1, -1, -1},
+};
+
+static const char *const sourceNames[] = {"none", "rtc", "nvs"};
+
+// == the record ===================================================
+
+static int64_t systemUs(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+static uint32_t crcOf(const boot_state_t *state)
+{
+    const uint8_t *start = (const uint8_t *)&state->savedUs;
+    return esp_rom_crc32_le(0, start, sizeof(*state) - (start - (const uint8_t *)state));
+}
+
+static bool isValid(const boot_state_t *state)
+{
+    return state->magic == BOOT_MAGIC && state->count <= ZONES_MAX && state->crc == crcOf(state);
+}
+
+static bool isCrash(esp_reset_reason_t reason)
+{
+    return reason == ESP_RST_PANIC || reason == ESP_RST_INT_WDT || reason == ESP_RST_TASK_WDT ||
+           reason == ESP_RST_WDT;
+}
+
+static bool readNvs(boot_state_t *state)
+{
+    size_t len = sizeof(*state);
+
+    if (nvs == 0 && nvs_open(BOOT_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK)
+        return false;
+    return nvs_get_blob(nvs, BOOT_NVS_KEY, state, &len) == ESP_OK && len == sizeof(*state) && isValid(state);
+}
+
+static void writeNvs(const boot_state_t *state)
+{
+    if (nvs == 0 && nvs_open(BOOT_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK)
+        return;
+
+    esp_err_t err = nvs_set_blob(nvs, BOOT_NVS_KEY, state, sizeof(*state));
+    if (err == ESP_OK)
+        err = nvs_commit(nvs);
+    if (err != ESP_OK)
+        ESP_LOGW(TAG, "NVS write failed: %s", esp_err_to_name(err));
+}
+
+/*----------------------------------------------------------------------------
+;
+;	restore the zones after controllerInit(), before the control task
+;
+;	NVS must be initialized. Returns the relay actions of resumed runs,
+;	actions needs room for ZONES_MAX entries.
+;
+;----------------------------------------------------------------------------*/
+
+int restoreBootState(controller_t *c, uint32_t nowS, zone_action_t *actions)
+{
+    esp_reset_reason_t reason = esp_reset_reason();
+    int n = 0;
+
+    times.resetReason = reason;
+    if (reason == ESP_RST_POWERON)
+        times.preAppMs = (int32_t)((esp_clk_rtc_time() - esp_timer_get_time()) / 1000);
+
+    if (crashMagic != BOOT_MAGIC)
+    {
+        crashMagic = BOOT_MAGIC;
+        crashCount = 0;
+    }
+    crashCount = isCrash(reason) ? crashCount + 1 : 0;
+
+    if (reason != ESP_RST_POWERON && isValid(&rtcState))
+    {
+        int64_t downUs = systemUs() - rtcState.savedUs;
+        uint32_t downS = downUs > 0 ? downUs / 1000000 : 0;
+
+        // a sagging supply or a crash loop would only meet the same run again
+        bool resume = reason != ESP_RST_BROWNOUT && crashCount <= BOOT_RESUME_MAX_CRASHES;
+
+        n = controllerRestore(c, nowS, rtcState.zones, rtcState.count, downS, resume, actions);
+        times.source = n >= 0 ? BOOT_SOURCE_RTC : BOOT_SOURCE_NONE;
+    }
+
+    // a power-on, or RTC memory that did not make it
+    if (times.source == BOOT_SOURCE_NONE && readNvs(&saved))
+    {
+        n = controllerRestore(c, nowS, saved.zones, saved.count, 0, false, actions);
+        times.source = n >= 0 ? BOOT_SOURCE_NVS : BOOT_SOURCE_NONE;
+    }
+
+    // zonesRestore() leaves the zones alone when the table has a different size now
+    if (n < 0)
+    {
+        ESP_LOGW(TAG, "Saved state does not fit the zone table, starting fresh");
+        n = 0;
+    }
+
+    for (int k = 0; k < c->zones.zoneCount; k++)
+        nvsStates[k] = times.source == BOOT_SOURCE_NVS ? saved.zones[k].state : UINT8_MAX;
+    return n;
+}
+
+// called by the control task after every step
+void saveBootState(const controller_t *c, uint32_t nowS)
+{
+    bool changed = false;
+
+    if (crashCount != 0 && esp_timer_get_time() >= BOOT_STABLE_S * 1000000LL)
+        crashCount = 0;
+
+    memset(&saved, 0, sizeof(saved));
+    saved.magic = BOOT_MAGIC;
+    saved.savedUs = systemUs();
+    saved.count = controllerSave(c, nowS, saved.zones);
+    saved.crc = crcOf(&saved);
+    rtcState = saved;
+
+    for (int k = 0; k < saved.count; k++)
+    {
+        changed |= saved.zones[k].state != nvsStates[k];
+        nvsStates[k] = saved.zones[k].state;
+    }
+    if (changed)
+        writeNvs(&saved);
+}
+
+// == boot number ==================================================
+
+// the next boot number, at least atLeast and never 0; 0 when NVS is not available
+uint16_t countBoot(uint16_t atLeast)
+{
+    uint16_t boot = 0;
+
+    if (nvs == 0 && nvs_open(BOOT_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK)
+        return 0;
+
+    nvs_get_u16(nvs, BOOT_NVS_COUNT_KEY, &boot);
+    boot = boot + 1 > atLeast ? boot + 1 : atLeast;
+    if (boot == 0)
+        boot = 1;
+
+    if (nvs_set_u16(nvs, BOOT_NVS_COUNT_KEY, boot) != ESP_OK || nvs_commit(nvs) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Boot number not saved");
+        return 0;
+    }
+    return boot;
+}
+
+// == boot time ====================================================
+
+void markBoot(int stage)
+{
+    if (stage >= 0 && stage < BOOT_STAGES && times.stageMs[stage] < 0)
+        times.stageMs[stage] = esp_timer_get_time() / 1000;
+}
+
+void getBootTimes(boot_times_t *t)
+{
+    *t = times;
+}
+
+void printBootTimes(void)
+{
+    printf("Boot: %s reset, state from %s, before app %ld ms, app %ld ms, restored %ld ms, sampling %ld ms, "
+           "first sample %ld ms, first decision %ld ms\n",
+           getResetName(times.resetReason), sourceNames[times.source], (long)times.preAppMs,
+           (long)times.stageMs[BOOT_STAGE_APP], (long)times.stageMs[BOOT_STAGE_RESTORED],
+           (long)times.stageMs[BOOT_STAGE_SAMPLING], (long)times.stageMs[BOOT_STAGE_SAMPLE],
+           (long)times.stageMs[BOOT_STAGE_DECISION]);
+}
+
+const char *getResetName(int reason)
+{
+    switch (reason)
+    {
+    case ESP_RST_POWERON:
+        return "power_on";
+    case ESP_RST_EXT:
+        return "external";
+    case ESP_RST_SW:
+        return "software";
+    case ESP_RST_PANIC:
+        return "panic";
+    case ESP_RST_INT_WDT:
+    case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT:
+        return "watchdog";
+    case ESP_RST_DEEPSLEEP:
+        return "deep_sleep";
+    case ESP_RST_BROWNOUT:
+        return "brownout";
+    default:
+        return "unknown";
+    }
+}
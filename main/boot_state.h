@@ -0,0 +1,74 @@
+/*
+	Controller state across resets, and where the boot time goes
+
+	saveBootState() keeps the zone snapshots (zonesSave()) in RTC memory
+	after every step; RTC_NOINIT memory survives every reset but a
+	power-on. Whenever a zone changes state, a few times per pump run, the
+	same record also goes to NVS. restoreBootState() prefers RTC: the
+	system time kept running there, so the time the controller was down
+	is known and a pump run in progress goes on for what is left of it.
+	Not after a brownout, which the pump itself may have caused, and not
+	after a second panic or watchdog reset in a row: latches, gains and
+	counters come back, the run counts as ended. From NVS the down time is unknown, runs count as ended and only
+	latches, gains and counters come back.
+
+	countBoot() keeps a boot number in NVS for the telemetry batches, which
+	the receiver tells apart by boot and uptime; unlike the sensor log's
+	number it does not depend on SPIFFS.
+
+	markBoot() notes when each startup stage is reached, in esp_timer
+	time. The ROM and the bootloader run before that timer; after a
+	power-on the RTC time, which started with the chip, tells how long
+	they took.
+*/
+
+#ifndef BOOT_STATE_H_
+#define BOOT_STATE_H_
+
+#include <stdint.h>
+
+#include "controller.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BOOT_SOURCE_NONE 0
+#define BOOT_SOURCE_RTC 1
+#define BOOT_SOURCE_NVS 2
+
+#define BOOT_STAGE_APP 0      // app_main() entered
+#define BOOT_STAGE_RESTORED 1 // zones and relays back to their state before the reset
+#define BOOT_STAGE_SAMPLING 2 // sampler task started
+#define BOOT_STAGE_SAMPLE 3   // first good reading decoded
+#define BOOT_STAGE_DECISION 4 // first zone step with that reading done
+#define BOOT_STAGES 5
+
+#define BOOT_RESUME_MAX_CRASHES 1 // panic and watchdog resets in a row that still resume a run
+#define BOOT_STABLE_S 600         // uptime after which the next crash is a first one again
+
+#define BOOT_NVS_NAMESPACE "ibaum"
+#define BOOT_NVS_KEY "zones"
+#define BOOT_NVS_COUNT_KEY "boots"
+
+typedef struct
+{
+    int32_t preAppMs;             // ROM, bootloader and startup before esp_timer, -1 unless a power-on
+    int32_t stageMs[BOOT_STAGES]; // since esp_timer started, -1 until reached
+    uint8_t source;               // BOOT_SOURCE_*
+    uint8_t resetReason;          // esp_reset_reason_t
+} boot_times_t;
+
+int restoreBootState(controller_t *c, uint32_t nowS, zone_action_t *actions);
+void saveBootState(const controller_t *c, uint32_t nowS);
+uint16_t countBoot(uint16_t atLeast);
+void markBoot(int stage);
+void getBootTimes(boot_times_t *times);
+void printBootTimes(void);
+const char *getResetName(int reason);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,243 @@
+/*------------------------------------------------------------------------------
+
+	Static task and queue allocation, stack and heap report
+
+	Every stack, queue storage area and sample bus is a static array sized
+	from budget.h, the control blocks live in the arrays below. Creation cannot
+	fail for lack of memory, a failure here is a bug in the table and
+	stops the boot.
+
+	The heap statistics are sampled by the control task and copied out
+	under a mutex, like the status. Stack high-water marks are read when a
+	report is made, FreeRTOS keeps them itself.
+
+---------------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "driver/rmt_rx.h"
+#include "esp_heap_caps.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+#include "soc/soc.h"
+
+#include "DHT.h"
+#include "budget.h"
+
+static StackType_t controlStack[BUDGET_CONTROL_STACK];
+static StackType_t samplerStack[BUDGET_SAMPLER_STACK];
+static StackType_t uploaderStack[BUDGET_UPLOADER_STACK];
+static StackType_t loggerStack[BUDGET_LOGGER_STACK];
+static StaticTask_t taskBuffers[BUDGET_TASKS];
+static TaskHandle_t taskHandles[BUDGET_TASKS];
+
+static const struct
+{
+    const char *name;
+    StackType_t *stack;
+    uint32_t stackBytes;
+    UBaseType_t priority;
+    BaseType_t core;
+} tasks[BUDGET_TASKS] = {
+    [BUDGET_TASK_CONTROL] = {"dht_task", controlStack, BUDGET_CONTROL_STACK, BUDGET_CONTROL_PRIORITY, PRO_CPU_NUM},
+    [BUDGET_TASK_SAMPLER] = {"sampler", samplerStack, BUDGET_SAMPLER_STACK, BUDGET_SAMPLER_PRIORITY, APP_CPU_NUM},
+    [BUDGET_TASK_UPLOADER] = {"uploader", uploaderStack, BUDGET_UPLOADER_STACK, BUDGET_UPLOADER_PRIORITY, PRO_CPU_NUM},
+    [BUDGET_TASK_LOGGER] = {"logger", loggerStack, BUDGET_LOGGER_STACK, BUDGET_LOGGER_PRIORITY, PRO_CPU_NUM},
+};
+
+static uint8_t resultStorage[BUDGET_RESULT_LENGTH * sizeof(dht_sample_t)];
+static uint8_t rmtStorage[BUDGET_RMT_LENGTH * sizeof(rmt_rx_done_event_data_t)];
+static StaticQueue_t queueBuffers[BUDGET_QUEUES];
+static QueueHandle_t queueHandles[BUDGET_QUEUES];
+
+static const struct
+{
+    uint8_t *storage;
+    UBaseType_t length;
+    UBaseType_t itemSize;
+} queues[BUDGET_QUEUES] = {
+    [BUDGET_QUEUE_RESULT] = {resultStorage, BUDGET_RESULT_LENGTH, sizeof(dht_sample_t)},
+    [BUDGET_QUEUE_RMT] = {rmtStorage, BUDGET_RMT_LENGTH, sizeof(rmt_rx_done_event_data_t)},
+};
+
+static sample_bus_t buses[BUDGET_BUSES];
+static bool busReady[BUDGET_BUSES];
+static const char *const busNames[BUDGET_BUSES] = {
+    [BUDGET_BUS_SAMPLES] = "samples",
+    [BUDGET_BUS_EVENTS] = "events",
+};
+
+#define STATIC_BYTES                                                                                                   \
+    (sizeof(controlStack) + sizeof(samplerStack) + sizeof(uploaderStack) + sizeof(loggerStack) +                     \
+     sizeof(taskBuffers) + sizeof(resultStorage) + sizeof(rmtStorage) + sizeof(queueBuffers) + sizeof(buses))
+
+_Static_assert(STATIC_BYTES <= CONFIG_IBAUM_STATIC_BUDGET_KB * 1024,
+               "Task stacks and queues exceed CONFIG_IBAUM_STATIC_BUDGET_KB, shrink budget.h or raise the budget");
+
+// IDF tasks the report looks up by name, with the stack their Kconfig gives them
+static const struct
+{
+    const char *name;
+    uint32_t stackBytes;
+} idfTasks[BUDGET_REPORT_TASKS - BUDGET_TASKS] = {
+    {"httpd", BUDGET_HTTP_STACK},
+    {"esp_timer", CONFIG_ESP_TIMER_TASK_STACK_SIZE},
+    {"tiT", CONFIG_LWIP_TCPIP_TASK_STACK_SIZE},
+    {"wifi", 0},
+};
+
+static StaticSemaphore_t lockBuffer;
+static SemaphoreHandle_t lock = NULL;
+static budget_heap_t internal, psram;
+
+// == creation =====================================================
+
+TaskHandle_t startBudgetTask(int task, TaskFunction_t function, void *arg)
+{
+    configASSERT(task >= 0 && task < BUDGET_TASKS && taskHandles[task] == NULL);
+
+    taskHandles[task] = xTaskCreateStaticPinnedToCore(function, tasks[task].name, tasks[task].stackBytes, arg,
+                                                      tasks[task].priority, tasks[task].stack, &taskBuffers[task],
+                                                      tasks[task].core);
+    return taskHandles[task];
+}
+
+// created on first use, later calls return the same queue
+QueueHandle_t getBudgetQueue(int queue)
+{
+    configASSERT(queue >= 0 && queue < BUDGET_QUEUES);
+
+    if (queueHandles[queue] == NULL)
+        queueHandles[queue] = xQueueCreateStatic(queues[queue].length, queues[queue].itemSize, queues[queue].storage,
+                                                 &queueBuffers[queue]);
+    return queueHandles[queue];
+}
+
+// created on first use like the queues
+sample_bus_t *getBudgetBus(int bus)
+{
+    configASSERT(bus >= 0 && bus < BUDGET_BUSES);
+
+    if (!busReady[bus])
+    {
+        busInit(&buses[bus], busNames[bus]);
+        busReady[bus] = true;
+    }
+    return &buses[bus];
+}
+
+// runs in the publishing task, a task not started yet just reads later
+static void notifyTask(void *arg)
+{
+    TaskHandle_t handle = *(TaskHandle_t *)arg;
+
+    if (handle != NULL)
+        xTaskNotifyGive(handle);
+}
+
+// Subscribes a task of the table, busNotify() then gives its task notification.
+// Subscribe before the task and the producer start, the handle is looked up on every wake.
+bus_subscriber_t *subscribeBudgetBus(int bus, int task)
+{
+    configASSERT(task >= 0 && task < BUDGET_TASKS);
+
+    bus_subscriber_t *sub = busSubscribe(getBudgetBus(bus), tasks[task].name, notifyTask, &taskHandles[task]);
+    configASSERT(sub != NULL);
+    return sub;
+}
+
+// == heap ========================================================
+
+static void sampleHeap(budget_heap_t *heap, uint32_t caps)
+{
+    multi_heap_info_t info;
+
+    heap->totalBytes = heap_caps_get_total_size(caps);
+    if (heap->totalBytes == 0)
+        return;
+
+    heap_caps_get_info(&info, caps);
+    heap->freeBytes = info.total_free_bytes;
+    heap->minFreeBytes = info.minimum_free_bytes;
+    heap->largestBlock = info.largest_free_block;
+    heap->fragmentation =
+        info.total_free_bytes ? 100 - (uint64_t)info.largest_free_block * 100 / info.total_free_bytes : 0;
+
+    if (heap->minLargestBlock == 0 || heap->largestBlock < heap->minLargestBlock)
+        heap->minLargestBlock = heap->largestBlock;
+    if (heap->fragmentation > heap->maxFragmentation)
+        heap->maxFragmentation = heap->fragmentation;
+}
+
+void sampleBudget(void)
+{
+    if (lock == NULL)
+        lock = xSemaphoreCreateMutexStatic(&lockBuffer);
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    sampleHeap(&internal, MALLOC_CAP_INTERNAL);
+    sampleHeap(&psram, MALLOC_CAP_SPIRAM);
+    xSemaphoreGive(lock);
+}
+
+// == report =======================================================
+
+static void reportTask(budget_report_t *report, const char *name, uint32_t stackBytes, TaskHandle_t handle)
+{
+    budget_task_t *task = &report->tasks[report->taskCount++];
+
+    task->name = name;
+    task->stackBytes = stackBytes;
+    task->running = handle != NULL;
+    task->freeMinBytes = handle != NULL ? uxTaskGetStackHighWaterMark(handle) : 0;
+}
+
+void getBudgetReport(budget_report_t *report)
+{
+    memset(report, 0, sizeof(*report));
+    report->staticBytes = STATIC_BYTES;
+
+    for (int k = 0; k < BUDGET_TASKS; k++)
+        reportTask(report, tasks[k].name, tasks[k].stackBytes, taskHandles[k]);
+    for (int k = 0; k < BUDGET_REPORT_TASKS - BUDGET_TASKS; k++)
+        reportTask(report, idfTasks[k].name, idfTasks[k].stackBytes, xTaskGetHandle(idfTasks[k].name));
+
+    if (lock == NULL)
+        return;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    report->internal = internal;
+    report->psram = psram;
+    xSemaphoreGive(lock);
+}
+
+static void printHeap(const char *name, const budget_heap_t *heap)
+{
+    if (heap->totalBytes == 0)
+        return;
+
+    printf("  %-8s %7lu total %7lu free %7lu min free %7lu largest (min %lu) %u%% fragmented (max %u%%)\n", name,
+           (unsigned long)heap->totalBytes, (unsigned long)heap->freeBytes, (unsigned long)heap->minFreeBytes,
+           (unsigned long)heap->largestBlock, (unsigned long)heap->minLargestBlock, heap->fragmentation,
+           heap->maxFragmentation);
+}
+
+void printBudgetReport(void)
+{
+    budget_report_t report;
+
+    getBudgetReport(&report);
+
+    printf("RAM budget: %lu bytes of static stacks and queues\n", (unsigned long)report.staticBytes);
+    for (int k = 0; k < report.taskCount; k++)
+    {
+        const budget_task_t *task = &report.tasks[k];
+
+        if (task->running)
+            printf("  %-10s stack %5lu, at least %5lu left\n", task->name, (unsigned long)task->stackBytes,
+                   (unsigned long)task->freeMinBytes);
+    }
+    printHeap("internal", &report.internal);
+    printHeap("psram", &report.psram);
+}
@@ -0,0 +1,114 @@
+/*
+	RAM budget of the firmware
+
+	One table for every task, queue and sample bus the application
+	creates: stack, priority and core of each task, length of each queue.
+	budget.c keeps their stacks, control blocks, queue storage and bus
+	rings in static arrays, so
+	they are part of the image, counted at link time, and nothing started
+	after boot can fail for lack of heap. Tasks of IDF components (WiFi,
+	lwIP, esp_timer, the HTTP server) still come from the heap, the report
+	keeps an eye on them.
+
+	Build time: the sum of the table is checked against
+	CONFIG_IBAUM_STATIC_BUDGET_KB in budget.c, the DRAM sections of the
+	linked image against CONFIG_IBAUM_DRAM_BUDGET_KB by ram_budget.cmake.
+
+	Run time: sampleBudget() follows free heap, lowest free heap, largest
+	free block and the fragmentation that follows from them, for internal
+	RAM and PSRAM. getBudgetReport() adds the stack high-water marks.
+*/
+
+#ifndef BUDGET_H_
+#define BUDGET_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#include "sample_bus.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BUDGET_TASK_CONTROL 0
+#define BUDGET_TASK_SAMPLER 1
+#define BUDGET_TASK_UPLOADER 2
+#define BUDGET_TASK_LOGGER 3
+#define BUDGET_TASKS 4
+
+// stacks in bytes, StackType_t is one byte on the ESP32
+#if CONFIG_IBAUM_DEEP_SLEEP
+#define BUDGET_CONTROL_STACK 4096 // writes the sleep buffer through SPIFFS, the logger does not run
+#else
+#define BUDGET_CONTROL_STACK 3072
+#endif
+#define BUDGET_CONTROL_PRIORITY 5
+#define BUDGET_SAMPLER_STACK 4096 // readDHT() runs here, with the RMT or SPI driver setup on the first read
+#define BUDGET_SAMPLER_PRIORITY 10 // above everything the application runs on the other core
+#define BUDGET_UPLOADER_STACK 6144 // TLS handshake and spool writes
+#define BUDGET_UPLOADER_PRIORITY 2 // like the HTTP server, below the control task
+#define BUDGET_LOGGER_STACK 4096   // log flushes go through SPIFFS on this stack
+#define BUDGET_LOGGER_PRIORITY 3   // a slow flash write only delays the log
+#define BUDGET_HTTP_STACK 4096     // allocated by esp_http_server, on the heap
+
+#define BUDGET_QUEUE_RESULT 0 // edge interrupt read to sampler, dht_sample_t
+#define BUDGET_QUEUE_RMT 1    // RMT driver to the RMT read, rmt_rx_done_event_data_t
+#define BUDGET_QUEUES 2
+
+#define BUDGET_RESULT_LENGTH 1
+#define BUDGET_RMT_LENGTH 1
+
+// sample buses, BUS_LENGTH records each, see sample_bus.h
+#define BUDGET_BUS_SAMPLES 0 // sampler to control, logger and uploader
+#define BUDGET_BUS_EVENTS 1  // pump events of the control task to logger and uploader
+#define BUDGET_BUSES 2
+
+#define BUDGET_REPORT_TASKS (BUDGET_TASKS + 4) // ours and the IDF tasks looked up by name
+#define BUDGET_REPORT_INTERVAL_S 3600
+
+typedef struct
+{
+    const char *name;
+    uint32_t stackBytes;   // 0 when the owner does not say
+    uint32_t freeMinBytes; // high-water mark, the least stack ever left
+    bool running;
+} budget_task_t;
+
+typedef struct
+{
+    uint32_t totalBytes; // 0: no such memory
+    uint32_t freeBytes;
+    uint32_t minFreeBytes;
+    uint32_t largestBlock;
+    uint32_t minLargestBlock;
+    uint8_t fragmentation; // percent of the free heap outside the largest block
+    uint8_t maxFragmentation;
+} budget_heap_t;
+
+typedef struct
+{
+    uint32_t staticBytes; // stacks, task and queue buffers and buses of the table
+    budget_task_t tasks[BUDGET_REPORT_TASKS];
+    int taskCount;
+    budget_heap_t internal;
+    budget_heap_t psram;
+} budget_report_t;
+
+TaskHandle_t startBudgetTask(int task, TaskFunction_t function, void *arg);
+QueueHandle_t getBudgetQueue(int queue);
+sample_bus_t *getBudgetBus(int bus);
+bus_subscriber_t *subscribeBudgetBus(int bus, int task);
+void sampleBudget(void);
+void getBudgetReport(budget_report_t *report);
+void printBudgetReport(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
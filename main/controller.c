@@ -0,0 +1,51 @@
+/*------------------------------------------------------------------------------
+
+	Irrigation decision logic: filters in front of the zones
+
+	A sample only updates the filter and the zone inputs. Relays change
+	in controllerStep(), which the caller runs after samples and when
+	controllerNextDue() has passed, with a clock that never goes back.
+
+---------------------------------------------------------------------------------*/
+
+#include "controller.h"
+
+int controllerInit(controller_t *c, const zone_config_t *configs, int count, int maxPumps, int staggerS)
+{
+    for (int k = 0; k < CONTROLLER_SENSORS; k++)
+        filterInit(&c->filters[k]);
+
+    return zonesInit(&c->zones, configs, count, maxPumps, staggerS);
+}
+
+void controllerSample(controller_t *c, int sensor, uint32_t timeS, const int16_t raw[FILTER_CHANNELS],
+                      int16_t filtered[FILTER_CHANNELS])
+{
+    if (sensor < 0 || sensor >= CONTROLLER_SENSORS)
+        return;
+
+    // zones only ever see conditioned values
+    filterAdd(&c->filters[sensor], timeS, raw, filtered);
+    zonesSensor(&c->zones, sensor, timeS, filtered[FILTER_HUMIDITY]);
+}
+
+int controllerStep(controller_t *c, uint32_t nowS, zone_action_t *actions)
+{
+    return zonesStep(&c->zones, nowS, actions);
+}
+
+uint32_t controllerNextDue(const controller_t *c, uint32_t nowS)
+{
+    return zonesNextDue(&c->zones, nowS);
+}
+
+int controllerSave(const controller_t *c, uint32_t nowS, zone_snapshot_t *snapshots)
+{
+    return zonesSave(&c->zones, nowS, snapshots);
+}
+
+int controllerRestore(controller_t *c, uint32_t nowS, const zone_snapshot_t *snapshots, int count, uint32_t downS,
+                      bool resume, zone_action_t *actions)
+{
+    return zonesRestore(&c->zones, nowS, snapshots, count, downS, resume, actions);
+}
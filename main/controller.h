@@ -0,0 +1,49 @@
+/*
+	Irrigation decision logic, independent of the device
+
+	Everything between a good reading and a relay change: every sensor
+	channel has its own conditioning filter (filter.h), the filtered
+	humidity goes to the zones (zones.h), and a step turns the zone states
+	into relay actions. Time is always passed in, nothing here reads a
+	clock, touches a pin or logs. The control task feeds it from the
+	sampler and when a step is due; host/replay.c feeds it recorded traces
+	much faster than real time, so both run the same decisions.
+
+	Across a reset only the zones are kept (zonesSave()), the filters
+	start again from the first new reading.
+*/
+
+#ifndef CONTROLLER_H_
+#define CONTROLLER_H_
+
+#include <stdint.h>
+
+#include "filter.h"
+#include "zones.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CONTROLLER_SENSORS ZONES_MAX_SENSORS
+
+typedef struct
+{
+    filter_t filters[CONTROLLER_SENSORS];
+    zones_t zones;
+} controller_t;
+
+int controllerInit(controller_t *c, const zone_config_t *configs, int count, int maxPumps, int staggerS);
+void controllerSample(controller_t *c, int sensor, uint32_t timeS, const int16_t raw[FILTER_CHANNELS],
+                      int16_t filtered[FILTER_CHANNELS]);
+int controllerStep(controller_t *c, uint32_t nowS, zone_action_t *actions);
+uint32_t controllerNextDue(const controller_t *c, uint32_t nowS);
+int controllerSave(const controller_t *c, uint32_t nowS, zone_snapshot_t *snapshots);
+int controllerRestore(controller_t *c, uint32_t nowS, const zone_snapshot_t *snapshots, int count, uint32_t downS,
+                      bool resume, zone_action_t *actions);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
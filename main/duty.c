@@ -0,0 +1,133 @@
+/*------------------------------------------------------------------------------
+
+	Deep sleep duty cycle: the record buffer and what the cycles cost
+
+	Wakes are kept on a grid of whole periods in system time, which runs on
+	through deep sleep: a long awake cycle, a pump run or a flush, skips
+	grid points instead of shifting all later wakes.
+
+---------------------------------------------------------------------------------*/
+
+#include <string.h>
+
+#include "duty.h"
+
+void dutyInit(duty_t *d)
+{
+    memset(d, 0, sizeof(*d));
+    d->magic = DUTY_MAGIC;
+}
+
+// RTC memory holds garbage after a power-on
+bool dutyIsValid(const duty_t *d)
+{
+    return d->magic == DUTY_MAGIC && d->count <= DUTY_RECORDS;
+}
+
+// wakeUs is what ROM and bootloader took, negative when it is not known
+void dutyWake(duty_t *d, int64_t wakeUs)
+{
+    d->wakes++;
+    d->wakesSinceFlush++;
+    d->lastWakeUs = wakeUs < 0 ? 0 : wakeUs > UINT32_MAX ? UINT32_MAX : wakeUs;
+}
+
+// false when the buffer is full, the record is counted as dropped
+bool dutyAdd(duty_t *d, uint32_t timeS, int type, int zone, int16_t humidity10, int16_t temperature10)
+{
+    if (d->count >= DUTY_RECORDS)
+    {
+        d->dropped++;
+        return false;
+    }
+
+    d->records[d->count++] = (duty_record_t){
+        .timeS = timeS,
+        .type = type,
+        .zone = zone,
+        .humidity10 = humidity10,
+        .temperature10 = temperature10,
+    };
+    return true;
+}
+
+bool dutyFlushDue(const duty_t *d, int flushWakes)
+{
+    return d->count >= DUTY_FLUSH_FILL || (d->count > 0 && d->wakesSinceFlush >= flushWakes);
+}
+
+void dutyFlushed(duty_t *d, uint32_t flushUs)
+{
+    d->count = 0;
+    d->wakesSinceFlush = 0;
+    d->flushes++;
+    d->lastFlushUs = flushUs;
+}
+
+/*----------------------------------------------------------------------------
+;
+;	end of a cycle, returns how long to sleep
+;
+;	nowUs is system time, awakeUs the time since the app started. The
+;	next wake is the first grid point at least DUTY_MIN_SLEEP_US away.
+;	After a failed read retryUs is not 0: the device wakes again after
+;	retryUs, then twice that, while that comes before the grid point.
+;	The grid stays where it was.
+;
+;----------------------------------------------------------------------------*/
+
+uint32_t dutySleep(duty_t *d, int64_t nowUs, uint32_t awakeUs, uint32_t periodUs, uint32_t retryUs)
+{
+    uint32_t cycleUs = awakeUs + d->lastWakeUs;
+
+    d->lastAwakeUs = cycleUs;
+    if (cycleUs > d->maxAwakeUs)
+        d->maxAwakeUs = cycleUs;
+    d->awakeUs += cycleUs;
+
+    // the first cycle starts the grid at its app start
+    if (d->nextWakeUs == 0)
+        d->nextWakeUs = nowUs - awakeUs;
+    if (d->nextWakeUs < nowUs + DUTY_MIN_SLEEP_US)
+    {
+        int64_t behind = nowUs + DUTY_MIN_SLEEP_US - d->nextWakeUs;
+        d->nextWakeUs += (behind + periodUs - 1) / periodUs * periodUs;
+        d->retries = 0;
+    }
+
+    d->sleepUs = d->nextWakeUs - nowUs;
+    if (retryUs == 0)
+        d->retries = 0;
+    else if (d->retries < DUTY_MAX_RETRIES && (uint64_t)retryUs << d->retries < d->sleepUs)
+    {
+        d->sleepUs = retryUs << d->retries;
+        d->retries++;
+        d->retryWakes++;
+    }
+    d->sleptUs += d->sleepUs;
+    return d->sleepUs;
+}
+
+// == average current ==============================================
+
+static uint32_t average(uint64_t awakeUs, uint64_t totalUs, uint32_t activeUa, uint32_t sleepUa)
+{
+    if (totalUs == 0 || awakeUs >= totalUs)
+        return activeUa;
+    return (awakeUs * activeUa + (totalUs - awakeUs) * sleepUa) / totalUs;
+}
+
+// what the cycles so far drew on average
+uint32_t dutyAverageUa(const duty_t *d, uint32_t activeUa, uint32_t sleepUa)
+{
+    return average(d->awakeUs, d->awakeUs + d->sleptUs, activeUa, sleepUa);
+}
+
+// what a policy would draw, from the awake time of a cycle and of a flush
+uint32_t dutyEstimateUa(uint32_t awakeUs, uint32_t flushUs, int flushWakes, uint32_t periodUs, uint32_t activeUa,
+                        uint32_t sleepUa)
+{
+    uint64_t awake = (uint64_t)awakeUs * flushWakes + flushUs;
+
+    return average(awake, (uint64_t)periodUs * flushWakes, activeUa, sleepUa);
+}
@@ -0,0 +1,87 @@
+/*
+	Deep sleep duty cycle: the record buffer and what the cycles cost
+
+	In deep sleep mode the device wakes on a timer, takes one reading,
+	steps the controller and sleeps again. Everything that has to outlive
+	a wake is kept in RTC slow memory: the controller (filters and zones)
+	and one duty_t. The duty_t buffers the samples and pump events of the
+	last wakes, so flash is only written every few wakes, and keeps the
+	accounting: awake time per cycle, the ROM and bootloader time of each
+	wake, the flush time and the time slept.
+
+	The average current is an estimate, awake time at the active current
+	plus sleep time at the sleep current. dutyEstimateUa() gives the same
+	for a policy that has not run yet, from a measured cycle.
+
+	Pure C with the times passed in, no IDF calls.
+*/
+
+#ifndef DUTY_H_
+#define DUTY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DUTY_MAGIC 0x59545544 // "DUTY"
+#define DUTY_RECORDS 64       // buffered between flushes, 12 bytes each
+#define DUTY_FLUSH_FILL 48    // flush early past this, a wake with a pump run adds several
+#define DUTY_MIN_SLEEP_US 100000
+#define DUTY_MAX_RETRIES 2 // early wakes per period after failed reads, like DHT_RETRY_MAX_EARLY
+
+typedef struct
+{
+    uint32_t timeS;
+    uint8_t type; // LOG_SAMPLE, LOG_PUMP_ON or LOG_PUMP_OFF
+    uint8_t zone; // pump events only
+    int16_t humidity10;
+    int16_t temperature10;
+} duty_record_t;
+
+typedef struct
+{
+    uint32_t magic;
+
+    // records since the last flush
+    uint16_t count;
+    uint16_t wakesSinceFlush;
+    duty_record_t records[DUTY_RECORDS];
+
+    // accounting since the first cycle
+    uint32_t wakes;
+    uint32_t flushes;
+    uint32_t dropped;     // records lost to a full buffer
+    uint32_t retryWakes;  // early wakes after a failed read
+    uint32_t lastAwakeUs; // the last cycle, its wake overhead included
+    uint32_t maxAwakeUs;
+    uint32_t lastWakeUs;  // ROM and bootloader before the last app start, estimated
+    uint32_t lastFlushUs;
+    uint64_t awakeUs;
+    uint64_t sleptUs;
+
+    // the sleep in progress
+    int64_t nextWakeUs;     // system time, on the period grid
+    uint32_t sleepUs;       // asked for
+    int64_t sleepStartRtcUs; // RTC time the sleep started at
+    uint8_t retries;        // early wakes before nextWakeUs
+} duty_t;
+
+void dutyInit(duty_t *d);
+bool dutyIsValid(const duty_t *d);
+void dutyWake(duty_t *d, int64_t wakeUs);
+bool dutyAdd(duty_t *d, uint32_t timeS, int type, int zone, int16_t humidity10, int16_t temperature10);
+bool dutyFlushDue(const duty_t *d, int flushWakes);
+void dutyFlushed(duty_t *d, uint32_t flushUs);
+uint32_t dutySleep(duty_t *d, int64_t nowUs, uint32_t awakeUs, uint32_t periodUs, uint32_t retryUs);
+uint32_t dutyAverageUa(const duty_t *d, uint32_t activeUa, uint32_t sleepUa);
+uint32_t dutyEstimateUa(uint32_t awakeUs, uint32_t flushUs, int flushWakes, uint32_t periodUs, uint32_t activeUa,
+                        uint32_t sleepUa);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
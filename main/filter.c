@@ -0,0 +1,139 @@
+/*------------------------------------------------------------------------------
+
+	Fixed-point signal conditioning
+
+	Integer only: the median sorts a copy of the window with an insertion
+	sort (5 entries, a handful of compares), the clamp and the EMA are adds
+	and shifts.
+
+---------------------------------------------------------------------------------*/
+
+#include <string.h>
+
+#include "filter.h"
+
+_Static_assert(FILTER_MEDIAN_WINDOW % 2 == 1, "FILTER_MEDIAN_WINDOW must be odd");
+_Static_assert(FILTER_MEDIAN_WINDOW < 256, "FILTER_MEDIAN_WINDOW must fit head and fill");
+
+static const int16_t maxRate[FILTER_CHANNELS] = {
+    [FILTER_HUMIDITY] = FILTER_HUMIDITY_RATE,
+    [FILTER_TEMPERATURE] = FILTER_TEMPERATURE_RATE,
+};
+
+static const int16_t minStep[FILTER_CHANNELS] = {
+    [FILTER_HUMIDITY] = FILTER_HUMIDITY_STEP,
+    [FILTER_TEMPERATURE] = FILTER_TEMPERATURE_STEP,
+};
+
+void filterInit(filter_t *filter)
+{
+    memset(filter, 0, sizeof(*filter));
+}
+
+// median of the first count entries, the window is only full after a few samples
+static int16_t median(const int16_t *values, int count)
+{
+    int16_t sorted[FILTER_MEDIAN_WINDOW];
+
+    for (int k = 0; k < count; k++)
+    {
+        int16_t v = values[k];
+        int j = k;
+
+        while (j > 0 && sorted[j - 1] > v)
+        {
+            sorted[j] = sorted[j - 1];
+            --j;
+        }
+        sorted[j] = v;
+    }
+
+    return sorted[count / 2];
+}
+
+// time from a raw step to the output halfway there
+static void trackLatency(filter_latency_t *latency, int c, uint32_t timeS, int16_t raw, int16_t out)
+{
+    if (latency->direction != 0)
+    {
+        if ((out - latency->midpoint) * latency->direction >= 0)
+        {
+            latency->lastS = timeS - latency->startS;
+            if (latency->lastS > latency->maxS)
+                latency->maxS = latency->lastS;
+            latency->steps++;
+            latency->direction = 0;
+        }
+        else if ((raw - latency->midpoint) * latency->direction < 0)
+            latency->direction = 0;
+        return;
+    }
+
+    // the tail of a step is no new step, the output has to settle first
+    int distance = raw - out;
+    if (distance < minStep[c] && distance > -minStep[c])
+        latency->settled = 1;
+    else if (latency->settled)
+    {
+        latency->startS = timeS;
+        latency->midpoint = out + distance / 2;
+        latency->direction = distance > 0 ? 1 : -1;
+        latency->settled = 0;
+    }
+}
+
+/*----------------------------------------------------------------------------
+;
+;	add one raw reading, filtered[] gets the conditioned values
+;
+;	The first reading initializes the clamp and the EMA, so the output
+;	starts at the first value instead of creeping up from zero.
+;
+;----------------------------------------------------------------------------*/
+
+void filterAdd(filter_t *filter, uint32_t timeS, const int16_t raw[FILTER_CHANNELS], int16_t filtered[FILTER_CHANNELS])
+{
+    int first = filter->fill == 0;
+    uint32_t dt = first || timeS <= filter->lastTimeS ? 1 : timeS - filter->lastTimeS;
+
+    for (int c = 0; c < FILTER_CHANNELS; c++)
+        filter->window[c][filter->head] = raw[c];
+
+    filter->head = (filter->head + 1) % FILTER_MEDIAN_WINDOW;
+    if (filter->fill < FILTER_MEDIAN_WINDOW)
+        filter->fill++;
+    filter->lastTimeS = timeS;
+
+    for (int c = 0; c < FILTER_CHANNELS; c++)
+    {
+        int32_t value = median(filter->window[c], filter->fill);
+
+        if (first)
+        {
+            filter->clamped[c] = value;
+            filter->ema[c] = value * (1 << FILTER_EMA_FRACTION);
+        }
+        else
+        {
+            int32_t step = maxRate[c] * (int32_t)(dt < 3600 ? dt : 3600);
+
+            if (value > filter->clamped[c] + step)
+            {
+                value = filter->clamped[c] + step;
+                filter->clampCount[c]++;
+            }
+            else if (value < filter->clamped[c] - step)
+            {
+                value = filter->clamped[c] - step;
+                filter->clampCount[c]++;
+            }
+            filter->clamped[c] = value;
+
+            filter->ema[c] += (value * (1 << FILTER_EMA_FRACTION) - filter->ema[c]) >> FILTER_EMA_SHIFT;
+        }
+
+        filtered[c] = (filter->ema[c] + (1 << (FILTER_EMA_FRACTION - 1))) >> FILTER_EMA_FRACTION;
+        if (!first)
+            trackLatency(&filter->latency[c], c, timeS, raw[c], filtered[c]);
+    }
+}
@@ -0,0 +1,75 @@
+/*
+	Fixed-point conditioning of DHT readings
+
+	Per channel: rolling median over FILTER_MEDIAN_WINDOW samples (a spike
+	that passed the checksum never reaches the output), then a clamp on the
+	rate of change against the previous clamped value, then an exponential
+	moving average with alpha = 1 / 2^FILTER_EMA_SHIFT. Values are deci units
+	like history.h, windows are compile-time sizes inside filter_t, nothing
+	is allocated.
+
+	The delay is also measured on the live signal: a raw reading at least
+	a step threshold away from an output that had settled starts a measurement, which ends
+	when the output has covered half of that distance. A raw value falling
+	back across the midpoint (an outlier the median ate) drops it.
+*/
+
+#ifndef FILTER_H_
+#define FILTER_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FILTER_HUMIDITY 0
+#define FILTER_TEMPERATURE 1
+#define FILTER_CHANNELS 2
+
+#define FILTER_MEDIAN_WINDOW 5 // odd, rejects up to 2 consecutive outliers
+#define FILTER_EMA_SHIFT 2     // alpha = 1/4
+#define FILTER_EMA_FRACTION 8  // fraction bits of the EMA state
+
+// largest plausible change per second, deci-percent and deci-degree
+#define FILTER_HUMIDITY_RATE 10
+#define FILTER_TEMPERATURE_RATE 5
+
+// group delay of median and EMA for a step, in samples
+#define FILTER_DELAY_SAMPLES ((FILTER_MEDIAN_WINDOW - 1) / 2 + (1 << FILTER_EMA_SHIFT) - 1)
+
+// smallest raw-to-output distance that counts as a step for the measured delay
+#define FILTER_HUMIDITY_STEP 30
+#define FILTER_TEMPERATURE_STEP 10
+
+typedef struct
+{
+    uint32_t startS;    // time of the raw reading that started the step
+    int16_t midpoint;   // output value that ends it
+    int8_t direction;   // +1 rising, -1 falling, 0 no step pending
+    uint8_t settled;    // raw and output were closer than a step, the next step may start
+    uint32_t lastS;     // delay of the last completed step
+    uint32_t maxS;
+    uint32_t steps;     // completed measurements
+} filter_latency_t;
+
+typedef struct
+{
+    int16_t window[FILTER_CHANNELS][FILTER_MEDIAN_WINDOW];
+    int16_t clamped[FILTER_CHANNELS];
+    int32_t ema[FILTER_CHANNELS]; // FILTER_EMA_FRACTION fixed point
+    uint8_t head;
+    uint8_t fill;
+    uint32_t lastTimeS;
+    uint32_t clampCount[FILTER_CHANNELS]; // samples the rate clamp had to limit
+    filter_latency_t latency[FILTER_CHANNELS];
+} filter_t;
+
+void filterInit(filter_t *filter);
+void filterAdd(filter_t *filter, uint32_t timeS, const int16_t raw[FILTER_CHANNELS], int16_t filtered[FILTER_CHANNELS]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,68 @@
+/*
+	Thin hardware abstraction for pins, clocks and delays
+
+	On the ESP32 every call is a static inline over the IDF / LL API, so the
+	timing-critical loops cost the same as before. A host build (no
+	ESP_PLATFORM) links host/hal_host.c instead, which runs the same code
+	against a simulated DHT22 on a virtual clock.
+*/
+
+#ifndef HAL_H_
+#define HAL_H_
+
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
+
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "hal/gpio_ll.h"
+
+static inline void halPinOutput(int pin) { gpio_set_direction(pin, GPIO_MODE_OUTPUT); }
+static inline void halPinInput(int pin) { gpio_set_direction(pin, GPIO_MODE_INPUT); }
+static inline void halPinWrite(int pin, int level) { gpio_set_level(pin, level); }
+static inline int halPinRead(int pin) { return gpio_ll_get_level(&GPIO, pin); } // straight from the input register
+
+static inline void halDelayUs(uint32_t us) { esp_rom_delay_us(us); }
+static inline void halDelayMs(uint32_t ms) { vTaskDelay(pdMS_TO_TICKS(ms)); }
+
+static inline uint32_t halCycles(void) { return esp_cpu_get_cycle_count(); }
+static inline uint32_t halCyclesPerUs(void) { return esp_rom_get_cpu_ticks_per_us(); }
+static inline int64_t halMicros(void) { return esp_timer_get_time(); }
+
+// mask interrupts up to the critical section level on this core only, no spinlock
+static inline uint32_t halMaskInterrupts(void) { return portSET_INTERRUPT_MASK_FROM_ISR(); }
+static inline void halUnmaskInterrupts(uint32_t state) { portCLEAR_INTERRUPT_MASK_FROM_ISR(state); }
+
+#else
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void halPinOutput(int pin);
+void halPinInput(int pin);
+void halPinWrite(int pin, int level);
+int halPinRead(int pin);
+
+void halDelayUs(uint32_t us);
+void halDelayMs(uint32_t ms);
+
+uint32_t halCycles(void);
+uint32_t halCyclesPerUs(void);
+int64_t halMicros(void);
+
+uint32_t halMaskInterrupts(void);
+void halUnmaskInterrupts(uint32_t state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+#endif
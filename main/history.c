@@ -0,0 +1,232 @@
+/*------------------------------------------------------------------------------
+
+	Multi-resolution sample history
+
+	Buckets are aligned to their tier period (bucket number = time / period)
+	and every bucket number between the oldest and the newest is present,
+	missing ones are filled in empty when the tier advances. That keeps the
+	ring slot of any bucket at number % length, so a window lookup is plain
+	index arithmetic.
+
+---------------------------------------------------------------------------------*/
+
+#include <string.h>
+
+#include "history.h"
+
+static inline history_bucket_t *bucketAt(const history_tier_t *tier, uint32_t index)
+{
+    return &tier->buckets[index % tier->length];
+}
+
+// == setup ======================================================
+
+void historyInit(history_t *history)
+{
+    memset(history, 0, sizeof(*history));
+
+    history->tiers[0] = (history_tier_t){.periodS = HISTORY_RAW_PERIOD_S, .length = HISTORY_RAW_LENGTH, .buckets = history->raw};
+    history->tiers[1] = (history_tier_t){.periodS = HISTORY_MINUTE_PERIOD_S, .length = HISTORY_MINUTE_LENGTH, .buckets = history->minute};
+    history->tiers[2] = (history_tier_t){.periodS = HISTORY_HOUR_PERIOD_S, .length = HISTORY_HOUR_LENGTH, .buckets = history->hour};
+}
+
+static void openBucket(const history_t *history, history_tier_t *tier, uint32_t index)
+{
+    history_bucket_t *bucket = bucketAt(tier, index);
+
+    bucket->index = index;
+    for (int c = 0; c < HISTORY_CHANNELS; c++)
+    {
+        bucket->min[c] = INT16_MAX;
+        bucket->max[c] = INT16_MIN;
+        bucket->sumTotal[c] = history->sumTotal[c];
+    }
+    bucket->countTotal = history->countTotal;
+}
+
+// == move a tier forward to bucket index, before the sample is counted
+
+static void advanceTier(const history_t *history, history_tier_t *tier, uint32_t index)
+{
+    if (tier->used == 0)
+    {
+        memcpy(tier->baseSum, history->sumTotal, sizeof(tier->baseSum));
+        tier->baseCount = history->countTotal;
+        tier->head = index;
+        tier->used = 1;
+        openBucket(history, tier, index);
+        return;
+    }
+
+    if (index <= tier->head)
+        return; // same bucket, or the clock stepped back: keep adding to the newest one
+
+    // a gap longer than the ring only needs the last length buckets
+    uint32_t first = tier->head + 1;
+    if (index - tier->head > tier->length)
+        first = index - tier->length + 1;
+
+    for (uint32_t k = first; k <= index; k++)
+        openBucket(history, tier, k);
+
+    uint32_t added = index - tier->head;
+    tier->used = tier->used + added > tier->length ? tier->length : tier->used + added;
+    tier->head = index;
+}
+
+/*----------------------------------------------------------------------------
+;
+;	add one sample, values[] holds one fixed-point value per channel
+;
+;----------------------------------------------------------------------------*/
+
+void historyAdd(history_t *history, uint32_t timeS, const int16_t *values)
+{
+    for (int t = 0; t < HISTORY_TIERS; t++)
+        advanceTier(history, &history->tiers[t], timeS / history->tiers[t].periodS);
+
+    for (int c = 0; c < HISTORY_CHANNELS; c++)
+        history->sumTotal[c] += (uint32_t)(int32_t)values[c];
+    ++history->countTotal;
+
+    for (int t = 0; t < HISTORY_TIERS; t++)
+    {
+        history_bucket_t *bucket = bucketAt(&history->tiers[t], history->tiers[t].head);
+
+        for (int c = 0; c < HISTORY_CHANNELS; c++)
+        {
+            if (values[c] < bucket->min[c])
+                bucket->min[c] = values[c];
+            if (values[c] > bucket->max[c])
+                bucket->max[c] = values[c];
+            bucket->sumTotal[c] = history->sumTotal[c];
+        }
+        bucket->countTotal = history->countTotal;
+    }
+}
+
+// sum is a wrap-around difference of running totals
+static int16_t roundedMean(uint32_t sum, uint32_t count)
+{
+    int32_t signedSum = (int32_t)sum;
+    int32_t half = count / 2;
+
+    return (signedSum >= 0 ? signedSum + half : signedSum - half) / (int32_t)count;
+}
+
+/*----------------------------------------------------------------------------
+;
+;	aggregate of one channel over the last windowS seconds before nowS
+
+	The finest tier whose ring covers the window is used, the window is
+	rounded up to whole buckets of that tier. Mean comes from the running
+	totals of the newest bucket and the bucket just before the window.
+	Returns the number of samples in the window.
+
+;----------------------------------------------------------------------------*/
+
+uint32_t historyWindow(const history_t *history, uint32_t nowS, uint32_t windowS, int channel, history_stats_t *stats)
+{
+    const history_tier_t *tier = &history->tiers[HISTORY_TIERS - 1];
+
+    for (int t = 0; t < HISTORY_TIERS; t++)
+    {
+        if (history->tiers[t].periodS * (history->tiers[t].length - 1) >= windowS)
+        {
+            tier = &history->tiers[t];
+            break;
+        }
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    if (tier->used == 0)
+        return 0;
+
+    uint32_t count = (windowS + tier->periodS - 1) / tier->periodS;
+    if (count < 1)
+        count = 1;
+    if (count > tier->length - 1u)
+        count = tier->length - 1u;
+
+    uint32_t nowIndex = nowS / tier->periodS;
+    uint32_t last = tier->head < nowIndex ? tier->head : nowIndex;
+    uint32_t start = nowIndex + 1 >= count ? nowIndex + 1 - count : 0;
+    uint32_t oldest = tier->head + 1 - tier->used;
+
+    if (last < start || last < oldest)
+        return 0;
+
+    const history_bucket_t *end = bucketAt(tier, last);
+    uint32_t beforeSum = tier->baseSum[channel];
+    uint32_t beforeCount = tier->baseCount;
+
+    if (start > oldest)
+    {
+        const history_bucket_t *before = bucketAt(tier, start - 1);
+        beforeSum = before->sumTotal[channel];
+        beforeCount = before->countTotal;
+    }
+
+    stats->count = end->countTotal - beforeCount;
+    if (stats->count == 0)
+        return 0;
+
+    stats->mean = roundedMean(end->sumTotal[channel] - beforeSum, stats->count);
+
+    stats->min = INT16_MAX;
+    stats->max = INT16_MIN;
+    for (uint32_t k = start > oldest ? start : oldest; k <= last; k++)
+    {
+        const history_bucket_t *bucket = bucketAt(tier, k);
+
+        if (bucket->min[channel] < stats->min)
+            stats->min = bucket->min[channel];
+        if (bucket->max[channel] > stats->max)
+            stats->max = bucket->max[channel];
+    }
+
+    return stats->count;
+}
+
+/*----------------------------------------------------------------------------
+;
+;	one bucket of a tier, age 0 is the newest
+;
+;	timeS gets the start of the bucket. Returns its number of samples, 0
+;	for an empty bucket or an age beyond the buckets whose mean is known
+;	(the oldest slot of a full ring has lost its predecessor).
+;
+;----------------------------------------------------------------------------*/
+
+uint32_t historyBucket(const history_t *history, int tier, uint32_t age, int channel, uint32_t *timeS, history_stats_t *stats)
+{
+    const history_tier_t *t = &history->tiers[tier];
+    uint32_t known = t->used == t->length ? t->used - 1u : t->used;
+
+    memset(stats, 0, sizeof(*stats));
+    if (age >= known)
+        return 0;
+
+    uint32_t index = t->head - age;
+    const history_bucket_t *bucket = bucketAt(t, index);
+    uint32_t beforeSum = t->baseSum[channel];
+    uint32_t beforeCount = t->baseCount;
+
+    if (age + 1 < t->used)
+    {
+        const history_bucket_t *before = bucketAt(t, index - 1);
+        beforeSum = before->sumTotal[channel];
+        beforeCount = before->countTotal;
+    }
+
+    *timeS = index * t->periodS;
+    stats->count = bucket->countTotal - beforeCount;
+    if (stats->count == 0)
+        return 0;
+
+    stats->mean = roundedMean(bucket->sumTotal[channel] - beforeSum, stats->count);
+    stats->min = bucket->min[channel];
+    stats->max = bucket->max[channel];
+
+    return stats->count;
+}
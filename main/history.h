@@ -0,0 +1,81 @@
+/*
+	Multi-resolution in-RAM sample history
+
+	Three rings of time-aligned buckets (raw 2 s, 1 minute, 1 hour), fed
+	with every sample. Each bucket keeps min/max per channel and the
+	running totals of sum and count at its end, so the mean over any
+	window is a difference of two buckets, O(1). Min/max scan the buckets
+	of the window in the finest tier whose ring covers it, at most one ring.
+	Values are fixed point tenths (deci-percent, deci-degree), all memory
+	is inside history_t (~3.5 KB), nothing is allocated.
+*/
+
+#ifndef HISTORY_H_
+#define HISTORY_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HISTORY_HUMIDITY 0
+#define HISTORY_TEMPERATURE 1
+#define HISTORY_CHANNELS 2
+
+#define HISTORY_RAW_PERIOD_S 2
+#define HISTORY_RAW_LENGTH 32 // ~1 minute
+#define HISTORY_MINUTE_PERIOD_S 60
+#define HISTORY_MINUTE_LENGTH 61 // 1 hour
+#define HISTORY_HOUR_PERIOD_S 3600
+#define HISTORY_HOUR_LENGTH 49 // 2 days
+#define HISTORY_TIERS 3
+
+typedef struct
+{
+    uint32_t index; // absolute bucket number, time / period
+    int16_t min[HISTORY_CHANNELS];
+    int16_t max[HISTORY_CHANNELS];
+    uint32_t sumTotal[HISTORY_CHANNELS]; // running totals, wrap-around safe differences
+    uint32_t countTotal;
+} history_bucket_t;
+
+typedef struct
+{
+    uint32_t periodS;
+    uint16_t length;
+    uint16_t used;       // buckets filled so far, up to length
+    uint32_t head;       // absolute index of the newest bucket
+    uint32_t baseSum[HISTORY_CHANNELS]; // totals before the first bucket of this tier
+    uint32_t baseCount;
+    history_bucket_t *buckets;
+} history_tier_t;
+
+typedef struct
+{
+    uint32_t sumTotal[HISTORY_CHANNELS];
+    uint32_t countTotal;
+    history_tier_t tiers[HISTORY_TIERS];
+    history_bucket_t raw[HISTORY_RAW_LENGTH];
+    history_bucket_t minute[HISTORY_MINUTE_LENGTH];
+    history_bucket_t hour[HISTORY_HOUR_LENGTH];
+} history_t;
+
+typedef struct
+{
+    uint32_t count;
+    int16_t min;
+    int16_t max;
+    int16_t mean;
+} history_stats_t;
+
+void historyInit(history_t *history);
+void historyAdd(history_t *history, uint32_t timeS, const int16_t *values);
+uint32_t historyWindow(const history_t *history, uint32_t nowS, uint32_t windowS, int channel, history_stats_t *stats);
+uint32_t historyBucket(const history_t *history, int tier, uint32_t age, int channel, uint32_t *timeS, history_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,633 @@
+/*------------------------------------------------------------------------------
+
+	HTTP metrics and history endpoint on esp_http_server
+
+	All handlers run in the single server task, so they share one static
+	chunk buffer and one status snapshot. The status is copied once per request and the history
+	is read a bucket at a time, each under the short status lock.
+
+---------------------------------------------------------------------------------*/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+#include "budget.h"
+#include "http_metrics.h"
+#include "sampler.h"
+#include "status.h"
+#include "uploader.h"
+
+static const char *TAG = "HTTP";
+
+static char chunk[HTTP_METRICS_CHUNK_SIZE];
+static char query[64];
+
+// request counters and the render time of the last response, per path
+#define PATH_METRICS 0
+#define PATH_STATUS 1
+#define PATH_HISTORY 2
+#define PATHS 3
+
+static const char *const pathNames[PATHS] = {"/metrics", "/status.json", "/history.json"};
+static uint32_t requests[PATHS];
+static uint32_t lastRenderUs[PATHS];
+static uint32_t maxRenderUs[PATHS];
+
+static const char *const stateNames[STATUS_STATES] = {"idle", "pumping", "cooldown", "waiting"};
+static const char *const faultNames[DHT_FAULTS] = {"no_response", "data_timeout", "checksum"};
+static const char *const tierNames[HISTORY_TIERS] = {"raw", "minute", "hour"};
+static const uint32_t jitterBinUs[SAMPLER_JITTER_BINS - 1] = SAMPLER_JITTER_BOUNDS_US;
+static const uint16_t tierLengths[HISTORY_TIERS] = {HISTORY_RAW_LENGTH, HISTORY_MINUTE_LENGTH, HISTORY_HOUR_LENGTH};
+static const char *const channelNames[HISTORY_CHANNELS] = {"humidity", "temperature"};
+static const char *const bootStageNames[BOOT_STAGES] = {"app", "restored", "sampling", "first_sample",
+                                                        "first_decision"};
+static const char *const bootSourceNames[] = {"none", "rtc", "nvs"};
+
+static const struct
+{
+    const char *name;
+    uint32_t seconds;
+} windows[] = {{"1m", 60}, {"10m", 600}, {"1h", 3600}, {"24h", 86400}};
+
+#define WINDOWS (sizeof(windows) / sizeof(windows[0]))
+
+static ibaum_status_t snapshot; // with the zones it is too big for the server stack
+
+/*----------------------------------------------------------------------------
+;
+;	chunked writer
+;
+;	Text is formatted straight into the chunk buffer. When a piece does
+;	not fit the buffer goes out as one HTTP chunk and the piece is
+;	formatted again at its start. After a send error the rest is dropped.
+;
+;----------------------------------------------------------------------------*/
+
+typedef struct
+{
+    httpd_req_t *req;
+    int len;
+    esp_err_t err;
+} chunk_writer_t;
+
+static void flushChunk(chunk_writer_t *w)
+{
+    if (w->len > 0 && w->err == ESP_OK)
+        w->err = httpd_resp_send_chunk(w->req, chunk, w->len);
+    w->len = 0;
+}
+
+static void put(chunk_writer_t *w, const char *format, ...)
+{
+    va_list args;
+    int n;
+
+    if (w->err != ESP_OK)
+        return;
+
+    va_start(args, format);
+    n = vsnprintf(chunk + w->len, sizeof(chunk) - w->len, format, args);
+    va_end(args);
+
+    if (n >= (int)sizeof(chunk) - w->len)
+    {
+        flushChunk(w);
+        va_start(args, format);
+        n = vsnprintf(chunk, sizeof(chunk), format, args);
+        va_end(args);
+        if (n >= (int)sizeof(chunk))
+            n = sizeof(chunk) - 1; // a single piece never gets near this
+    }
+
+    w->len += n;
+}
+
+// tenths as a decimal number, no float formatting
+static void putDeci(chunk_writer_t *w, int value)
+{
+    put(w, "%s%d.%d", value < 0 ? "-" : "", (value < 0 ? -value : value) / 10, (value < 0 ? -value : value) % 10);
+}
+
+static esp_err_t finish(chunk_writer_t *w, int path, int64_t startUs)
+{
+    flushChunk(w);
+    if (w->err == ESP_OK)
+        w->err = httpd_resp_send_chunk(w->req, NULL, 0);
+
+    uint32_t us = esp_timer_get_time() - startUs;
+    requests[path]++;
+    lastRenderUs[path] = us;
+    if (us > maxRenderUs[path])
+        maxRenderUs[path] = us;
+
+    return w->err;
+}
+
+static uint32_t sampleAgeS(const ibaum_status_t *status, int64_t nowUs)
+{
+    return status->sampleUs ? (nowUs - status->sampleUs) / 1000000 : 0;
+}
+
+/*----------------------------------------------------------------------------
+;
+;	GET /metrics
+;
+;----------------------------------------------------------------------------*/
+
+static void putGauge(chunk_writer_t *w, const char *name, const char *type)
+{
+    put(w, "# TYPE %s %s\n", name, type);
+}
+
+static void putHeap(chunk_writer_t *w, const char *region, const budget_heap_t *heap)
+{
+    if (heap->totalBytes == 0)
+        return;
+
+    put(w, "ibaum_heap_bytes{region=\"%s\",stat=\"total\"} %lu\n", region, (unsigned long)heap->totalBytes);
+    put(w, "ibaum_heap_bytes{region=\"%s\",stat=\"free\"} %lu\n", region, (unsigned long)heap->freeBytes);
+    put(w, "ibaum_heap_bytes{region=\"%s\",stat=\"min_free\"} %lu\n", region, (unsigned long)heap->minFreeBytes);
+    put(w, "ibaum_heap_bytes{region=\"%s\",stat=\"largest_block\"} %lu\n", region,
+        (unsigned long)heap->largestBlock);
+    put(w, "ibaum_heap_bytes{region=\"%s\",stat=\"largest_block_min\"} %lu\n", region,
+        (unsigned long)heap->minLargestBlock);
+}
+
+static void putBudget(chunk_writer_t *w)
+{
+    budget_report_t budget;
+
+    getBudgetReport(&budget);
+
+    putGauge(w, "ibaum_static_budget_bytes", "gauge");
+    put(w, "ibaum_static_budget_bytes %lu\n", (unsigned long)budget.staticBytes);
+
+    putGauge(w, "ibaum_heap_bytes", "gauge");
+    putHeap(w, "internal", &budget.internal);
+    putHeap(w, "psram", &budget.psram);
+    putGauge(w, "ibaum_heap_fragmentation_percent", "gauge");
+    for (int k = 0; k < 2; k++)
+    {
+        const budget_heap_t *heap = k ? &budget.psram : &budget.internal;
+        const char *region = k ? "psram" : "internal";
+
+        if (heap->totalBytes == 0)
+            continue;
+        put(w, "ibaum_heap_fragmentation_percent{region=\"%s\",stat=\"last\"} %u\n", region, heap->fragmentation);
+        put(w, "ibaum_heap_fragmentation_percent{region=\"%s\",stat=\"max\"} %u\n", region,
+            heap->maxFragmentation);
+    }
+
+    putGauge(w, "ibaum_task_stack_bytes", "gauge");
+    for (int k = 0; k < budget.taskCount; k++)
+        if (budget.tasks[k].running && budget.tasks[k].stackBytes)
+            put(w, "ibaum_task_stack_bytes{task=\"%s\"} %lu\n", budget.tasks[k].name,
+                (unsigned long)budget.tasks[k].stackBytes);
+    putGauge(w, "ibaum_task_stack_free_min_bytes", "gauge");
+    for (int k = 0; k < budget.taskCount; k++)
+        if (budget.tasks[k].running)
+            put(w, "ibaum_task_stack_free_min_bytes{task=\"%s\"} %lu\n", budget.tasks[k].name,
+                (unsigned long)budget.tasks[k].freeMinBytes);
+}
+
+static void putBuses(chunk_writer_t *w)
+{
+    const sample_bus_t *buses[BUDGET_BUSES];
+    bus_subscriber_stats_t subs[BUDGET_BUSES][BUS_SUBSCRIBERS];
+    int counts[BUDGET_BUSES];
+
+    for (int b = 0; b < BUDGET_BUSES; b++)
+    {
+        buses[b] = getBudgetBus(b);
+        counts[b] = busGetStats(buses[b], subs[b]);
+    }
+
+    putGauge(w, "ibaum_bus_published_total", "counter");
+    for (int b = 0; b < BUDGET_BUSES; b++)
+        put(w, "ibaum_bus_published_total{bus=\"%s\"} %lu\n", buses[b]->name, (unsigned long)busPublished(buses[b]));
+    putGauge(w, "ibaum_bus_received_total", "counter");
+    for (int b = 0; b < BUDGET_BUSES; b++)
+        for (int k = 0; k < counts[b]; k++)
+            put(w, "ibaum_bus_received_total{bus=\"%s\",subscriber=\"%s\"} %lu\n", buses[b]->name, subs[b][k].name,
+                (unsigned long)subs[b][k].received);
+    putGauge(w, "ibaum_bus_overruns_total", "counter");
+    for (int b = 0; b < BUDGET_BUSES; b++)
+        for (int k = 0; k < counts[b]; k++)
+            put(w, "ibaum_bus_overruns_total{bus=\"%s\",subscriber=\"%s\"} %lu\n", buses[b]->name, subs[b][k].name,
+                (unsigned long)subs[b][k].overruns);
+    putGauge(w, "ibaum_bus_lag_records", "gauge");
+    for (int b = 0; b < BUDGET_BUSES; b++)
+        for (int k = 0; k < counts[b]; k++)
+            put(w, "ibaum_bus_lag_records{bus=\"%s\",subscriber=\"%s\"} %lu\n", buses[b]->name, subs[b][k].name,
+                (unsigned long)subs[b][k].lag);
+}
+
+// stays empty until the first decision, the control task publishes the times then
+static void putBoot(chunk_writer_t *w, const boot_times_t *boot)
+{
+    putGauge(w, "ibaum_boot_info", "gauge");
+    put(w, "ibaum_boot_info{reset=\"%s\",restored=\"%s\"} 1\n", getResetName(boot->resetReason),
+        bootSourceNames[boot->source]);
+    putGauge(w, "ibaum_boot_milliseconds", "gauge");
+    if (boot->preAppMs >= 0)
+        put(w, "ibaum_boot_milliseconds{stage=\"before_app\"} %ld\n", (long)boot->preAppMs);
+    for (int k = 0; k < BOOT_STAGES; k++)
+        if (boot->stageMs[k] >= 0)
+            put(w, "ibaum_boot_milliseconds{stage=\"%s\"} %ld\n", bootStageNames[k], (long)boot->stageMs[k]);
+}
+
+// one series per zone and state, like the single controller state before
+static void putZones(chunk_writer_t *w, const ibaum_status_t *status)
+{
+    const ibaum_zone_status_t *zone;
+    int n = status->zoneCount;
+
+    putGauge(w, "ibaum_zone_state", "gauge");
+    for (zone = status->zones; zone < status->zones + n; zone++)
+        for (int k = 0; k < STATUS_STATES; k++)
+            put(w, "ibaum_zone_state{zone=\"%s\",state=\"%s\"} %d\n", zone->name, stateNames[k], zone->state == k);
+    putGauge(w, "ibaum_zone_humidity_percent", "gauge");
+    for (zone = status->zones; zone < status->zones + n; zone++)
+        if (zone->hasReading)
+        {
+            put(w, "ibaum_zone_humidity_percent{zone=\"%s\"} ", zone->name);
+            putDeci(w, zone->humidity10);
+            put(w, "\n");
+        }
+    putGauge(w, "ibaum_zone_pump_cycles_total", "counter");
+    for (zone = status->zones; zone < status->zones + n; zone++)
+        put(w, "ibaum_zone_pump_cycles_total{zone=\"%s\"} %lu\n", zone->name, (unsigned long)zone->pumpCycles);
+    putGauge(w, "ibaum_zone_pump_seconds_total", "counter");
+    for (zone = status->zones; zone < status->zones + n; zone++)
+        put(w, "ibaum_zone_pump_seconds_total{zone=\"%s\"} %lu\n", zone->name, (unsigned long)zone->pumpSeconds);
+    putGauge(w, "ibaum_zone_pulse_seconds", "gauge");
+    for (zone = status->zones; zone < status->zones + n; zone++)
+        put(w, "ibaum_zone_pulse_seconds{zone=\"%s\"} %u\n", zone->name, zone->pulseS);
+    putGauge(w, "ibaum_zone_gain_percent_per_minute", "gauge");
+    for (zone = status->zones; zone < status->zones + n; zone++)
+    {
+        put(w, "ibaum_zone_gain_percent_per_minute{zone=\"%s\"} ", zone->name);
+        putDeci(w, zone->gainQ8 * 60 / 256);
+        put(w, "\n");
+    }
+    putGauge(w, "ibaum_zone_max_wait_seconds", "gauge");
+    for (zone = status->zones; zone < status->zones + n; zone++)
+        put(w, "ibaum_zone_max_wait_seconds{zone=\"%s\"} %lu\n", zone->name, (unsigned long)zone->maxWaitS);
+}
+
+static esp_err_t metricsHandler(httpd_req_t *req)
+{
+    int64_t startUs = esp_timer_get_time();
+    chunk_writer_t w = {.req = req};
+    const dht_health_t *health = &snapshot.health;
+
+    getStatus(&snapshot);
+    uint32_t nowS = startUs / 1000000;
+
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+
+    putGauge(&w, "ibaum_humidity_percent", "gauge");
+    put(&w, "ibaum_humidity_percent{value=\"raw\"} ");
+    putDeci(&w, snapshot.humidity10);
+    put(&w, "\nibaum_humidity_percent{value=\"filtered\"} ");
+    putDeci(&w, snapshot.filteredHumidity10);
+    put(&w, "\n");
+
+    putGauge(&w, "ibaum_temperature_celsius", "gauge");
+    put(&w, "ibaum_temperature_celsius{value=\"raw\"} ");
+    putDeci(&w, snapshot.temperature10);
+    put(&w, "\nibaum_temperature_celsius{value=\"filtered\"} ");
+    putDeci(&w, snapshot.filteredTemperature10);
+    put(&w, "\n");
+
+    putGauge(&w, "ibaum_filter_delay_seconds", "gauge");
+    put(&w, "ibaum_filter_delay_seconds{stat=\"last\"} %lu\n", (unsigned long)snapshot.filterLatency.lastS);
+    put(&w, "ibaum_filter_delay_seconds{stat=\"max\"} %lu\n", (unsigned long)snapshot.filterLatency.maxS);
+    putGauge(&w, "ibaum_filter_steps_total", "counter");
+    put(&w, "ibaum_filter_steps_total %lu\n", (unsigned long)snapshot.filterLatency.steps);
+    putGauge(&w, "ibaum_condition_seconds", "gauge");
+    put(&w, "ibaum_condition_seconds %lu.%06lu\n", (unsigned long)(snapshot.conditionUs / 1000000),
+        (unsigned long)(snapshot.conditionUs % 1000000));
+
+    putGauge(&w, "ibaum_sample_age_seconds", "gauge");
+    put(&w, "ibaum_sample_age_seconds %lu\n", (unsigned long)sampleAgeS(&snapshot, startUs));
+    putGauge(&w, "ibaum_pump_on", "gauge");
+    put(&w, "ibaum_pump_on %d\n", snapshot.pumpOn);
+    putGauge(&w, "ibaum_pumps_running", "gauge");
+    put(&w, "ibaum_pumps_running %d\n", snapshot.pumpsRunning);
+    putGauge(&w, "ibaum_pump_cycles_total", "counter");
+    put(&w, "ibaum_pump_cycles_total %lu\n", (unsigned long)snapshot.pumpCycles);
+    putZones(&w, &snapshot);
+
+    putGauge(&w, "ibaum_dht_reads_total", "counter");
+    put(&w, "ibaum_dht_reads_total %lu\n", (unsigned long)health->reads);
+    putGauge(&w, "ibaum_dht_ok_total", "counter");
+    put(&w, "ibaum_dht_ok_total %lu\n", (unsigned long)health->ok);
+    putGauge(&w, "ibaum_dht_faults_total", "counter");
+    for (int k = 0; k < DHT_FAULTS; k++)
+        put(&w, "ibaum_dht_faults_total{type=\"%s\"} %lu\n", faultNames[k], (unsigned long)health->faults[k]);
+    putGauge(&w, "ibaum_dht_data_cut_total", "counter");
+    for (int k = 0; k < MAXdhtData; k++)
+        put(&w, "ibaum_dht_data_cut_total{byte=\"%d\"} %lu\n", k, (unsigned long)health->cutInByte[k]);
+    putGauge(&w, "ibaum_dht_retries_total", "counter");
+    put(&w, "ibaum_dht_retries_total %lu\n", (unsigned long)health->retries);
+    putGauge(&w, "ibaum_dht_degraded", "gauge");
+    put(&w, "ibaum_dht_degraded %d\n", snapshot.degraded);
+    putGauge(&w, "ibaum_dht_degraded_total", "counter");
+    put(&w, "ibaum_dht_degraded_total %lu\n", (unsigned long)health->degraded);
+
+    // recovery latency, cumulative like a Prometheus histogram but without a sum
+    putGauge(&w, "ibaum_dht_recoveries_total", "counter");
+    uint32_t cumulative = 0;
+    for (int k = 0; k < DHT_RECOVERY_BINS - 1; k++)
+    {
+        cumulative += health->recoveryHistogram[k];
+        put(&w, "ibaum_dht_recoveries_total{le=\"%d\"} %lu\n", 1 << k, (unsigned long)cumulative);
+    }
+    put(&w, "ibaum_dht_recoveries_total{le=\"+Inf\"} %lu\n", (unsigned long)health->recoveries);
+
+    for (int c = 0; c < HISTORY_CHANNELS; c++)
+    {
+        const char *name = c == HISTORY_HUMIDITY ? "ibaum_history_humidity_percent" : "ibaum_history_temperature_celsius";
+
+        putGauge(&w, name, "gauge");
+        for (size_t k = 0; k < WINDOWS; k++)
+        {
+            history_stats_t stats;
+
+            if (getStatusWindow(nowS, windows[k].seconds, c, &stats) == 0)
+                continue;
+            put(&w, "%s{window=\"%s\",stat=\"mean\"} ", name, windows[k].name);
+            putDeci(&w, stats.mean);
+            put(&w, "\n%s{window=\"%s\",stat=\"min\"} ", name, windows[k].name);
+            putDeci(&w, stats.min);
+            put(&w, "\n%s{window=\"%s\",stat=\"max\"} ", name, windows[k].name);
+            putDeci(&w, stats.max);
+            put(&w, "\n");
+        }
+    }
+
+    putGauge(&w, "ibaum_uptime_seconds", "gauge");
+    put(&w, "ibaum_uptime_seconds %lu\n", (unsigned long)nowS);
+    putBoot(&w, &snapshot.boot);
+    putBudget(&w);
+
+    putGauge(&w, "ibaum_http_requests_total", "counter");
+    for (int k = 0; k < PATHS; k++)
+        put(&w, "ibaum_http_requests_total{path=\"%s\"} %lu\n", pathNames[k], (unsigned long)requests[k]);
+    putGauge(&w, "ibaum_http_render_seconds", "gauge");
+    for (int k = 0; k < PATHS; k++)
+    {
+        put(&w, "ibaum_http_render_seconds{path=\"%s\",stat=\"last\"} %lu.%06lu\n", pathNames[k],
+            (unsigned long)(lastRenderUs[k] / 1000000), (unsigned long)(lastRenderUs[k] % 1000000));
+        put(&w, "ibaum_http_render_seconds{path=\"%s\",stat=\"max\"} %lu.%06lu\n", pathNames[k],
+            (unsigned long)(maxRenderUs[k] / 1000000), (unsigned long)(maxRenderUs[k] % 1000000));
+    }
+
+    sampler_stats_t sampler;
+    getSamplerStats(&sampler);
+
+    putGauge(&w, "ibaum_sampler_cycles_total", "counter");
+    put(&w, "ibaum_sampler_cycles_total %lu\n", (unsigned long)sampler.cycles);
+    putGauge(&w, "ibaum_sampler_missed_deadlines_total", "counter");
+    put(&w, "ibaum_sampler_missed_deadlines_total %lu\n", (unsigned long)sampler.missed);
+    putGauge(&w, "ibaum_sampler_jitter_microseconds", "gauge");
+    put(&w, "ibaum_sampler_jitter_microseconds{stat=\"last\"} %ld\n", (long)sampler.lastJitterUs);
+    put(&w, "ibaum_sampler_jitter_microseconds{stat=\"max\"} %lu\n", (unsigned long)sampler.maxJitterUs);
+
+    // wake-up jitter, cumulative like a Prometheus histogram but without a sum
+    putGauge(&w, "ibaum_sampler_wakeups_total", "counter");
+    cumulative = 0;
+    for (int k = 0; k < SAMPLER_JITTER_BINS - 1; k++)
+    {
+        cumulative += sampler.jitterHistogram[k];
+        put(&w, "ibaum_sampler_wakeups_total{le_us=\"%lu\"} %lu\n", (unsigned long)jitterBinUs[k], (unsigned long)cumulative);
+    }
+    put(&w, "ibaum_sampler_wakeups_total{le_us=\"+Inf\"} %lu\n", (unsigned long)sampler.cycles);
+
+    putGauge(&w, "ibaum_sampler_masked_microseconds", "gauge");
+    put(&w, "ibaum_sampler_masked_microseconds{stat=\"last\"} %lu\n", (unsigned long)sampler.lastMaskedUs);
+    put(&w, "ibaum_sampler_masked_microseconds{stat=\"max\"} %lu\n", (unsigned long)sampler.maxMaskedUs);
+    putGauge(&w, "ibaum_sampler_masked_microseconds_total", "counter");
+    put(&w, "ibaum_sampler_masked_microseconds_total %llu\n", (unsigned long long)sampler.totalMaskedUs);
+    putGauge(&w, "ibaum_bus_publish_cycles", "gauge");
+    put(&w, "ibaum_bus_publish_cycles{stat=\"last\"} %lu\n", (unsigned long)sampler.lastPublishCycles);
+    put(&w, "ibaum_bus_publish_cycles{stat=\"max\"} %lu\n", (unsigned long)sampler.maxPublishCycles);
+    putBuses(&w);
+
+    // all zero when no telemetry URL is configured
+    uploader_stats_t upload;
+    getUploaderStats(&upload);
+
+    putGauge(&w, "ibaum_telemetry_records_total", "counter");
+    put(&w, "ibaum_telemetry_records_total %lu\n", (unsigned long)upload.telemetry.records);
+    putGauge(&w, "ibaum_telemetry_batches_total", "counter");
+    put(&w, "ibaum_telemetry_batches_total{result=\"sealed\"} %lu\n", (unsigned long)upload.telemetry.batches);
+    put(&w, "ibaum_telemetry_batches_total{result=\"sent\"} %lu\n", (unsigned long)upload.telemetry.sent);
+    put(&w, "ibaum_telemetry_batches_total{result=\"spilled\"} %lu\n", (unsigned long)upload.telemetry.spilled);
+    put(&w, "ibaum_telemetry_batches_total{result=\"dropped\"} %lu\n", (unsigned long)upload.telemetry.dropped);
+    putGauge(&w, "ibaum_telemetry_send_failures_total", "counter");
+    put(&w, "ibaum_telemetry_send_failures_total %lu\n", (unsigned long)upload.telemetry.sendFailures);
+    putGauge(&w, "ibaum_telemetry_overruns_total", "counter");
+    put(&w, "ibaum_telemetry_overruns_total %lu\n", (unsigned long)upload.overruns);
+    putGauge(&w, "ibaum_telemetry_queued_batches", "gauge");
+    put(&w, "ibaum_telemetry_queued_batches %u\n", upload.telemetry.queued);
+    putGauge(&w, "ibaum_telemetry_spool_bytes", "gauge");
+    put(&w, "ibaum_telemetry_spool_bytes %ld\n", upload.telemetry.spoolBytes);
+
+    return finish(&w, PATH_METRICS, startUs);
+}
+
+/*----------------------------------------------------------------------------
+;
+;	GET /status.json
+;
+;----------------------------------------------------------------------------*/
+
+static void putStats(chunk_writer_t *w, const history_stats_t *stats)
+{
+    put(w, "{\"count\":%lu,\"mean\":", (unsigned long)stats->count);
+    putDeci(w, stats->mean);
+    put(w, ",\"min\":");
+    putDeci(w, stats->min);
+    put(w, ",\"max\":");
+    putDeci(w, stats->max);
+    put(w, "}");
+}
+
+static esp_err_t statusHandler(httpd_req_t *req)
+{
+    int64_t startUs = esp_timer_get_time();
+    chunk_writer_t w = {.req = req};
+    const dht_health_t *health = &snapshot.health;
+
+    getStatus(&snapshot);
+    uint32_t nowS = startUs / 1000000;
+
+    httpd_resp_set_type(req, "application/json");
+
+    put(&w, "{\"uptime_s\":%lu,\"sample_age_s\":%lu,\"humidity\":{\"raw\":", (unsigned long)nowS,
+        (unsigned long)sampleAgeS(&snapshot, startUs));
+    putDeci(&w, snapshot.humidity10);
+    put(&w, ",\"filtered\":");
+    putDeci(&w, snapshot.filteredHumidity10);
+    put(&w, "},\"temperature\":{\"raw\":");
+    putDeci(&w, snapshot.temperature10);
+    put(&w, ",\"filtered\":");
+    putDeci(&w, snapshot.filteredTemperature10);
+    put(&w, "},\"filter\":{\"delay_s\":%lu,\"max_delay_s\":%lu,\"expected_delay_samples\":%d,\"steps\":%lu,",
+        (unsigned long)snapshot.filterLatency.lastS, (unsigned long)snapshot.filterLatency.maxS, FILTER_DELAY_SAMPLES,
+        (unsigned long)snapshot.filterLatency.steps);
+    put(&w, "\"condition_us\":%lu", (unsigned long)snapshot.conditionUs);
+    put(&w, "},\"control\":{\"pump_on\":%s,\"pumps_running\":%d,\"pump_cycles\":%lu,\"zones\":[",
+        snapshot.pumpOn ? "true" : "false", snapshot.pumpsRunning, (unsigned long)snapshot.pumpCycles);
+    for (int k = 0; k < snapshot.zoneCount; k++)
+    {
+        const ibaum_zone_status_t *zone = &snapshot.zones[k];
+
+        put(&w, "%s{\"name\":\"%s\",\"state\":\"%s\",\"humidity\":", k ? "," : "", zone->name,
+            stateNames[zone->state < STATUS_STATES ? zone->state : 0]);
+        if (zone->hasReading)
+            putDeci(&w, zone->humidity10);
+        else
+            put(&w, "null");
+        put(&w, ",\"pump_cycles\":%lu,\"pump_seconds\":%lu,\"max_wait_s\":%lu,\"pulse_s\":%u,\"gain_pct_per_min\":",
+            (unsigned long)zone->pumpCycles, (unsigned long)zone->pumpSeconds, (unsigned long)zone->maxWaitS,
+            zone->pulseS);
+        putDeci(&w, zone->gainQ8 * 60 / 256);
+        put(&w, "}");
+    }
+    put(&w, "]}");
+
+    put(&w, ",\"dht\":{\"reads\":%lu,\"ok\":%lu,\"faults\":{", (unsigned long)health->reads, (unsigned long)health->ok);
+    for (int k = 0; k < DHT_FAULTS; k++)
+        put(&w, "%s\"%s\":%lu", k ? "," : "", faultNames[k], (unsigned long)health->faults[k]);
+    put(&w, "},\"retries\":%lu,\"degraded\":%s,\"degraded_total\":%lu,\"recoveries\":%lu,\"max_recovery_ms\":%lu}",
+        (unsigned long)health->retries, snapshot.degraded ? "true" : "false", (unsigned long)health->degraded,
+        (unsigned long)health->recoveries, (unsigned long)health->maxRecoveryMs);
+
+    put(&w, ",\"windows\":{");
+    for (size_t k = 0; k < WINDOWS; k++)
+    {
+        put(&w, "%s\"%s\":{", k ? "," : "", windows[k].name);
+        for (int c = 0; c < HISTORY_CHANNELS; c++)
+        {
+            history_stats_t stats;
+
+            getStatusWindow(nowS, windows[k].seconds, c, &stats);
+            put(&w, "%s\"%s\":", c ? "," : "", channelNames[c]);
+            putStats(&w, &stats);
+        }
+        put(&w, "}");
+    }
+
+    budget_report_t budget;
+
+    getBudgetReport(&budget);
+    put(&w, "},\"heap\":{\"free\":%lu,\"min_free\":%lu,\"largest_block\":%lu,\"fragmentation_pct\":%u,"
+        "\"max_fragmentation_pct\":%u},\"static_bytes\":%lu",
+        (unsigned long)budget.internal.freeBytes, (unsigned long)budget.internal.minFreeBytes,
+        (unsigned long)budget.internal.largestBlock, budget.internal.fragmentation, budget.internal.maxFragmentation,
+        (unsigned long)budget.staticBytes);
+
+    const boot_times_t *boot = &snapshot.boot;
+
+    put(&w, ",\"boot\":{\"reset\":\"%s\",\"restored\":\"%s\",\"before_app_ms\":%ld", getResetName(boot->resetReason),
+        bootSourceNames[boot->source], (long)boot->preAppMs);
+    for (int k = 0; k < BOOT_STAGES; k++)
+        put(&w, ",\"%s_ms\":%ld", bootStageNames[k], (long)boot->stageMs[k]);
+    put(&w, "}}\n");
+
+    return finish(&w, PATH_STATUS, startUs);
+}
+
+/*----------------------------------------------------------------------------
+;
+;	GET /history.json?tier=raw|minute|hour
+;
+;----------------------------------------------------------------------------*/
+
+static esp_err_t historyHandler(httpd_req_t *req)
+{
+    int64_t startUs = esp_timer_get_time();
+    chunk_writer_t w = {.req = req};
+    char value[8];
+    int tier = 1;
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "tier", value, sizeof(value)) == ESP_OK)
+    {
+        for (tier = 0; tier < HISTORY_TIERS && strcmp(value, tierNames[tier]) != 0; tier++)
+            ;
+        if (tier == HISTORY_TIERS)
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "tier must be raw, minute or hour");
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    put(&w, "{\"tier\":\"%s\",\"points\":[", tierNames[tier]);
+
+    int first = 1;
+    for (uint32_t age = 0; age < tierLengths[tier]; age++)
+    {
+        history_stats_t stats[HISTORY_CHANNELS];
+        uint32_t timeS = 0;
+        uint32_t count = 0;
+
+        // empty buckets (gaps and the unused part of the ring) are left out
+        for (int c = 0; c < HISTORY_CHANNELS; c++)
+            count = getStatusBucket(tier, age, c, &timeS, &stats[c]);
+        if (count == 0)
+            continue;
+
+        put(&w, "%s{\"t\":%lu", first ? "" : ",", (unsigned long)timeS);
+        for (int c = 0; c < HISTORY_CHANNELS; c++)
+        {
+            put(&w, ",\"%s\":", channelNames[c]);
+            putStats(&w, &stats[c]);
+        }
+        put(&w, "}");
+        first = 0;
+    }
+
+    put(&w, "]}\n");
+    return finish(&w, PATH_HISTORY, startUs);
+}
+
+// == server setup =================================================
+
+esp_err_t startHttpMetrics(uint16_t port)
+{
+    httpd_handle_t server = NULL;
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+
+    config.server_port = port;
+    config.task_priority = HTTP_METRICS_PRIORITY;
+    config.stack_size = BUDGET_HTTP_STACK;
+    config.max_open_sockets = 3;
+    config.lru_purge_enable = true; // scrapers that never close do not lock others out
+    config.core_id = PRO_CPU_NUM;   // the APP CPU belongs to the sampler
+
+    esp_err_t err = httpd_start(&server, &config);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Server start failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    const httpd_uri_t uris[] = {
+        {.uri = "/metrics", .method = HTTP_GET, .handler = metricsHandler},
+        {.uri = "/status.json", .method = HTTP_GET, .handler = statusHandler},
+        {.uri = "/history.json", .method = HTTP_GET, .handler = historyHandler},
+    };
+
+    for (size_t k = 0; k < sizeof(uris) / sizeof(uris[0]); k++)
+        httpd_register_uri_handler(server, &uris[k]);
+
+    return ESP_OK;
+}
@@ -0,0 +1,30 @@
+/*
+	HTTP endpoint for monitoring
+
+	GET /metrics        Prometheus text format
+	GET /status.json    current readings, pump, sensor health, window stats
+	GET /history.json   ?tier=raw|minute|hour, buckets newest first
+
+	Responses are rendered piecewise into one static buffer and sent as
+	HTTP chunks, nothing is allocated per request.
+*/
+
+#ifndef HTTP_METRICS_H_
+#define HTTP_METRICS_H_
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HTTP_METRICS_CHUNK_SIZE 512
+#define HTTP_METRICS_PRIORITY 2 // below the control task, scrapes never delay a sample
+
+esp_err_t startHttpMetrics(uint16_t port);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
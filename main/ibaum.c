@@ -1,103 +1,593 @@
 #include <stdio.h>
+#include <sys/time.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "esp_spiffs.h"
+#include "esp_private/esp_clk.h"
+#include "esp_console.h"
+#include "nvs_flash.h"
 #include "driver/gpio.h"
+#include "driver/ledc.h"
 #include "DHT.h"
+#include "DHT_trace.h"
+#include "boot_state.h"
+#include "budget.h"
+#include "hal.h"
+#include "controller.h"
+#include "duty.h"
+#include "history.h"
+#include "http_metrics.h"
+#include "net.h"
+#include "sampler.h"
+#include "sensor_log.h"
+#include "status.h"
+#include "uploader.h"
 
 #define DHT_GPIO_PIN 4
 #define RELAY_GPIO_PIN 25  // Replace with the actual GPIO pin connected to the relay
 #define LED_GPIO_PIN 26    // Replace with the actual GPIO pin connected to the LED
 #define HUMIDITY_THRESHOLD 70.0
 #define HYSTERESIS 5.0  // Adjust this value as needed
-#define PUMP_DURATION_SECONDS 5
+#define HUMIDITY_HIGH_DECI ((int)((HUMIDITY_THRESHOLD + HYSTERESIS) * 10))  // Switching points on the filtered deci-percent
+#define HUMIDITY_LOW_DECI ((int)((HUMIDITY_THRESHOLD - HYSTERESIS) * 10))
+#define PUMP_DURATION_SECONDS 5  // First runs, later ones are sized from the measured response
+#define PUMP_MAX_ON_SECONDS 30  // No single run is longer
+#define PUMP_MIN_OFF_SECONDS 300  // Shortest pause between two runs of a zone, spares the relay
+#define MAX_CONCURRENT_PUMPS 1  // Relays the pump supply can carry at once
+#define PUMP_STAGGER_SECONDS 5  // Between two pump starts, keeps inrush currents apart
+#define DHT_SENSOR 0  // Sensor channel of the DHT read by the sampler
 #define BLINK_INTERVAL_MS 200  // Blink interval for LED
+#define SAMPLE_INTERVAL_MS CONFIG_IBAUM_SAMPLE_INTERVAL_MS  // Regular read period, failed reads are retried in between (whole ticks)
+#define HUMIDITY_MEAN_WINDOW_S 600  // Window of the mean humidity shown with every sample
 
-void controlWaterPump(bool turnOn) {
-    gpio_set_level(RELAY_GPIO_PIN, turnOn ? 1 : 0);
+// Samples and pump events are logged to the "storage" SPIFFS partition, see partitions.csv
+#define LOG_BASE_PATH "/spiffs"
+#define LOG_PATH LOG_BASE_PATH "/samples.log"
+#define LOG_MAX_BYTES (300 * 1024)  // Two logs and the spool take ~650 KB of the ~895 KB SPIFFS keeps for data, 25% stay free for GC
+#define TELEMETRY_SPOOL_PATH LOG_BASE_PATH "/telemetry.q"
+#define TELEMETRY_SPOOL_BYTES (32 * 1024)  // 128 full batches, about 14 hours of 2 s samples
+
+// The LED is driven by LEDC so it keeps blinking without any CPU work
+#define LED_SPEED_MODE LEDC_LOW_SPEED_MODE
+#define LED_TIMER LEDC_TIMER_0
+#define LED_CHANNEL LEDC_CHANNEL_0
+#define LED_DUTY_RESOLUTION LEDC_TIMER_10_BIT
+#define LED_DUTY_FULL (1 << 10)
+#define LED_BLINK_HZ (1000 / (2 * BLINK_INTERVAL_MS))  // One on/off cycle every two intervals
+
+// Relay outputs, indexed by zone_config_t.relay
+static const uint8_t relayGpios[] = {RELAY_GPIO_PIN};
+
+// Irrigation zones, add a line per bed. Sensor channels index the readings passed to controllerSample().
+static const zone_config_t zoneConfigs[] = {
+    {
+        .name = "main",
+        .sensors = {DHT_SENSOR},
+        .sensorCount = 1,
+        .relay = 0,
+        .highDeci = HUMIDITY_HIGH_DECI,
+        .lowDeci = HUMIDITY_LOW_DECI,
+        .pumpDurationS = PUMP_DURATION_SECONDS,
+        .adaptive = true,
+        .maxOnS = PUMP_MAX_ON_SECONDS,
+        .minOffS = PUMP_MIN_OFF_SECONDS,
+    },
+};
+
+#define ZONE_COUNT (sizeof(zoneConfigs) / sizeof(zoneConfigs[0]))
+#define RELAY_COUNT (sizeof(relayGpios) / sizeof(relayGpios[0]))
+
+// Tasks, queues and buses are allocated from the table in budget.h
+static sample_bus_t *sampleBus;  // Readings, published by the sampler
+static sample_bus_t *eventBus;  // Pump events, published by dht_task
+static bus_subscriber_t *controlSamples;
+static bus_subscriber_t *logSamples;
+static bus_subscriber_t *logEvents;
+static uint32_t zonesDueS = ZONES_NOT_DUE;  // Next pump stop or start without a new sample
+#if CONFIG_IBAUM_DEEP_SLEEP
+// Both outlive deep sleep in RTC slow memory, duty.magic tells whether they made it through a reset
+RTC_NOINIT_ATTR static controller_t controller;  // Filters and zones, see controller.h
+RTC_NOINIT_ATTR static duty_t duty;  // Records waiting for the flush and the cost of the cycles, see duty.h
+#else
+static controller_t controller;  // Filters and zones, see controller.h
+#endif
+static bool retained;  // Woken from deep sleep, the controller carries on where it went to sleep
+static uint32_t clockOffsetS;  // System time minus esp_timer time in deep sleep mode, 0 otherwise
+static sensor_log_t sensorLog;  // Owned by the logger task once it runs
+static ibaum_status_t status;  // Owned by dht_task, published for the HTTP endpoint
+
+// Controller time. esp_timer starts over with every wake from deep sleep, the system time runs on.
+static uint32_t toSeconds(int64_t timerUs) {
+    return timerUs / 1000000 + clockOffsetS;
+}
+
+static uint32_t nowSeconds() {
+    return toSeconds(esp_timer_get_time());
+}
+
+void controlRelay(int relay, bool turnOn) {
+    halPinWrite(relayGpios[relay], turnOn ? 1 : 0);
+}
+
+static void setLedDuty(uint32_t duty) {
+    ledc_set_duty(LED_SPEED_MODE, LED_CHANNEL, duty);
+    ledc_update_duty(LED_SPEED_MODE, LED_CHANNEL);
 }
 
 void controlLed(bool turnOn) {
-    gpio_set_level(LED_GPIO_PIN, turnOn ? 1 : 0);
+    setLedDuty(turnOn ? LED_DUTY_FULL : 0);
+}
+
+void blinkLedStart() {
+    setLedDuty(LED_DUTY_FULL / 2);
 }
 
 void blinkLed(int blinkCount) {
-    for (int i = 0; i < blinkCount; i++) {
-        controlLed(i % 2 == 0);  // Toggle the LED state
-        vTaskDelay(BLINK_INTERVAL_MS / portTICK_PERIOD_MS);
+    blinkLedStart();
+    halDelayMs(blinkCount * BLINK_INTERVAL_MS);
+}
+
+static void publishZones() {
+    status.pumpOn = controller.zones.running > 0;
+    status.pumpsRunning = controller.zones.running;
+    status.pumpCycles = 0;
+    status.zoneCount = controller.zones.zoneCount;
+
+    for (int k = 0; k < controller.zones.zoneCount; k++) {
+        const zone_t *zone = &controller.zones.zones[k];
+
+        status.zones[k] = (ibaum_zone_status_t){
+            .name = zone->config->name,
+            .state = zone->state,
+            .hasReading = zone->hasReading,
+            .humidity10 = zone->humidity,
+            .pumpCycles = zone->pumpCycles,
+            .pumpSeconds = zone->pumpSeconds,
+            .maxWaitS = zone->maxWaitS,
+            .pulseS = zone->pulseS,
+            .gainQ8 = zone->gainQ8,
+        };
+        status.pumpCycles += zone->pumpCycles;
+    }
+}
+
+// Switches the relays and tells the logger and the uploader
+static void applyActions(const zone_action_t *actions, int n) {
+    for (int k = 0; k < n; k++) {
+        bus_record_t event = {
+            .timeUs = esp_timer_get_time(),
+            .type = BUS_PUMP,
+            .source = actions[k].zone,
+            .on = actions[k].on,
+        };
+
+        controlRelay(actions[k].relay, actions[k].on);
+        busPublish(eventBus, &event);
+#if CONFIG_IBAUM_DEEP_SLEEP
+        dutyAdd(&duty, nowSeconds(), actions[k].on ? LOG_PUMP_ON : LOG_PUMP_OFF, actions[k].zone, 0, 0);
+#endif
+        printf("Zone %s: pump %s\n", zoneConfigs[actions[k].zone].name, actions[k].on ? "on" : "off");
+    }
+
+    // The LED blinks while any pump runs
+    if (n > 0) {
+        if (controller.zones.running > 0) {
+            blinkLedStart();
+        } else {
+            controlLed(true);
+        }
+        busNotify(eventBus);
+    }
+}
+
+// Moves all zones to now, switches the relays and notes when the next pump stop or start is due.
+// Samples are timestamped before they are published, so the step uses the clock, which never goes back.
+static void stepZones() {
+    uint32_t nowS = nowSeconds();
+    zone_action_t actions[ZONES_MAX];
+    int n = controllerStep(&controller, nowS, actions);
+
+    applyActions(actions, n);
+#if CONFIG_IBAUM_FAST_BOOT
+    saveBootState(&controller, nowS);
+#endif
+
+    zonesDueS = controllerNextDue(&controller, nowS);
+    publishZones();
+}
+
+static void onSample(const bus_record_t *sample) {
+    bool wasDegraded = status.degraded;
+
+    // The sampler updates the health before it publishes, so this includes the sample
+    getSamplerHealth(&status.health, &status.degraded);
+    if (status.degraded != wasDegraded) {
+        printf(wasDegraded ? "Sensor recovered\n" : "Sensor degraded, check the wiring\n");
+    }
+
+    if (sample->status != DHT_OK) {
+        errorHandler(sample->status);
+        return;
+    }
+
+    markBoot(BOOT_STAGE_SAMPLE);
+
+    uint32_t nowS = toSeconds(sample->timeUs);
+    int16_t values[HISTORY_CHANNELS] = {
+        [HISTORY_HUMIDITY] = sample->humidity10,
+        [HISTORY_TEMPERATURE] = sample->temperature10,
+    };
+    int16_t filtered[FILTER_CHANNELS];
+    history_stats_t mean;
+
+    // History, log and upload keep the raw readings, the controller only sees filtered values
+    addStatusHistory(nowS, values);
+    controllerSample(&controller, DHT_SENSOR, nowS, values, filtered);
+#if CONFIG_IBAUM_DEEP_SLEEP
+    // The logger does not run between wakes, samples wait in RTC memory for the next flush
+    dutyAdd(&duty, nowS, LOG_SAMPLE, 0, values[HISTORY_HUMIDITY], values[HISTORY_TEMPERATURE]);
+#endif
+
+    status.sampleUs = sample->timeUs;
+    status.humidity10 = values[HISTORY_HUMIDITY];
+    status.temperature10 = values[HISTORY_TEMPERATURE];
+    status.filteredHumidity10 = filtered[FILTER_HUMIDITY];
+    status.filteredTemperature10 = filtered[FILTER_TEMPERATURE];
+    const filter_latency_t *latency = &controller.filters[DHT_SENSOR].latency[FILTER_HUMIDITY];
+    if (latency->steps != status.filterLatency.steps) {
+        printf("Humidity filter delay measured %lu s (max %lu s)\n", (unsigned long)latency->lastS,
+               (unsigned long)latency->maxS);
+    }
+    status.filterLatency = *latency;
+    status.conditionUs = esp_timer_get_time() - sample->timeUs;
+
+    // Integer formatting, printf with floats costs the control task a lot more stack
+    int raw = values[HISTORY_HUMIDITY];
+    int humidity = filtered[FILTER_HUMIDITY];
+    getStatusWindow(nowS, HUMIDITY_MEAN_WINDOW_S, HISTORY_HUMIDITY, &mean);
+    printf("Humidity: %d.%d%% raw, %d.%d%% filtered (%d min mean %d.%d%%)\n", raw / 10, raw % 10, humidity / 10,
+           humidity % 10, HUMIDITY_MEAN_WINDOW_S / 60, mean.mean / 10, mean.mean % 10);
+
+    stepZones();
+
+    if (status.boot.stageMs[BOOT_STAGE_DECISION] < 0) {
+        markBoot(BOOT_STAGE_DECISION);
+        getBootTimes(&status.boot);
+        if (!retained) {
+            printBootTimes();
+        }
+#if CONFIG_IBAUM_FAST_BOOT
+        // Startup is over, the LED only blinks for running pumps from now on
+        if (controller.zones.running == 0) {
+            controlLed(true);
+        }
+#endif
+    }
+}
+
+static bool openSensorLog() {
+    esp_vfs_spiffs_conf_t spiffs_conf = {
+        .base_path = LOG_BASE_PATH,
+        .partition_label = "storage",
+        .max_files = 3,  // The log, its rotation and the telemetry spool
+        .format_if_mount_failed = true,
+    };
+
+    // Without a log the controller still runs, the log calls just fail
+    if (esp_vfs_spiffs_register(&spiffs_conf) != ESP_OK || logOpen(&sensorLog, LOG_PATH, LOG_MAX_BYTES) != 0) {
+        printf("Sensor log unavailable\n");
+        return false;
+    }
+    return true;
+}
+
+#if CONFIG_IBAUM_DEEP_SLEEP
+static int64_t systemUs() {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+// Picks up where the last wake went to sleep, or starts the cycles after any other reset
+static void startDutyCycle() {
+    int64_t appStartRtcUs = esp_clk_rtc_time() - esp_timer_get_time();
+
+    clockOffsetS = systemUs() / 1000000 - esp_timer_get_time() / 1000000;
+    retained = esp_reset_reason() == ESP_RST_DEEPSLEEP && dutyIsValid(&duty);
+
+    // Records buffered before a crash are still flushed, only a power-on loses them
+    if (!dutyIsValid(&duty)) {
+        dutyInit(&duty);
     }
+
+    // The sleep timer fired sleepUs after the sleep started, ROM and bootloader ran from there to the app
+    dutyWake(&duty, retained ? appStartRtcUs - duty.sleepStartRtcUs - duty.sleepUs : -1);
 }
 
+// Writes the buffered records to the sensor log, SPIFFS is only mounted for it
+static void flushDuty() {
+    int64_t startUs = esp_timer_get_time();
+
+    if (openSensorLog()) {
+        for (int k = 0; k < duty.count; k++) {
+            const duty_record_t *r = &duty.records[k];
+
+            if (r->type == LOG_SAMPLE) {
+                logSample(&sensorLog, r->timeS, r->humidity10, r->temperature10);
+            } else {
+                logPump(&sensorLog, r->timeS, r->type == LOG_PUMP_ON);
+            }
+        }
+        logClose(&sensorLog);
+    } else {
+        duty.dropped += duty.count;
+    }
+    dutyFlushed(&duty, esp_timer_get_time() - startUs);
+}
+
+// Awake times include the wake overhead, the current is an estimate from the configured draws
+static void printDuty() {
+    printf("Duty: %lu wakes (%lu retries), awake %lu ms (max %lu, mean %lu), wake %lu ms, flush %lu ms, %lu dropped, "
+           "~%lu uA average\n",
+           (unsigned long)duty.wakes, (unsigned long)duty.retryWakes, (unsigned long)duty.lastAwakeUs / 1000,
+           (unsigned long)duty.maxAwakeUs / 1000, (unsigned long)(duty.awakeUs / 1000 / duty.wakes), (unsigned long)duty.lastWakeUs / 1000,
+           (unsigned long)duty.lastFlushUs / 1000, (unsigned long)duty.dropped,
+           (unsigned long)dutyAverageUa(&duty, CONFIG_IBAUM_ACTIVE_CURRENT_MA * 1000, CONFIG_IBAUM_SLEEP_CURRENT_UA));
+}
+
+// Sleeps until the next point on the sample grid, or a retry after a failed read; the app starts over from there
+static void enterSleep(bool readFailed) {
+    bool flush = dutyFlushDue(&duty, CONFIG_IBAUM_SLEEP_FLUSH_WAKES);
+
+    if (flush) {
+        flushDuty();
+    }
+
+    // The relays are off, their pads keep that level through sleep instead of floating
+    controlLed(false);
+    for (size_t k = 0; k < RELAY_COUNT; k++) {
+        gpio_hold_en(relayGpios[k]);
+    }
+    gpio_deep_sleep_hold_en();
+
+    // The report goes out with the cycle it closes, the UART is drained before the sleep starts
+    uint32_t retryUs = readFailed ? getDHTMinIntervalMs() * 1000 : 0;
+    uint32_t sleepUs = dutySleep(&duty, systemUs(), esp_timer_get_time(), SAMPLE_INTERVAL_MS * 1000, retryUs);
+    if (flush) {
+        printDuty();
+    }
+    fflush(stdout);
+    ESP_ERROR_CHECK(esp_sleep_enable_timer_wakeup(sleepUs));
+    duty.sleepStartRtcUs = esp_clk_rtc_time();
+    esp_deep_sleep_start();
+}
+#endif
 
 void dht_task(void *pvParameter) {
-    bool pumpActive = false;
+    // A wake from deep sleep is no startup, it just takes its reading
+    if (!retained) {
+#if !CONFIG_IBAUM_FAST_BOOT
+        // Blink the LED rapidly to indicate startup
+        blinkLed(10);  // You can adjust the blink count for a more noticeable startup blink
+
+        // Turn on the LED initially
+        controlLed(true);
+#endif
 
-    // Blink the LED rapidly to indicate startup
-    blinkLed(10);  // You can adjust the blink count for a more noticeable startup blink
+        printf("Humidity filter delay %d samples (%d s) expected\n", FILTER_DELAY_SAMPLES,
+               FILTER_DELAY_SAMPLES * SAMPLE_INTERVAL_MS / 1000);
 
-    // Turn on the LED initially
-    controlLed(true);
+        // Everything is running by now, the first report shows the stacks after startup
+        sampleBudget();
+        printBudgetReport();
+    }
+    uint32_t reportS = nowSeconds();
 
+    // The sampler on the other core reads on its own schedule whatever the controller is doing.
+    // Waiting for the next sample ends early when a pump has to stop or a queued zone may start.
     while (1) {
-        int ret = readDHT();
+        uint32_t nowS = nowSeconds();
+        TickType_t wait = portMAX_DELAY;
+        bus_record_t sample;
+        bool sampled = false;
 
-        if (ret == DHT_OK) {
-            float humidity = getHumidity();
-            printf("Humidity: %.2f%%\n", humidity);
+        if (zonesDueS != ZONES_NOT_DUE) {
+            wait = zonesDueS > nowS ? pdMS_TO_TICKS((zonesDueS - nowS) * 1000) : 1;
+        }
 
-            if (humidity > HUMIDITY_THRESHOLD + HYSTERESIS && !pumpActive) {
-                // Turn on the water pump
-                controlWaterPump(true);
+        ulTaskNotifyTake(pdTRUE, wait);
+        while (busRead(sampleBus, controlSamples, &sample)) {
+            onSample(&sample);
+            sampled = true;
+        }
 
-                // Set the flag to indicate the pump is active
-                pumpActive = true;
+        if (sampled) {
+            sampleBudget();
+        } else {
+            stepZones();
+        }
 
-                // Print a message indicating water pumping
-                printf("Pumping water\n");
+        publishStatus(&status);
 
-                // Turn off the LED when the pump is active
-                double blinkcount = PUMP_DURATION_SECONDS * 1000 / BLINK_INTERVAL_MS;
-                blinkLed(blinkcount);
+#if CONFIG_IBAUM_DEEP_SLEEP
+        // Back to sleep once the reading is decided, unless a pump runs or is due before the next wake.
+        // The last record read is the reading of this wake.
+        if (sampled && controller.zones.running == 0 && zonesDueS >= nowSeconds() + SAMPLE_INTERVAL_MS / 1000) {
+            enterSleep(sample.status != DHT_OK);
+        }
+#endif
 
-                // Wait for the specified duration
-                vTaskDelay(blinkcount);
+        if (nowSeconds() - reportS >= BUDGET_REPORT_INTERVAL_S) {
+            printBudgetReport();
+            reportS = nowSeconds();
+        }
+    }
+}
 
-                // Turn off the water pump after the specified duration
-                controlWaterPump(false);
+// Appends samples and pump events to the sensor log, a slow flash write never holds up control
+void log_task(void *pvParameter) {
+    bus_record_t record;
 
-                // Print a message indicating pump is off
-                printf("Pump off\n");
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 
-                // Turn on the LED after the pump is turned off
-                controlLed(true);
-            } else if (humidity <= HUMIDITY_THRESHOLD - HYSTERESIS) {
-                // Reset the flag when humidity falls below the lower threshold
-                pumpActive = false;
+        while (busRead(sampleBus, logSamples, &record)) {
+            if (record.status == DHT_OK) {
+                logSample(&sensorLog, record.timeUs / 1000000, record.humidity10, record.temperature10);
             }
-        } else {
-            errorHandler(ret);
         }
+        while (busRead(eventBus, logEvents, &record)) {
+            logPump(&sensorLog, record.timeUs / 1000000, record.on);
+        }
+    }
+}
+
+#if CONFIG_DHT_TRACE && !CONFIG_IBAUM_DEEP_SLEEP
+// Serial console with the "dht_trace" command
+static void startConsole() {
+    esp_console_repl_t *repl = NULL;
+    esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    esp_console_dev_uart_config_t uart_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+
+    repl_config.prompt = "ibaum>";
+    ESP_ERROR_CHECK(esp_console_new_repl_uart(&uart_config, &repl_config, &repl));
+    ESP_ERROR_CHECK(esp_console_register_help_command());
+    ESP_ERROR_CHECK(registerDHTTraceCommands());
+    ESP_ERROR_CHECK(esp_console_start_repl(repl));
+}
+#endif
+
+// The saved controller state and the WiFi driver both live in NVS
+static void initNvs() {
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        err = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(err);
+}
+
+#if !CONFIG_IBAUM_DEEP_SLEEP
+// WiFi, the HTTP metrics endpoint and the telemetry upload, only when a network is configured
+static void startNetwork() {
+    if (CONFIG_IBAUM_WIFI_SSID[0] == '\0') {
+        return;
+    }
+
+    if (startWifi(CONFIG_IBAUM_WIFI_SSID, CONFIG_IBAUM_WIFI_PASSWORD) != ESP_OK ||
+        startHttpMetrics(CONFIG_IBAUM_HTTP_PORT) != ESP_OK) {
+        printf("Network unavailable\n");
+        return;
+    }
+
+    if (CONFIG_IBAUM_TELEMETRY_URL[0] == '\0') {
+        return;
+    }
 
-        // Wait for the next iteration
-        vTaskDelay(2000 / portTICK_PERIOD_MS);
+    // The receiver tells boots apart by this number and the uptime, so it comes from NVS: the sensor log's
+    // stays 0 without SPIFFS. Never below the log's, so it stays above batches spooled by older firmware.
+    uint16_t boot = countBoot(sensorLog.boot);
+    if (boot == 0) {
+        printf("No boot number, telemetry upload off\n");
+    } else if (startUploader(CONFIG_IBAUM_TELEMETRY_URL, TELEMETRY_SPOOL_PATH, TELEMETRY_SPOOL_BYTES, boot) != ESP_OK) {
+        printf("Telemetry upload unavailable\n");
     }
 }
+#endif
 
+// Everything the first decision needs comes first, the log and the network start while the sampler already reads
 void app_main() {
-    setDHTgpio(DHT_GPIO_PIN);
+    markBoot(BOOT_STAGE_APP);
+#if CONFIG_IBAUM_DEEP_SLEEP
+    startDutyCycle();
+#endif
+    initStatus();
 
-    // Setup the LED pin as an output
-    gpio_config_t led_io_conf = {
-        .pin_bit_mask = (1ULL << LED_GPIO_PIN),
-        .mode = GPIO_MODE_OUTPUT,
+    // Every consumer subscribes before the producers start, so none misses the first sample
+    sampleBus = getBudgetBus(BUDGET_BUS_SAMPLES);
+    eventBus = getBudgetBus(BUDGET_BUS_EVENTS);
+    controlSamples = subscribeBudgetBus(BUDGET_BUS_SAMPLES, BUDGET_TASK_CONTROL);
+    logSamples = subscribeBudgetBus(BUDGET_BUS_SAMPLES, BUDGET_TASK_LOGGER);
+    logEvents = subscribeBudgetBus(BUDGET_BUS_EVENTS, BUDGET_TASK_LOGGER);
+
+    // A bad zone table is a build mistake, stop right here
+    if (!retained) {
+        int controllerOk =
+            controllerInit(&controller, zoneConfigs, ZONE_COUNT, MAX_CONCURRENT_PUMPS, PUMP_STAGGER_SECONDS) == 0;
+        ESP_ERROR_CHECK(controllerOk ? ESP_OK : ESP_ERR_INVALID_ARG);
+    }
+
+    // Setup the LED on LEDC, REF_TICK allows the low blink frequency
+    ledc_timer_config_t led_timer_conf = {
+        .speed_mode = LED_SPEED_MODE,
+        .duty_resolution = LED_DUTY_RESOLUTION,
+        .timer_num = LED_TIMER,
+        .freq_hz = LED_BLINK_HZ,
+        .clk_cfg = LEDC_USE_REF_TICK,
     };
-    gpio_config(&led_io_conf);
+    ESP_ERROR_CHECK(ledc_timer_config(&led_timer_conf));
 
-    // Setup the relay and LED pins as outputs
+    ledc_channel_config_t led_channel_conf = {
+        .gpio_num = LED_GPIO_PIN,
+        .speed_mode = LED_SPEED_MODE,
+        .channel = LED_CHANNEL,
+        .timer_sel = LED_TIMER,
+        .duty = 0,
+        .hpoint = 0,
+    };
+    ESP_ERROR_CHECK(ledc_channel_config(&led_channel_conf));
+
+    // Setup the relay pins as outputs
     gpio_config_t relay_io_conf = {
-        .pin_bit_mask = (1ULL << RELAY_GPIO_PIN),
         .mode = GPIO_MODE_OUTPUT,
     };
+    for (size_t k = 0; k < RELAY_COUNT; k++) {
+        relay_io_conf.pin_bit_mask |= 1ULL << relayGpios[k];
+    }
     gpio_config(&relay_io_conf);
+#if CONFIG_IBAUM_DEEP_SLEEP
+    // Driven low by now, the level held through sleep can go
+    for (size_t k = 0; k < RELAY_COUNT; k++) {
+        gpio_hold_dis(relayGpios[k]);
+    }
+#endif
+
+    initNvs();
+
+#if CONFIG_IBAUM_FAST_BOOT
+    if (!retained) {
+        // The LED blinks on its own while the first read runs, instead of holding it up
+        blinkLedStart();
+
+        // Latches, gains and counters come back, a pump run cut short by the reset goes on
+        zone_action_t actions[ZONES_MAX];
+        applyActions(actions, restoreBootState(&controller, nowSeconds(), actions));
+    }
+#endif
+    zonesDueS = controllerNextDue(&controller, nowSeconds());
+    markBoot(BOOT_STAGE_RESTORED);
+    getBootTimes(&status.boot);
+    publishZones();
+    publishStatus(&status);
+
+    // Control and networking stay on the PRO CPU, the APP CPU is left to the sampler
+    startBudgetTask(BUDGET_TASK_CONTROL, &dht_task, NULL);
+    ESP_ERROR_CHECK(startSampler(DHT_GPIO_PIN, getDHTMinIntervalMs(), SAMPLE_INTERVAL_MS, sampleBus));
+    markBoot(BOOT_STAGE_SAMPLING);
+
+#if !CONFIG_IBAUM_DEEP_SLEEP
+    // Mounting SPIFFS can take long, the logger catches up from the bus
+    openSensorLog();
+    startBudgetTask(BUDGET_TASK_LOGGER, &log_task, NULL);
+
+#if CONFIG_DHT_TRACE
+    startConsole();
+#endif
 
-    xTaskCreate(&dht_task, "dht_task", 2048, NULL, 5, NULL);
+    startNetwork();
+#endif
 }
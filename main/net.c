@@ -0,0 +1,65 @@
+/*------------------------------------------------------------------------------
+
+	WiFi station
+
+	Connects in the background and reconnects after every disconnect, the
+	callers only look at isWifiConnected(). Expects NVS to be initialized.
+
+---------------------------------------------------------------------------------*/
+
+#include <string.h>
+
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_wifi.h"
+
+#include "net.h"
+
+static const char *TAG = "NET";
+
+static volatile bool connected = false;
+
+static void onWifiEvent(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    if (base == WIFI_EVENT && (id == WIFI_EVENT_STA_START || id == WIFI_EVENT_STA_DISCONNECTED))
+    {
+        connected = false;
+        esp_wifi_connect();
+    }
+    else if (base == IP_EVENT && id == IP_EVENT_STA_GOT_IP)
+    {
+        const ip_event_got_ip_t *event = (const ip_event_got_ip_t *)data;
+        ESP_LOGI(TAG, "Connected, IP " IPSTR, IP2STR(&event->ip_info.ip));
+        connected = true;
+    }
+}
+
+esp_err_t startWifi(const char *ssid, const char *password)
+{
+    wifi_init_config_t init = WIFI_INIT_CONFIG_DEFAULT();
+    wifi_config_t config = {0};
+
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    esp_netif_create_default_wifi_sta();
+
+    esp_err_t err = esp_wifi_init(&init);
+    if (err != ESP_OK)
+        return err;
+
+    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, onWifiEvent, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, onWifiEvent, NULL));
+
+    strncpy((char *)config.sta.ssid, ssid, sizeof(config.sta.ssid));
+    strncpy((char *)config.sta.password, password, sizeof(config.sta.password));
+
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &config));
+    return esp_wifi_start();
+}
+
+bool isWifiConnected(void)
+{
+    return connected;
+}
@@ -0,0 +1,23 @@
+/*
+	WiFi station with automatic reconnect
+*/
+
+#ifndef NET_H_
+#define NET_H_
+
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t startWifi(const char *ssid, const char *password);
+bool isWifiConnected(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,158 @@
+/*------------------------------------------------------------------------------
+
+	Lock-free publish/subscribe bus of samples and events
+
+	The producer owns the head and the slots, each subscriber owns its
+	cursor; the other side only ever loads them. The ordering is that of a
+	sequence lock per slot:
+
+	  publish   stamp = odd, fence, words, stamp = even (release), head (release)
+	  read      head (acquire), stamp (acquire), words, fence, stamp again
+
+	The words are relaxed atomics, a racing copy is a defined value that
+	the second stamp rejects. On the ESP32 all of it compiles to plain
+	32 bit loads and stores with memw barriers, no compare-and-swap.
+
+---------------------------------------------------------------------------------*/
+
+#include <string.h>
+
+#include "sample_bus.h"
+
+_Static_assert((BUS_LENGTH & (BUS_LENGTH - 1)) == 0, "BUS_LENGTH must be a power of two");
+_Static_assert(sizeof(bus_record_t) % sizeof(uint32_t) == 0, "bus_record_t must be whole words");
+
+#define STAMP(seq) ((uint32_t)(seq) * 2 + 2)
+
+void busInit(sample_bus_t *bus, const char *name)
+{
+    memset(bus, 0, sizeof(*bus));
+    bus->name = name;
+}
+
+bus_subscriber_t *busSubscribe(sample_bus_t *bus, const char *name, void (*wake)(void *arg), void *arg)
+{
+    int count = atomic_load_explicit(&bus->subscriberCount, memory_order_relaxed);
+
+    if (count >= BUS_SUBSCRIBERS)
+        return NULL;
+
+    bus_subscriber_t *sub = &bus->subscribers[count];
+
+    sub->name = name;
+    sub->wake = wake;
+    sub->arg = arg;
+    // records published before the subscription are not its business
+    atomic_store_explicit(&sub->cursor, atomic_load_explicit(&bus->head, memory_order_acquire), memory_order_relaxed);
+    atomic_store_explicit(&sub->overruns, 0, memory_order_relaxed);
+    atomic_store_explicit(&sub->received, 0, memory_order_relaxed);
+
+    // the slot is complete before busNotify() can see it
+    atomic_store_explicit(&bus->subscriberCount, count + 1, memory_order_release);
+    return sub;
+}
+
+// == producer =====================================================
+
+void busPublish(sample_bus_t *bus, const bus_record_t *record)
+{
+    uint32_t seq = atomic_load_explicit(&bus->head, memory_order_relaxed);
+    bus_slot_t *slot = &bus->slots[seq & (BUS_LENGTH - 1)];
+    uint32_t words[BUS_WORDS];
+
+    memcpy(words, record, sizeof(words));
+
+    atomic_store_explicit(&slot->stamp, STAMP(seq) - 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    for (unsigned k = 0; k < BUS_WORDS; k++)
+        atomic_store_explicit(&slot->words[k], words[k], memory_order_relaxed);
+    atomic_store_explicit(&slot->stamp, STAMP(seq), memory_order_release);
+
+    atomic_store_explicit(&bus->head, seq + 1, memory_order_release);
+}
+
+void busNotify(sample_bus_t *bus)
+{
+    int count = atomic_load_explicit(&bus->subscriberCount, memory_order_acquire);
+
+    for (int k = 0; k < count; k++)
+        if (bus->subscribers[k].wake != NULL)
+            bus->subscribers[k].wake(bus->subscribers[k].arg);
+}
+
+// == subscriber ===================================================
+
+static void lose(bus_subscriber_t *sub, uint32_t count)
+{
+    atomic_store_explicit(&sub->overruns, atomic_load_explicit(&sub->overruns, memory_order_relaxed) + count,
+                          memory_order_relaxed);
+}
+
+// next record for this subscriber, false when it has read everything
+bool busRead(sample_bus_t *bus, bus_subscriber_t *sub, bus_record_t *record)
+{
+    uint32_t cursor = atomic_load_explicit(&sub->cursor, memory_order_relaxed);
+    uint32_t words[BUS_WORDS];
+
+    while (1)
+    {
+        uint32_t head = atomic_load_explicit(&bus->head, memory_order_acquire);
+
+        if (cursor == head)
+            return false;
+
+        // lapped, the oldest records in the ring are the first ones left
+        if (head - cursor > BUS_LENGTH)
+        {
+            lose(sub, head - cursor - BUS_LENGTH);
+            cursor = head - BUS_LENGTH;
+        }
+
+        bus_slot_t *slot = &bus->slots[cursor & (BUS_LENGTH - 1)];
+        uint32_t stamp = atomic_load_explicit(&slot->stamp, memory_order_acquire);
+
+        for (unsigned k = 0; k < BUS_WORDS; k++)
+            words[k] = atomic_load_explicit(&slot->words[k], memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+
+        if (stamp == STAMP(cursor) && atomic_load_explicit(&slot->stamp, memory_order_relaxed) == stamp)
+            break;
+
+        // overwritten since the head was loaded, or while copying
+        lose(sub, 1);
+        cursor++;
+    }
+
+    memcpy(record, words, sizeof(words));
+    atomic_store_explicit(&sub->cursor, cursor + 1, memory_order_relaxed);
+    atomic_store_explicit(&sub->received, atomic_load_explicit(&sub->received, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    return true;
+}
+
+// == statistics, from any task ====================================
+
+uint32_t busPublished(const sample_bus_t *bus)
+{
+    return atomic_load_explicit(&bus->head, memory_order_relaxed);
+}
+
+int busGetStats(const sample_bus_t *bus, bus_subscriber_stats_t *stats)
+{
+    int count = atomic_load_explicit(&bus->subscriberCount, memory_order_acquire);
+    uint32_t head = atomic_load_explicit(&bus->head, memory_order_relaxed);
+
+    for (int k = 0; k < count; k++)
+    {
+        const bus_subscriber_t *sub = &bus->subscribers[k];
+        uint32_t lag = head - atomic_load_explicit(&sub->cursor, memory_order_relaxed);
+
+        stats[k] = (bus_subscriber_stats_t){
+            .name = sub->name,
+            .received = atomic_load_explicit(&sub->received, memory_order_relaxed),
+            .overruns = atomic_load_explicit(&sub->overruns, memory_order_relaxed),
+            .lag = lag > BUS_LENGTH ? BUS_LENGTH : lag, // the cursor may not have caught up with a lap yet
+        };
+    }
+    return count;
+}
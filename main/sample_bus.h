@@ -0,0 +1,97 @@
+/*
+	Lock-free publish/subscribe bus of samples and events
+
+	One producer appends fixed-size records to a ring, any number of
+	subscribers (up to BUS_SUBSCRIBERS) read them through cursors of their
+	own. Nobody takes a lock and the producer never waits: a subscriber
+	that falls more than BUS_LENGTH records behind loses the oldest ones,
+	and counts them as overruns, instead of holding up the producer.
+
+	Every slot carries a stamp, odd while the producer writes it and
+	2 * sequence + 2 once the record is complete. A reader checks the
+	stamp before and after copying the record out, so a slot overwritten
+	under it is detected and counted, never returned torn. Stamps repeat
+	after 2^31 records, decades at the sample rate.
+
+	Waking subscribers is up to the caller: busNotify() runs the wake
+	function each subscriber registered, after busPublish() has returned.
+	Subscribe before the producer starts, from one task.
+*/
+
+#ifndef SAMPLE_BUS_H_
+#define SAMPLE_BUS_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BUS_LENGTH 16 // records, a power of two
+#define BUS_SUBSCRIBERS 4
+
+// record types
+#define BUS_SAMPLE 0
+#define BUS_PUMP 1
+
+typedef struct
+{
+    int64_t timeUs; // esp_timer time of the reading or the event
+    uint8_t type;   // BUS_SAMPLE or BUS_PUMP
+    uint8_t source; // sensor of a sample, zone of a pump event
+    int8_t status;  // DHT_OK or the read error, samples only
+    uint8_t on;     // pump events only
+    int16_t humidity10;
+    int16_t temperature10;
+} bus_record_t;
+
+#define BUS_WORDS (sizeof(bus_record_t) / sizeof(uint32_t))
+
+typedef struct
+{
+    _Atomic uint32_t stamp;
+    _Atomic uint32_t words[BUS_WORDS]; // the record, copied word by word
+} bus_slot_t;
+
+typedef struct
+{
+    const char *name;
+    void (*wake)(void *arg); // NULL: the subscriber polls
+    void *arg;
+    _Atomic uint32_t cursor;   // next sequence to read, written by the subscriber only
+    _Atomic uint32_t overruns; // records lost to the producer lapping the cursor
+    _Atomic uint32_t received;
+} bus_subscriber_t;
+
+typedef struct
+{
+    const char *name;
+    bus_slot_t slots[BUS_LENGTH];
+    _Atomic uint32_t head; // sequence of the next record
+    bus_subscriber_t subscribers[BUS_SUBSCRIBERS];
+    _Atomic int subscriberCount;
+} sample_bus_t;
+
+typedef struct
+{
+    const char *name;
+    uint32_t received;
+    uint32_t overruns;
+    uint32_t lag; // records published but not read yet
+} bus_subscriber_stats_t;
+
+void busInit(sample_bus_t *bus, const char *name);
+bus_subscriber_t *busSubscribe(sample_bus_t *bus, const char *name, void (*wake)(void *arg), void *arg);
+void busPublish(sample_bus_t *bus, const bus_record_t *record);
+void busNotify(sample_bus_t *bus);
+bool busRead(sample_bus_t *bus, bus_subscriber_t *sub, bus_record_t *record);
+uint32_t busPublished(const sample_bus_t *bus);
+int busGetStats(const sample_bus_t *bus, bus_subscriber_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
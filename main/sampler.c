@@ -0,0 +1,219 @@
+/*------------------------------------------------------------------------------
+
+	Sampling scheduler pinned to the APP CPU
+
+	The deadlines live on the FreeRTOS tick grid: lastWake advances by the
+	delay the retry policy asked for, whether the task woke on time or not,
+	and deadlineUs follows it in esp_timer microseconds. All delays are
+	whole ticks (the periods are multiples of 10 ms), so both stay in step.
+	xTaskDelayUntil() returning without blocking means the deadline had
+	already passed, that is a missed deadline.
+
+	The read runs the backend chosen in menuconfig: readDHT() blocks this
+	task for the ~5 ms capture (RMT, SPI or busy-wait), the edge interrupt
+	read returns at once and the task waits on its result queue. Either
+	way the interrupt of the capture is allocated on this core.
+
+	The retry state and the statistics belong to the task. Readers get
+	copies under a mutex, which is only held for the copy.
+
+---------------------------------------------------------------------------------*/
+
+#include <string.h>
+
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "DHT.h"
+#include "DHT_async.h"
+#include "budget.h"
+#include "sampler.h"
+
+static const char *TAG = "SAMPLER";
+
+static const uint32_t jitterBinUs[SAMPLER_JITTER_BINS - 1] = SAMPLER_JITTER_BOUNDS_US;
+
+static int dhtGpio;
+static sample_bus_t *sampleBus; // to the control task, the logger and the uploader
+#if CONFIG_DHT_BACKEND_ASYNC
+static QueueHandle_t resultQueue; // from the async read
+#endif
+static dht_retry_t retry;
+
+static StaticSemaphore_t lockBuffer;
+static SemaphoreHandle_t lock = NULL;
+static sampler_stats_t stats;
+static dht_health_t health;
+static bool degraded;
+
+// == statistics ==================================================
+
+static void countJitter(sampler_stats_t *s, int32_t jitterUs)
+{
+    uint32_t magnitude = jitterUs < 0 ? -jitterUs : jitterUs;
+    int bin = 0;
+
+    while (bin < SAMPLER_JITTER_BINS - 1 && magnitude >= jitterBinUs[bin])
+        bin++;
+
+    s->lastJitterUs = jitterUs;
+    s->jitterHistogram[bin]++;
+    if (magnitude > s->maxJitterUs)
+        s->maxJitterUs = magnitude;
+}
+
+static void countMasked(sampler_stats_t *s, uint32_t us)
+{
+    s->lastMaskedUs = us;
+    s->totalMaskedUs += us;
+    if (us > s->maxMaskedUs)
+        s->maxMaskedUs = us;
+}
+
+// == to the subscribers ===========================================
+
+static void publish(sampler_stats_t *s, const dht_sample_t *sample)
+{
+    bus_record_t record = {
+        .timeUs = sample->timestamp,
+        .type = BUS_SAMPLE,
+        .status = sample->status,
+        .humidity10 = sample->humidity10,
+        .temperature10 = sample->temperature10,
+    };
+
+    uint32_t start = esp_cpu_get_cycle_count();
+    busPublish(sampleBus, &record);
+    uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+    s->lastPublishCycles = cycles;
+    if (cycles > s->maxPublishCycles)
+        s->maxPublishCycles = cycles;
+
+    busNotify(sampleBus);
+}
+
+// == one read, start to result ===================================
+
+#if CONFIG_DHT_BACKEND_ASYNC
+static void readSample(dht_sample_t *sample)
+{
+    xQueueReset(resultQueue);
+
+    int ret = startReadDHT();
+    if (ret == DHT_OK && xQueueReceive(resultQueue, sample, pdMS_TO_TICKS(SAMPLER_RESULT_TIMEOUT_MS)) == pdTRUE)
+        return;
+
+    // no frame came back, the retry policy sees a sensor that did not answer
+    *sample = (dht_sample_t){
+        .status = ret == DHT_OK ? DHT_TIMEOUT_ERROR : ret,
+        .timestamp = esp_timer_get_time(),
+    };
+}
+#else
+// the RMT and SPI setup is lazy, their interrupts land on this core with the first read
+static void readSample(dht_sample_t *sample)
+{
+    readDHTSample(sample);
+}
+#endif
+
+// == the task =====================================================
+
+static void sampler_task(void *pvParameter)
+{
+    sampler_stats_t local = {0};
+    dht_sample_t sample;
+
+#if CONFIG_DHT_BACKEND_ASYNC
+    // the edge interrupt goes to the core this runs on
+    ESP_ERROR_CHECK(initDHTAsync(dhtGpio, resultQueue));
+#else
+    setDHTgpio(dhtGpio);
+#endif
+
+    // start on a tick boundary, so deadlineUs and the tick grid line up
+    vTaskDelay(1);
+    TickType_t lastWake = xTaskGetTickCount();
+    int64_t deadlineUs = esp_timer_get_time();
+    uint32_t nextMs = 0;
+
+    while (1)
+    {
+        if (nextMs > 0 && xTaskDelayUntil(&lastWake, pdMS_TO_TICKS(nextMs)) == pdFALSE)
+            local.missed++;
+
+        countJitter(&local, esp_timer_get_time() - deadlineUs);
+        local.cycles++;
+
+        readSample(&sample);
+        countMasked(&local, sample.maskedUs);
+
+        nextMs = updateDHTRetry(&retry, &sample);
+        deadlineUs += nextMs * 1000LL;
+
+        // the health goes out before the sample, a subscriber woken by it reads the state after this read
+        xSemaphoreTake(lock, portMAX_DELAY);
+        getDHTHealth(&retry, &health);
+        degraded = isDHTDegraded(&retry);
+        xSemaphoreGive(lock);
+
+        publish(&local, &sample);
+
+        xSemaphoreTake(lock, portMAX_DELAY);
+        stats = local;
+        xSemaphoreGive(lock);
+    }
+}
+
+esp_err_t startSampler(int gpio, uint32_t minIntervalMs, uint32_t periodMs, sample_bus_t *bus)
+{
+    dhtGpio = gpio;
+    sampleBus = bus;
+    initDHTRetry(&retry, minIntervalMs, periodMs);
+
+    lock = xSemaphoreCreateMutexStatic(&lockBuffer);
+#if CONFIG_DHT_BACKEND_ASYNC
+    resultQueue = getBudgetQueue(BUDGET_QUEUE_RESULT);
+#endif
+
+    if (startBudgetTask(BUDGET_TASK_SAMPLER, &sampler_task, NULL) == NULL)
+    {
+        ESP_LOGE(TAG, "Task creation failed");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+void getSamplerStats(sampler_stats_t *s)
+{
+    if (lock == NULL)
+    {
+        memset(s, 0, sizeof(*s));
+        return;
+    }
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    *s = stats;
+    xSemaphoreGive(lock);
+}
+
+void getSamplerHealth(dht_health_t *h, bool *isDegraded)
+{
+    if (lock == NULL)
+    {
+        memset(h, 0, sizeof(*h));
+        *isDegraded = false;
+        return;
+    }
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    *h = health;
+    *isDegraded = degraded;
+    xSemaphoreGive(lock);
+}
@@ -0,0 +1,58 @@
+/*
+	Sampling scheduler pinned to the APP CPU
+
+	One task owns the DHT read cycle: it sleeps until an absolute deadline
+	(xTaskDelayUntil), reads the sensor with the configured backend, feeds
+	the result to the retry policy and publishes the sample on the sample bus. The next
+	deadline is counted from the previous one, never from when the work
+	finished, so the period does not drift. The capture interrupt is
+	allocated on the same core, away from WiFi, HTTP and flash writes on the PRO CPU.
+
+	Wake-up jitter against the deadline, missed deadlines, the time the
+	reads kept interrupts masked and the cycles a publish took are kept as
+	statistics.
+*/
+
+#ifndef SAMPLER_H_
+#define SAMPLER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#include "DHT_retry.h"
+#include "sample_bus.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// task and queues are in the table of budget.h, the task is pinned to the APP CPU
+#define SAMPLER_RESULT_TIMEOUT_MS 50 // the edge interrupt read reports after ~10 ms
+#define SAMPLER_JITTER_BINS 8        // bin k: below the k-th bound, the last one open
+#define SAMPLER_JITTER_BOUNDS_US {100, 200, 500, 1000, 2000, 5000, 10000}
+
+typedef struct
+{
+    uint32_t cycles;   // reads started
+    uint32_t missed;   // deadlines already past when the task got to them
+    int32_t lastJitterUs; // wake-up minus deadline
+    uint32_t maxJitterUs;
+    uint32_t jitterHistogram[SAMPLER_JITTER_BINS];
+    uint32_t lastMaskedUs; // interrupts masked by the last read
+    uint32_t maxMaskedUs;
+    uint64_t totalMaskedUs;
+    uint32_t lastPublishCycles; // busPublish() alone, waking the subscribers not included
+    uint32_t maxPublishCycles;
+} sampler_stats_t;
+
+esp_err_t startSampler(int gpio, uint32_t minIntervalMs, uint32_t periodMs, sample_bus_t *bus);
+void getSamplerStats(sampler_stats_t *stats);
+void getSamplerHealth(dht_health_t *health, bool *degraded); // includes every sample already on the bus
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,421 @@
+/*------------------------------------------------------------------------------
+
+	Append-only sensor log
+
+	Segment layout, little endian:
+
+	  0  magic        u32  LOG_MAGIC
+	  4  version      u8
+	  5  reserved     u8
+	  6  boot         u16
+	  8  baseTimeS    u32  time the encoder starts from
+	 12  count        u16  records in the payload
+	 14  payloadLen   u16
+	 16  crc          u32  CRC-32 of bytes 0..15 and the payload
+	 20  payload, padded with 0xFF to LOG_SEGMENT_SIZE
+
+	Every record starts with a tag byte: the type in bits 0..1 and flags
+	for fields that are left out. The time is the delta to the previous
+	record, omitted when it repeats the previous delta (the sample rate).
+	Sample values are deci units, stored as zigzag varint deltas to the
+	previous sample and omitted when unchanged, so a steady reading at the
+	regular rate costs a single byte.
+
+	The segment is written with one fwrite() and synced. A power loss can
+	only tear the last slot; logOpen() pads the file back to a slot
+	boundary and the CRC makes the torn slot invisible to the reader.
+
+---------------------------------------------------------------------------------*/
+
+#include <string.h>
+#include <unistd.h>
+
+#include "sensor_log.h"
+
+#define LOG_TAG_TYPE 0x03
+#define LOG_TAG_SAME_DELTA 0x04
+#define LOG_TAG_SAME_HUMIDITY 0x08
+#define LOG_TAG_SAME_TEMPERATURE 0x10
+#define LOG_RECORD_MAX 12 // tag, 5 byte time delta, two 3 byte value deltas
+
+// == CRC-32 (IEEE), four bits at a time ==========================
+
+uint32_t logCrc32(uint32_t crc, const uint8_t *data, int len)
+{
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+
+    crc = ~crc;
+    for (int k = 0; k < len; k++)
+    {
+        crc ^= data[k];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+
+    return ~crc;
+}
+
+// == byte packing ================================================
+
+static inline void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static inline void put32(uint8_t *p, uint32_t v)
+{
+    put16(p, v);
+    put16(p + 2, v >> 16);
+}
+
+static inline uint16_t get16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t get32(const uint8_t *p)
+{
+    return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+static int putVarint(uint8_t *p, uint32_t v)
+{
+    int n = 0;
+
+    while (v >= 0x80)
+    {
+        p[n++] = v | 0x80;
+        v >>= 7;
+    }
+    p[n++] = v;
+
+    return n;
+}
+
+// returns the number of bytes read, 0 when the varint runs past end
+static int getVarint(const uint8_t *p, const uint8_t *end, uint32_t *v)
+{
+    *v = 0;
+
+    for (int n = 0; n < 5 && p + n < end; n++)
+    {
+        *v |= (uint32_t)(p[n] & 0x7F) << (7 * n);
+        if (!(p[n] & 0x80))
+            return n + 1;
+    }
+
+    return 0;
+}
+
+static inline uint32_t zigzag(int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t v)
+{
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+// == segment buffer ==============================================
+
+void logSegmentStart(log_segment_t *seg, uint16_t boot, uint32_t timeS)
+{
+    seg->boot = boot;
+    seg->used = 0;
+    seg->count = 0;
+    seg->baseTimeS = timeS;
+    seg->lastTimeS = timeS;
+    seg->lastDeltaS = 0;
+    seg->lastHumidity = 0;
+    seg->lastTemperature = 0;
+}
+
+// header, payload and 0xFF padding into one LOG_SEGMENT_SIZE slot
+void logSegmentSeal(const log_segment_t *seg, uint8_t *segment)
+{
+    put32(segment + 0, LOG_MAGIC);
+    segment[4] = LOG_VERSION;
+    segment[5] = 0;
+    put16(segment + 6, seg->boot);
+    put32(segment + 8, seg->baseTimeS);
+    put16(segment + 12, seg->count);
+    put16(segment + LOG_PAYLOAD_LEN_OFFSET, seg->used);
+
+    memcpy(segment + LOG_HEADER_SIZE, seg->payload, seg->used);
+    memset(segment + LOG_HEADER_SIZE + seg->used, 0xFF, LOG_PAYLOAD_SIZE - seg->used);
+
+    uint32_t crc = logCrc32(0, segment, 16);
+    put32(segment + 16, logCrc32(crc, segment + LOG_HEADER_SIZE, seg->used));
+}
+
+// == open, recover the boot number and realign after a torn write ==
+
+static void oldPathOf(const sensor_log_t *log, char *oldPath, size_t size)
+{
+    snprintf(oldPath, size, "%s.old", log->path);
+}
+
+// boot number of the newest valid segment in the file, -1 if there is none
+static int lastBoot(const char *path)
+{
+    uint8_t segment[LOG_SEGMENT_SIZE];
+    FILE *file = fopen(path, "rb");
+    int boot = -1;
+
+    if (file == NULL)
+        return -1;
+
+    fseek(file, 0, SEEK_END);
+    long slot = ftell(file) / LOG_SEGMENT_SIZE;
+
+    // walk back from the end, only a torn tail is ever invalid
+    while (boot < 0 && --slot >= 0)
+    {
+        fseek(file, slot * LOG_SEGMENT_SIZE, SEEK_SET);
+        if (fread(segment, 1, LOG_SEGMENT_SIZE, file) == LOG_SEGMENT_SIZE && logDecodeSegment(segment, NULL, 0) >= 0)
+            boot = get16(segment + 6);
+    }
+
+    fclose(file);
+    return boot;
+}
+
+int logOpen(sensor_log_t *log, const char *path, long maxBytes)
+{
+    char oldPath[sizeof(log->path) + 4];
+
+    memset(log, 0, sizeof(*log));
+    snprintf(log->path, sizeof(log->path), "%s", path);
+    log->maxBytes = maxBytes;
+
+    oldPathOf(log, oldPath, sizeof(oldPath));
+    int boot = lastBoot(log->path);
+    if (boot < 0)
+        boot = lastBoot(oldPath);
+    log->boot = boot + 1;
+    logSegmentStart(&log->segment, log->boot, 0);
+
+    log->file = fopen(log->path, "ab");
+    if (log->file == NULL)
+        return -1;
+
+    // whole segments are written at once, stdio buffering would only copy them
+    setvbuf(log->file, NULL, _IONBF, 0);
+
+    fseek(log->file, 0, SEEK_END);
+    long tail = ftell(log->file) % LOG_SEGMENT_SIZE;
+    if (tail)
+    {
+        uint8_t pad[LOG_SEGMENT_SIZE];
+        memset(pad, 0xFF, sizeof(pad));
+        fwrite(pad, 1, LOG_SEGMENT_SIZE - tail, log->file);
+    }
+
+    return 0;
+}
+
+// == write the pending segment ===================================
+
+static int rotate(sensor_log_t *log)
+{
+    char oldPath[sizeof(log->path) + 4];
+
+    oldPathOf(log, oldPath, sizeof(oldPath));
+    fclose(log->file);
+    remove(oldPath);
+    rename(log->path, oldPath);
+
+    log->file = fopen(log->path, "ab");
+    if (log->file == NULL)
+        return -1;
+
+    setvbuf(log->file, NULL, _IONBF, 0);
+    return 0;
+}
+
+int logFlush(sensor_log_t *log)
+{
+    uint8_t segment[LOG_SEGMENT_SIZE];
+
+    if (log->file == NULL)
+        return -1;
+    if (log->segment.count == 0)
+        return 0;
+
+    logSegmentSeal(&log->segment, segment);
+    logSegmentStart(&log->segment, log->boot, log->segment.lastTimeS);
+
+    if (fwrite(segment, 1, LOG_SEGMENT_SIZE, log->file) != LOG_SEGMENT_SIZE)
+        return -1;
+    fsync(fileno(log->file));
+
+    if (log->maxBytes > 0 && ftell(log->file) >= log->maxBytes)
+        return rotate(log);
+
+    return 0;
+}
+
+void logClose(sensor_log_t *log)
+{
+    if (log->file == NULL)
+        return;
+
+    logFlush(log);
+    fclose(log->file);
+    log->file = NULL;
+}
+
+/*----------------------------------------------------------------------------
+;
+;	append one record
+;
+;	logSegmentAppend() encodes into the RAM segment and returns true when
+;	the next record might not fit. The log writes the segment out then, or
+;	LOG_FLUSH_INTERVAL_S after its first record.
+;
+;----------------------------------------------------------------------------*/
+
+bool logSegmentAppend(log_segment_t *seg, uint32_t timeS, int type, int16_t humidity, int16_t temperature)
+{
+    if (seg->count == 0)
+        logSegmentStart(seg, seg->boot, timeS);
+
+    uint8_t *p = seg->payload + seg->used;
+    uint8_t *tag = p++;
+    uint32_t delta = timeS >= seg->lastTimeS ? timeS - seg->lastTimeS : 0;
+
+    *tag = type;
+
+    if (delta == seg->lastDeltaS)
+        *tag |= LOG_TAG_SAME_DELTA;
+    else
+        p += putVarint(p, delta);
+
+    if (type == LOG_SAMPLE)
+    {
+        if (humidity == seg->lastHumidity)
+            *tag |= LOG_TAG_SAME_HUMIDITY;
+        else
+            p += putVarint(p, zigzag(humidity - seg->lastHumidity));
+
+        if (temperature == seg->lastTemperature)
+            *tag |= LOG_TAG_SAME_TEMPERATURE;
+        else
+            p += putVarint(p, zigzag(temperature - seg->lastTemperature));
+
+        seg->lastHumidity = humidity;
+        seg->lastTemperature = temperature;
+    }
+
+    seg->used = p - seg->payload;
+    seg->count++;
+    seg->lastTimeS = timeS;
+    seg->lastDeltaS = delta;
+
+    return seg->used + LOG_RECORD_MAX > LOG_PAYLOAD_SIZE;
+}
+
+static int appendRecord(sensor_log_t *log, uint32_t timeS, int type, int16_t humidity, int16_t temperature)
+{
+    if (log->file == NULL)
+        return -1;
+
+    bool full = logSegmentAppend(&log->segment, timeS, type, humidity, temperature);
+
+    if (full || timeS - log->segment.baseTimeS >= LOG_FLUSH_INTERVAL_S)
+        return logFlush(log);
+
+    return 0;
+}
+
+int logSample(sensor_log_t *log, uint32_t timeS, int16_t humidity, int16_t temperature)
+{
+    return appendRecord(log, timeS, LOG_SAMPLE, humidity, temperature);
+}
+
+int logPump(sensor_log_t *log, uint32_t timeS, bool on)
+{
+    return appendRecord(log, timeS, on ? LOG_PUMP_ON : LOG_PUMP_OFF, 0, 0);
+}
+
+/*----------------------------------------------------------------------------
+;
+;	decode one segment slot
+;
+;	Returns the number of records, or -1 when the slot is empty, torn or
+;	corrupted. With records == NULL only the header and CRC are checked.
+;
+;----------------------------------------------------------------------------*/
+
+int logDecodeSegment(const uint8_t *segment, log_record_t *records, int maxRecords)
+{
+    uint16_t count = get16(segment + 12);
+    uint16_t payloadLen = get16(segment + LOG_PAYLOAD_LEN_OFFSET);
+
+    if (get32(segment) != LOG_MAGIC || segment[4] != LOG_VERSION || payloadLen > LOG_PAYLOAD_SIZE)
+        return -1;
+
+    uint32_t crc = logCrc32(0, segment, 16);
+    if (logCrc32(crc, segment + LOG_HEADER_SIZE, payloadLen) != get32(segment + 16))
+        return -1;
+
+    if (records == NULL)
+        return count;
+
+    const uint8_t *p = segment + LOG_HEADER_SIZE;
+    const uint8_t *end = p + payloadLen;
+    uint16_t boot = get16(segment + 6);
+    uint32_t timeS = get32(segment + 8);
+    uint32_t delta = 0;
+    int32_t humidity = 0, temperature = 0;
+    int n = 0;
+
+    while (p < end && n < count && n < maxRecords)
+    {
+        uint8_t tag = *p++;
+        uint32_t v;
+        int len;
+
+        if (!(tag & LOG_TAG_SAME_DELTA))
+        {
+            if ((len = getVarint(p, end, &delta)) == 0)
+                return -1;
+            p += len;
+        }
+        timeS += delta;
+
+        if ((tag & LOG_TAG_TYPE) == LOG_SAMPLE)
+        {
+            if (!(tag & LOG_TAG_SAME_HUMIDITY))
+            {
+                if ((len = getVarint(p, end, &v)) == 0)
+                    return -1;
+                p += len;
+                humidity += unzigzag(v);
+            }
+            if (!(tag & LOG_TAG_SAME_TEMPERATURE))
+            {
+                if ((len = getVarint(p, end, &v)) == 0)
+                    return -1;
+                p += len;
+                temperature += unzigzag(v);
+            }
+        }
+
+        records[n] = (log_record_t){
+            .boot = boot,
+            .timeS = timeS,
+            .type = tag & LOG_TAG_TYPE,
+            .humidity = humidity,
+            .temperature = temperature,
+        };
+        n++;
+    }
+
+    return n;
+}
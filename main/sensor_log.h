@@ -0,0 +1,93 @@
+/*
+	Append-only binary log of samples and pump events
+
+	The file is a sequence of fixed LOG_SEGMENT_SIZE slots, each written
+	whole in one batch. A SPIFFS page holds 251 data bytes behind its
+	5 byte header, so a slot spans two pages and a flush writes both. A slot holds a CRC-protected header
+	and delta encoded records; every segment restarts the encoding, so a
+	torn or corrupted slot only loses itself and replay just skips it.
+	Only stdio is used, the same code runs on the VFS and on a host.
+*/
+
+#ifndef SENSOR_LOG_H_
+#define SENSOR_LOG_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LOG_SEGMENT_SIZE 256 // one CONFIG_SPIFFS_PAGE_SIZE, two pages on flash with their headers
+#define LOG_HEADER_SIZE 20
+#define LOG_PAYLOAD_LEN_OFFSET 14 // u16 little endian, the header layout is in sensor_log.c
+#define LOG_PAYLOAD_SIZE (LOG_SEGMENT_SIZE - LOG_HEADER_SIZE)
+#define LOG_MAGIC 0x474C4249 // "IBLG"
+#define LOG_VERSION 1
+#define LOG_FLUSH_INTERVAL_S 600 // longest time a record waits in RAM
+
+// record types
+#define LOG_SAMPLE 0
+#define LOG_PUMP_ON 1
+#define LOG_PUMP_OFF 2
+
+typedef struct
+{
+    uint16_t boot;   // incremented on every logOpen(), times restart with each boot
+    uint32_t timeS;
+    uint8_t type;
+    int16_t humidity;    // deci-percent, LOG_SAMPLE only
+    int16_t temperature; // deci-degree, LOG_SAMPLE only
+} log_record_t;
+
+// one segment being filled, also the batch format of the telemetry upload
+typedef struct
+{
+    uint16_t boot;
+    uint8_t payload[LOG_PAYLOAD_SIZE];
+    int used;
+    uint16_t count;
+    uint32_t baseTimeS;
+
+    // encoder state, reset with every segment
+    uint32_t lastTimeS;
+    uint32_t lastDeltaS;
+    int16_t lastHumidity;
+    int16_t lastTemperature;
+} log_segment_t;
+
+typedef struct
+{
+    FILE *file;
+    char path[32];
+    long maxBytes; // rotate to <path>.old beyond this size
+    uint16_t boot;
+    log_segment_t segment;
+} sensor_log_t;
+
+int logOpen(sensor_log_t *log, const char *path, long maxBytes);
+int logSample(sensor_log_t *log, uint32_t timeS, int16_t humidity, int16_t temperature);
+int logPump(sensor_log_t *log, uint32_t timeS, bool on);
+int logFlush(sensor_log_t *log);
+void logClose(sensor_log_t *log);
+
+void logSegmentStart(log_segment_t *seg, uint16_t boot, uint32_t timeS);
+bool logSegmentAppend(log_segment_t *seg, uint32_t timeS, int type, int16_t humidity, int16_t temperature);
+void logSegmentSeal(const log_segment_t *seg, uint8_t *segment);
+
+int logDecodeSegment(const uint8_t *segment, log_record_t *records, int maxRecords);
+uint32_t logCrc32(uint32_t crc, const uint8_t *data, int len);
+
+// header and payload of a sealed segment, without the padding
+static inline int logSegmentLength(const uint8_t *segment)
+{
+    return LOG_HEADER_SIZE + (segment[LOG_PAYLOAD_LEN_OFFSET] | segment[LOG_PAYLOAD_LEN_OFFSET + 1] << 8);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,60 @@
+/*------------------------------------------------------------------------------
+
+	Shared controller status and sample history, guarded by one mutex
+
+---------------------------------------------------------------------------------*/
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "status.h"
+
+static StaticSemaphore_t lockBuffer;
+static SemaphoreHandle_t lock;
+static ibaum_status_t current;
+static history_t history;
+
+void initStatus(void)
+{
+    lock = xSemaphoreCreateMutexStatic(&lockBuffer);
+    historyInit(&history);
+}
+
+void publishStatus(const ibaum_status_t *status)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    current = *status;
+    xSemaphoreGive(lock);
+}
+
+void getStatus(ibaum_status_t *status)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    *status = current;
+    xSemaphoreGive(lock);
+}
+
+void addStatusHistory(uint32_t timeS, const int16_t *values)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    historyAdd(&history, timeS, values);
+    xSemaphoreGive(lock);
+}
+
+uint32_t getStatusWindow(uint32_t nowS, uint32_t windowS, int channel, history_stats_t *stats)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    uint32_t count = historyWindow(&history, nowS, windowS, channel, stats);
+    xSemaphoreGive(lock);
+
+    return count;
+}
+
+uint32_t getStatusBucket(int tier, uint32_t age, int channel, uint32_t *timeS, history_stats_t *stats)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    uint32_t count = historyBucket(&history, tier, age, channel, timeS, stats);
+    xSemaphoreGive(lock);
+
+    return count;
+}
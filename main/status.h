@@ -0,0 +1,75 @@
+/*
+	Shared controller status and sample history
+
+	The control task publishes a snapshot after every change and adds the
+	samples to the history, other tasks (HTTP, telemetry) read copies. All
+	access goes through a mutex, not a critical section, so readers never
+	hold off the interrupts that timestamp the sensor edges.
+*/
+
+#ifndef STATUS_H_
+#define STATUS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "DHT_retry.h"
+#include "boot_state.h"
+#include "filter.h"
+#include "history.h"
+#include "zones.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STATUS_IDLE 0
+#define STATUS_PUMPING 1
+#define STATUS_COOLDOWN 2
+#define STATUS_WAITING 3
+#define STATUS_STATES 4
+
+typedef struct
+{
+    const char *name;
+    uint8_t state; // STATUS_*
+    bool hasReading;
+    int16_t humidity10; // mean of the zone's filtered readings
+    uint32_t pumpCycles;
+    uint32_t pumpSeconds;
+    uint32_t maxWaitS;
+    uint16_t pulseS; // current or last run
+    uint16_t gainQ8; // learned response, deci-percent per pump second in Q8, 0 before the first
+} ibaum_zone_status_t;
+
+typedef struct
+{
+    int64_t sampleUs; // esp_timer time of the last good sample, 0 before the first
+    int16_t humidity10;
+    int16_t temperature10;
+    int16_t filteredHumidity10;
+    int16_t filteredTemperature10;
+    filter_latency_t filterLatency; // measured humidity step delay, see filter.h
+    uint32_t conditionUs;           // capture to filtered value of the last sample
+    bool pumpOn;         // any zone
+    uint32_t pumpCycles; // all zones
+    uint8_t pumpsRunning;
+    uint8_t zoneCount;
+    ibaum_zone_status_t zones[ZONES_MAX];
+    bool degraded;
+    dht_health_t health;
+    boot_times_t boot; // up to the restore at first, complete once the first decision is made
+} ibaum_status_t;
+
+void initStatus(void);
+void publishStatus(const ibaum_status_t *status);
+void getStatus(ibaum_status_t *status);
+void addStatusHistory(uint32_t timeS, const int16_t *values);
+uint32_t getStatusWindow(uint32_t nowS, uint32_t windowS, int channel, history_stats_t *stats);
+uint32_t getStatusBucket(int tier, uint32_t age, int channel, uint32_t *timeS, history_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
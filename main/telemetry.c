@@ -0,0 +1,287 @@
+/*------------------------------------------------------------------------------
+
+	Batched telemetry upload with an offline queue
+
+	Records go into an open log segment. It is sealed into the RAM ring when
+	full or, while sends succeed, TELEMETRY_BATCH_INTERVAL_S after its first
+	record; with the link down only full batches are queued, so the spool
+	holds as many records as it can. The ring is
+	the only buffer while the link is up; when it overflows the oldest batch
+	is appended to the spool file, so the spool always holds older batches
+	than the ring and the upload order stays the capture order. spoolMax
+	bounds the unsent batches: when the file end reaches it, the batches
+	already sent are cut from the front of the file first. With spoolMax
+	unsent the overflowing batch is dropped.
+
+	telemetryPoll() sends from the spool first, then from the ring, one
+	batch per token, without the padding of the slot. Tokens refill at TELEMETRY_DRAIN_PER_S up to
+	TELEMETRY_DRAIN_BURST, which is never reached by the regular batch rate,
+	so only a backlog is rate limited. A failed send backs off exponentially.
+
+	The spool survives a reboot and is sent again from its start, so the
+	receiver sees a batch at least once and deduplicates on (boot, baseTimeS)
+	from the segment header.
+
+---------------------------------------------------------------------------------*/
+
+#include <string.h>
+#include <unistd.h>
+
+#include "telemetry.h"
+
+// == spool file ==================================================
+
+static FILE *openSpool(const char *path, const char *mode)
+{
+    FILE *file = fopen(path, mode);
+
+    // whole batches are written at once, stdio buffering would only copy them
+    if (file != NULL)
+        setvbuf(file, NULL, _IONBF, 0);
+
+    return file;
+}
+
+// move the unsent batches to the start of the file, the sent ones before them only take space
+static void compactSpool(telemetry_t *t)
+{
+    long to = 0;
+
+    for (long from = t->spoolRead; from < t->spoolWrite; from += TELEMETRY_BATCH_SIZE)
+    {
+        fseek(t->spool, from, SEEK_SET);
+        if (fread(t->batch, 1, TELEMETRY_BATCH_SIZE, t->spool) != TELEMETRY_BATCH_SIZE)
+            break;
+        fseek(t->spool, to, SEEK_SET);
+        if (fwrite(t->batch, 1, TELEMETRY_BATCH_SIZE, t->spool) != TELEMETRY_BATCH_SIZE)
+            break;
+        to += TELEMETRY_BATCH_SIZE;
+    }
+
+    // a power loss in between, or a tail a failed truncate leaves, only sends
+    // some batches twice after the next boot, the receiver deduplicates them
+    fsync(fileno(t->spool));
+    if (ftruncate(fileno(t->spool), to) == 0)
+        fsync(fileno(t->spool));
+    t->spoolRead = 0;
+    t->spoolWrite = to;
+}
+
+static void spill(telemetry_t *t, const uint8_t *batch)
+{
+    // the bound is on the unsent batches, not on the end of the file
+    if (t->spool != NULL && t->spoolRead > 0 && t->spoolWrite + TELEMETRY_BATCH_SIZE > t->spoolMax)
+        compactSpool(t);
+
+    if (t->spool == NULL || t->spoolWrite + TELEMETRY_BATCH_SIZE > t->spoolMax)
+    {
+        t->stats.dropped++;
+        return;
+    }
+
+    fseek(t->spool, t->spoolWrite, SEEK_SET);
+    if (fwrite(batch, 1, TELEMETRY_BATCH_SIZE, t->spool) != TELEMETRY_BATCH_SIZE)
+    {
+        t->stats.dropped++;
+        return;
+    }
+    fsync(fileno(t->spool));
+
+    t->spoolWrite += TELEMETRY_BATCH_SIZE;
+    t->stats.spilled++;
+
+    long bytes = t->spoolWrite - t->spoolRead;
+    if (bytes > t->stats.spoolBytesMax)
+        t->stats.spoolBytesMax = bytes;
+}
+
+// everything sent, start the file over instead of letting it grow
+static void truncateSpool(telemetry_t *t)
+{
+    fclose(t->spool);
+    t->spool = openSpool(t->path, "w+b");
+    t->spoolRead = 0;
+    t->spoolWrite = 0;
+}
+
+int telemetryOpen(telemetry_t *t, const char *spoolPath, long spoolMax, uint16_t boot, telemetry_send_t send,
+                  void *context)
+{
+    memset(t, 0, sizeof(*t));
+    t->send = send;
+    t->context = context;
+    t->tokens = TELEMETRY_DRAIN_BURST * 1000;
+    t->backoffMs = TELEMETRY_RETRY_MIN_MS;
+    logSegmentStart(&t->open, boot, 0);
+
+    // without a spool path the ring is the whole queue
+    if (spoolPath == NULL)
+        return 0;
+
+    snprintf(t->path, sizeof(t->path), "%s", spoolPath);
+    t->spoolMax = spoolMax;
+
+    t->spool = openSpool(t->path, "r+b");
+    if (t->spool == NULL)
+        t->spool = openSpool(t->path, "w+b");
+    if (t->spool == NULL)
+        return -1;
+
+    // a torn last batch is cut off, it fails the CRC anyway
+    fseek(t->spool, 0, SEEK_END);
+    t->spoolWrite = ftell(t->spool) / TELEMETRY_BATCH_SIZE * TELEMETRY_BATCH_SIZE;
+    if (t->spoolWrite > t->spoolMax)
+        t->spoolWrite = t->spoolMax / TELEMETRY_BATCH_SIZE * TELEMETRY_BATCH_SIZE;
+    t->stats.spoolBytesMax = t->spoolWrite;
+
+    return 0;
+}
+
+// == seal the open batch into the RAM ring =======================
+
+static void seal(telemetry_t *t)
+{
+    if (t->open.count == 0)
+        return;
+
+    if (t->queued == TELEMETRY_QUEUE_BATCHES)
+    {
+        spill(t, t->queue[t->head]);
+        t->head = (t->head + 1) % TELEMETRY_QUEUE_BATCHES;
+        t->queued--;
+    }
+
+    logSegmentSeal(&t->open, t->queue[(t->head + t->queued) % TELEMETRY_QUEUE_BATCHES]);
+    logSegmentStart(&t->open, t->open.boot, t->open.lastTimeS);
+
+    t->queued++;
+    t->stats.batches++;
+    if (t->queued > t->stats.queuedMax)
+        t->stats.queuedMax = t->queued;
+}
+
+static void append(telemetry_t *t, uint32_t timeS, int type, int16_t humidity, int16_t temperature)
+{
+    t->stats.records++;
+
+    if (logSegmentAppend(&t->open, timeS, type, humidity, temperature))
+        seal(t);
+}
+
+void telemetrySample(telemetry_t *t, uint32_t timeS, int16_t humidity, int16_t temperature)
+{
+    append(t, timeS, LOG_SAMPLE, humidity, temperature);
+}
+
+void telemetryPump(telemetry_t *t, uint32_t timeS, bool on)
+{
+    append(t, timeS, on ? LOG_PUMP_ON : LOG_PUMP_OFF, 0, 0);
+}
+
+/*----------------------------------------------------------------------------
+;
+;	seal a due batch and send what the token bucket allows
+;
+;	Returns the number of batches delivered. Spooled batches that fail the
+;	CRC (torn by a power loss) are skipped.
+;
+;----------------------------------------------------------------------------*/
+
+// next batch to send, NULL when there is none
+static const uint8_t *peek(telemetry_t *t, bool *fromSpool)
+{
+    while (t->spool != NULL && t->spoolRead < t->spoolWrite)
+    {
+        *fromSpool = true;
+        fseek(t->spool, t->spoolRead, SEEK_SET);
+        if (fread(t->batch, 1, TELEMETRY_BATCH_SIZE, t->spool) == TELEMETRY_BATCH_SIZE &&
+            logDecodeSegment(t->batch, NULL, 0) >= 0)
+            return t->batch;
+
+        t->spoolRead += TELEMETRY_BATCH_SIZE;
+    }
+
+    if (t->spool != NULL && t->spoolWrite > 0)
+        truncateSpool(t);
+
+    *fromSpool = false;
+    return t->queued ? t->queue[t->head] : NULL;
+}
+
+int telemetryPoll(telemetry_t *t, uint32_t nowMs, uint32_t nowS)
+{
+    int sent = 0;
+
+    bool linkUp = t->backoffMs == TELEMETRY_RETRY_MIN_MS; // reset by every delivered batch
+
+    if (linkUp && t->open.count && nowS - t->open.baseTimeS >= TELEMETRY_BATCH_INTERVAL_S)
+        seal(t);
+
+    t->tokens += (nowMs - t->lastMs) * TELEMETRY_DRAIN_PER_S;
+    if (t->tokens > TELEMETRY_DRAIN_BURST * 1000)
+        t->tokens = TELEMETRY_DRAIN_BURST * 1000;
+    t->lastMs = nowMs;
+
+    if (!linkUp && (int32_t)(nowMs - t->retryAtMs) < 0)
+        return 0;
+
+    while (t->tokens >= 1000)
+    {
+        bool fromSpool;
+        const uint8_t *batch = peek(t, &fromSpool);
+
+        if (batch == NULL)
+            break;
+
+        // header and payload only, the 0xFF padding just keeps the spool slots aligned
+        int len = logSegmentLength(batch);
+
+        if (t->send(t->context, batch, len) < 0)
+        {
+            t->stats.sendFailures++;
+            t->retryAtMs = nowMs + t->backoffMs;
+            t->backoffMs = t->backoffMs * 2 < TELEMETRY_RETRY_MAX_MS ? t->backoffMs * 2 : TELEMETRY_RETRY_MAX_MS;
+            break;
+        }
+
+        if (fromSpool)
+            t->spoolRead += TELEMETRY_BATCH_SIZE;
+        else
+        {
+            t->head = (t->head + 1) % TELEMETRY_QUEUE_BATCHES;
+            t->queued--;
+        }
+
+        t->tokens -= 1000;
+        t->backoffMs = TELEMETRY_RETRY_MIN_MS;
+        t->stats.sent++;
+        ++sent;
+    }
+
+    return sent;
+}
+
+void telemetryGetStats(const telemetry_t *t, telemetry_stats_t *stats)
+{
+    *stats = t->stats;
+    stats->queued = t->queued;
+    stats->spoolBytes = t->spoolWrite - t->spoolRead;
+}
+
+// == keep the unsent batches in the spool for the next boot =======
+
+void telemetryClose(telemetry_t *t)
+{
+    seal(t);
+
+    while (t->queued)
+    {
+        spill(t, t->queue[t->head]);
+        t->head = (t->head + 1) % TELEMETRY_QUEUE_BATCHES;
+        t->queued--;
+    }
+
+    if (t->spool != NULL)
+        fclose(t->spool);
+    t->spool = NULL;
+}
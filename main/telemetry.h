@@ -0,0 +1,91 @@
+/*
+	Batched telemetry upload with an offline queue
+
+	Samples and pump events are encoded into sensor log segments (see
+	sensor_log.h), a batch is one sealed LOG_SEGMENT_SIZE slot. Sealed
+	batches wait in a small RAM ring; while the link is down the oldest
+	ones spill to a bounded spool file, and once that is full new batches
+	are dropped and counted (they are still in the sensor log). After a
+	reconnect the backlog drains oldest first through a token bucket.
+	The transport is a callback, the same code runs on a host.
+*/
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "sensor_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TELEMETRY_BATCH_SIZE LOG_SEGMENT_SIZE
+#define TELEMETRY_BATCH_INTERVAL_S 60 // longest time a record waits for its batch
+#define TELEMETRY_QUEUE_BATCHES 8     // sealed batches kept in RAM
+#define TELEMETRY_DRAIN_PER_S 2       // upload rate once a backlog has built up
+#define TELEMETRY_DRAIN_BURST 4
+#define TELEMETRY_RETRY_MIN_MS 2000 // backoff after a failed send, doubled up to the max
+#define TELEMETRY_RETRY_MAX_MS 60000
+
+// batch is a sealed segment cut after its payload (len <= TELEMETRY_BATCH_SIZE),
+// returns 0 when it was delivered, a negative value when it has to be retried
+typedef int (*telemetry_send_t)(void *context, const uint8_t *batch, int len);
+
+typedef struct
+{
+    uint32_t records;
+    uint32_t batches;      // sealed
+    uint32_t sent;
+    uint32_t sendFailures;
+    uint32_t spilled;      // batches written to the spool
+    uint32_t dropped;      // batches lost with RAM and spool full
+    uint16_t queued;       // batches in RAM right now
+    uint16_t queuedMax;
+    long spoolBytes;       // unsent bytes in the spool right now
+    long spoolBytesMax;
+} telemetry_stats_t;
+
+typedef struct
+{
+    telemetry_send_t send;
+    void *context;
+
+    log_segment_t open; // batch being filled
+
+    uint8_t queue[TELEMETRY_QUEUE_BATCHES][TELEMETRY_BATCH_SIZE];
+    int head; // oldest queued batch
+    int queued;
+
+    FILE *spool;
+    char path[32];
+    long spoolMax;
+    long spoolRead;  // next batch to send
+    long spoolWrite; // end of the spooled batches
+    uint8_t batch[TELEMETRY_BATCH_SIZE];
+
+    // token bucket in thousandths of a batch, and the backoff after a failure
+    uint32_t tokens;
+    uint32_t lastMs;
+    uint32_t retryAtMs;
+    uint32_t backoffMs;
+
+    telemetry_stats_t stats;
+} telemetry_t;
+
+int telemetryOpen(telemetry_t *t, const char *spoolPath, long spoolMax, uint16_t boot, telemetry_send_t send,
+                  void *context);
+void telemetrySample(telemetry_t *t, uint32_t timeS, int16_t humidity, int16_t temperature);
+void telemetryPump(telemetry_t *t, uint32_t timeS, bool on);
+int telemetryPoll(telemetry_t *t, uint32_t nowMs, uint32_t nowS);
+void telemetryGetStats(const telemetry_t *t, telemetry_stats_t *stats);
+void telemetryClose(telemetry_t *t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,130 @@
+/*------------------------------------------------------------------------------
+
+	Telemetry upload task
+
+	The task owns the telemetry queue, the HTTP client and its bus
+	cursors, so none of them needs a lock. Only the statistics are copied
+	out, under a mutex, after every poll. A send fails fast while WiFi is down, the backoff in telemetry.c
+	then spaces the attempts.
+
+---------------------------------------------------------------------------------*/
+
+#include "esp_crt_bundle.h"
+#include "esp_http_client.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "DHT.h"
+#include "budget.h"
+#include "net.h"
+#include "uploader.h"
+
+static const char *TAG = "UPLOAD";
+
+static telemetry_t telemetry;
+static esp_http_client_handle_t client;
+static bus_subscriber_t *samples = NULL;
+static bus_subscriber_t *events;
+
+static StaticSemaphore_t lockBuffer;
+static SemaphoreHandle_t lock = NULL;
+static telemetry_stats_t published;
+
+// == one batch per POST ===========================================
+
+static int sendBatch(void *context, const uint8_t *batch, int len)
+{
+    if (!isWifiConnected())
+        return -1;
+
+    esp_http_client_set_post_field(client, (const char *)batch, len);
+
+    esp_err_t err = esp_http_client_perform(client);
+    int status = esp_http_client_get_status_code(client);
+
+    if (err != ESP_OK || status < 200 || status >= 300)
+    {
+        ESP_LOGW(TAG, "Upload failed: %s, HTTP %d", esp_err_to_name(err), status);
+        esp_http_client_close(client); // the next attempt reconnects
+        return -1;
+    }
+
+    return 0;
+}
+
+// == the task =====================================================
+
+static void uploader_task(void *pvParameter)
+{
+    sample_bus_t *sampleBus = getBudgetBus(BUDGET_BUS_SAMPLES);
+    sample_bus_t *eventBus = getBudgetBus(BUDGET_BUS_EVENTS);
+    bus_record_t record;
+
+    while (1)
+    {
+        // woken by every publish, the timeout keeps the retries going
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(UPLOADER_POLL_MS));
+
+        while (busRead(sampleBus, samples, &record))
+            if (record.status == DHT_OK)
+                telemetrySample(&telemetry, record.timeUs / 1000000, record.humidity10, record.temperature10);
+        while (busRead(eventBus, events, &record))
+            telemetryPump(&telemetry, record.timeUs / 1000000, record.on);
+
+        uint32_t nowMs = esp_timer_get_time() / 1000;
+        telemetryPoll(&telemetry, nowMs, nowMs / 1000);
+
+        xSemaphoreTake(lock, portMAX_DELAY);
+        telemetryGetStats(&telemetry, &published);
+        xSemaphoreGive(lock);
+    }
+}
+
+esp_err_t startUploader(const char *url, const char *spoolPath, long spoolMax, uint16_t boot)
+{
+    esp_http_client_config_t config = {
+        .url = url,
+        .method = HTTP_METHOD_POST,
+        .timeout_ms = UPLOADER_TIMEOUT_MS,
+        .keep_alive_enable = true,
+        .crt_bundle_attach = esp_crt_bundle_attach, // https URLs are verified against the IDF bundle
+    };
+
+    client = esp_http_client_init(&config);
+    if (client == NULL)
+        return ESP_FAIL;
+    esp_http_client_set_header(client, "Content-Type", "application/octet-stream");
+
+    // without the spool the uploader still runs on its RAM queue
+    if (telemetryOpen(&telemetry, spoolPath, spoolMax, boot, sendBatch, NULL) != 0)
+        ESP_LOGW(TAG, "Spool %s unavailable", spoolPath);
+
+    lock = xSemaphoreCreateMutexStatic(&lockBuffer);
+    samples = subscribeBudgetBus(BUDGET_BUS_SAMPLES, BUDGET_TASK_UPLOADER);
+    events = subscribeBudgetBus(BUDGET_BUS_EVENTS, BUDGET_TASK_UPLOADER);
+
+    // with the network on the PRO CPU, the APP CPU belongs to the sampler
+    if (startBudgetTask(BUDGET_TASK_UPLOADER, &uploader_task, NULL) == NULL)
+        return ESP_FAIL;
+
+    return ESP_OK;
+}
+
+// == statistics ==================================================
+
+void getUploaderStats(uploader_stats_t *stats)
+{
+    *stats = (uploader_stats_t){0};
+
+    if (lock == NULL)
+        return;
+
+    stats->overruns = atomic_load(&samples->overruns) + atomic_load(&events->overruns);
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    stats->telemetry = published;
+    xSemaphoreGive(lock);
+}
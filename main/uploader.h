@@ -0,0 +1,42 @@
+/*
+	Telemetry upload task
+
+	The uploader subscribes to the samples and the pump events on the
+	sample buses (budget.h), a producer never waits for it: records it
+	falls too far behind on are counted as overruns instead. The task
+	feeds them to telemetry.c and POSTs every batch to the
+	configured URL as application/octet-stream, one sensor log segment per
+	request, over one kept-alive connection.
+*/
+
+#ifndef UPLOADER_H_
+#define UPLOADER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "telemetry.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the task is in the table of budget.h
+#define UPLOADER_POLL_MS 500
+#define UPLOADER_TIMEOUT_MS 5000
+
+typedef struct
+{
+    telemetry_stats_t telemetry;
+    uint32_t overruns; // records lost to the buses lapping the uploader
+} uploader_stats_t;
+
+esp_err_t startUploader(const char *url, const char *spoolPath, long spoolMax, uint16_t boot);
+void getUploaderStats(uploader_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
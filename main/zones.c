@@ -0,0 +1,415 @@
+/*------------------------------------------------------------------------------
+
+	Irrigation zones sharing a limited pump supply
+
+	Per zone the same latch as the single controller had: above highDeci
+	the zone asks for water, a run ends after its pulse (cooldown until
+	humidity is back at lowDeci) or early once lowDeci is reached. Asking
+	means joining the FIFO. A zone whose humidity drops back, or whose
+	sensors go stale, leaves it again.
+
+	zonesStep() first ends runs, then fills the free pump slots from the
+	head of the queue, one start per staggerS. A slot freed in a step is
+	reused in the same step.
+
+	The gain is learned from every run, adaptive or not, so it can be
+	watched before a zone is switched over. A measurement is the drop
+	from the humidity at the start to the lowest one within ZONE_SETTLE_S
+	after the end, per second of the run. Everything is integer, a Q8
+	division per run and one per start.
+
+---------------------------------------------------------------------------------*/
+
+#include <string.h>
+
+#include "zones.h"
+
+static uint16_t maxOn(const zone_config_t *config)
+{
+    return config->maxOnS ? config->maxOnS : config->pumpDurationS;
+}
+
+int zonesInit(zones_t *z, const zone_config_t *configs, int count, int maxPumps, int staggerS)
+{
+    memset(z, 0, sizeof(*z));
+
+    if (count < 0 || count > ZONES_MAX || maxPumps < 1 || staggerS < 0)
+        return -1;
+
+    for (int k = 0; k < count; k++)
+    {
+        const zone_config_t *config = &configs[k];
+
+        if (config->sensorCount < 1 || config->sensorCount > ZONE_MAX_SENSORS || config->lowDeci >= config->highDeci)
+            return -1;
+        if (config->pumpDurationS < 1 || config->pumpDurationS > maxOn(config))
+            return -1;
+        for (int s = 0; s < config->sensorCount; s++)
+            if (config->sensors[s] >= ZONES_MAX_SENSORS)
+                return -1;
+
+        z->zones[k].config = config;
+        z->zones[k].state = ZONE_IDLE;
+    }
+
+    z->zoneCount = count;
+    z->maxPumps = maxPumps;
+    z->staggerS = staggerS;
+    return 0;
+}
+
+void zonesSensor(zones_t *z, int sensor, uint32_t timeS, int16_t humidity)
+{
+    if (sensor < 0 || sensor >= ZONES_MAX_SENSORS)
+        return;
+
+    z->sensors[sensor] = (zone_sensor_t){.humidity = humidity, .timeS = timeS, .valid = true};
+}
+
+// == zone humidity, the mean of its fresh sensor readings =========
+
+static void readZone(const zones_t *z, zone_t *zone, uint32_t nowS)
+{
+    const zone_config_t *config = zone->config;
+    int32_t sum = 0;
+    int n = 0;
+
+    for (int s = 0; s < config->sensorCount; s++)
+    {
+        const zone_sensor_t *sensor = &z->sensors[config->sensors[s]];
+
+        if (sensor->valid && nowS - sensor->timeS <= ZONES_STALE_S)
+        {
+            sum += sensor->humidity;
+            ++n;
+        }
+    }
+
+    zone->hasReading = n > 0;
+    if (n)
+        zone->humidity = sum / n;
+}
+
+// == the FIFO of waiting zones ====================================
+
+static void enqueue(zones_t *z, int index)
+{
+    z->queue[(z->queueHead + z->queued) % ZONES_MAX] = index;
+    z->queued++;
+}
+
+static void dequeue(zones_t *z, int index)
+{
+    int k = 0;
+
+    while (k < z->queued && z->queue[(z->queueHead + k) % ZONES_MAX] != index)
+        k++;
+    if (k == z->queued)
+        return;
+
+    // close the gap, the order of the others stays
+    for (; k + 1 < z->queued; k++)
+        z->queue[(z->queueHead + k) % ZONES_MAX] = z->queue[(z->queueHead + k + 1) % ZONES_MAX];
+    z->queued--;
+}
+
+// == gain and pulse length ========================================
+
+static void learnGain(zone_t *zone)
+{
+    int32_t drop = zone->startHumidity - zone->settleMin;
+    uint32_t measured = drop > 0 && zone->ranS > 0 ? ((uint32_t)drop << 8) / zone->ranS : 0;
+
+    zone->settling = false;
+
+    // a run resumed after a reset has no start reading, its drop would look like no effect
+    if (!zone->measurable)
+        return;
+
+    // no visible effect still counts, a dry pump or a broken hose should not look like a strong one
+    if (measured < 1)
+        measured = 1;
+    if (measured > UINT16_MAX)
+        measured = UINT16_MAX;
+
+    if (zone->gainQ8 == 0)
+        zone->gainQ8 = measured;
+    else
+        zone->gainQ8 += ((int32_t)measured - zone->gainQ8) / (1 << ZONE_GAIN_SHIFT);
+}
+
+static void watchSettling(zone_t *zone, uint32_t nowS)
+{
+    if (!zone->settling)
+        return;
+
+    if (zone->hasReading && zone->humidity < zone->settleMin)
+        zone->settleMin = zone->humidity;
+    if (nowS - zone->stopS >= ZONE_SETTLE_S)
+        learnGain(zone);
+}
+
+// the run that takes the zone a quarter band below lowDeci with the learned gain, far enough to release the latch
+static uint16_t pulseLength(const zone_t *zone)
+{
+    const zone_config_t *config = zone->config;
+    uint32_t pulseS = config->pumpDurationS;
+
+    if (config->adaptive && zone->gainQ8 > 0)
+    {
+        int32_t target = config->lowDeci - (config->highDeci - config->lowDeci) / 4;
+        int32_t excess = zone->humidity - target;
+
+        pulseS = excess > 0 ? (((uint32_t)excess << 8) + zone->gainQ8 / 2) / zone->gainQ8 : 0;
+        if (pulseS < ZONE_MIN_PULSE_S)
+            pulseS = ZONE_MIN_PULSE_S;
+    }
+
+    return pulseS < maxOn(config) ? pulseS : maxOn(config);
+}
+
+// a zone may ask for water again minOffS after its last run
+static bool restedAt(const zone_t *zone, uint32_t nowS)
+{
+    return !zone->stopped || nowS - zone->stopS >= zone->config->minOffS;
+}
+
+// == transitions ==================================================
+
+static void enter(zone_t *zone, int state, uint32_t nowS)
+{
+    zone->state = state;
+    zone->sinceS = nowS;
+}
+
+static int stopPump(zones_t *z, int index, int state, uint32_t nowS, zone_action_t *action)
+{
+    zone_t *zone = &z->zones[index];
+
+    zone->pumpSeconds += nowS - zone->sinceS;
+    zone->ranS = nowS - zone->sinceS;
+    zone->stopS = nowS;
+    zone->stopped = true;
+    zone->settleMin = zone->humidity;
+    zone->settling = true;
+    z->running--;
+    enter(zone, state, nowS);
+
+    *action = (zone_action_t){.zone = index, .relay = zone->config->relay, .on = false};
+    return 1;
+}
+
+static int updateZone(zones_t *z, int index, uint32_t nowS, zone_action_t *action)
+{
+    zone_t *zone = &z->zones[index];
+    const zone_config_t *config = zone->config;
+    bool low = zone->hasReading && zone->humidity <= config->lowDeci;
+
+    watchSettling(zone, nowS);
+
+    switch (zone->state)
+    {
+    case ZONE_IDLE:
+        if (zone->hasReading && zone->humidity > config->highDeci && restedAt(zone, nowS))
+        {
+            enter(zone, ZONE_WAITING, nowS);
+            enqueue(z, index);
+        }
+        break;
+
+    case ZONE_WAITING:
+        if (low || !zone->hasReading)
+        {
+            dequeue(z, index);
+            enter(zone, ZONE_IDLE, nowS);
+        }
+        break;
+
+    case ZONE_PUMPING:
+        if (nowS - zone->sinceS >= zone->pulseS)
+            return stopPump(z, index, ZONE_COOLDOWN, nowS, action);
+        if (low)
+            return stopPump(z, index, ZONE_IDLE, nowS, action);
+        break;
+
+    case ZONE_COOLDOWN:
+        if (low)
+            enter(zone, ZONE_IDLE, nowS);
+        // an adaptive zone whose pulse fell short asks again once the run is measured, with a better gain
+        else if (config->adaptive && !zone->settling && zone->humidity > config->highDeci && restedAt(zone, nowS))
+        {
+            enter(zone, ZONE_WAITING, nowS);
+            enqueue(z, index);
+        }
+        break;
+    }
+
+    return 0;
+}
+
+/*----------------------------------------------------------------------------
+;
+;	advance all zones to nowS
+;
+;	actions needs room for ZONES_MAX entries, a zone changes its relay at
+;	most once per step. Returns the number of actions.
+;
+;----------------------------------------------------------------------------*/
+
+int zonesStep(zones_t *z, uint32_t nowS, zone_action_t *actions)
+{
+    int n = 0;
+
+    for (int k = 0; k < z->zoneCount; k++)
+    {
+        readZone(z, &z->zones[k], nowS);
+        n += updateZone(z, k, nowS, &actions[n]);
+    }
+
+    while (z->queued && z->running < z->maxPumps && (!z->started || nowS - z->lastStartS >= z->staggerS))
+    {
+        int index = z->queue[z->queueHead];
+        zone_t *zone = &z->zones[index];
+
+        z->queueHead = (z->queueHead + 1) % ZONES_MAX;
+        z->queued--;
+
+        if (nowS - zone->sinceS > zone->maxWaitS)
+            zone->maxWaitS = nowS - zone->sinceS;
+        zone->pumpCycles++;
+        enter(zone, ZONE_PUMPING, nowS);
+
+        // a run before the last one settled ends that measurement early
+        if (zone->settling)
+            learnGain(zone);
+        zone->pulseS = pulseLength(zone);
+        zone->startHumidity = zone->humidity;
+        zone->measurable = zone->hasReading;
+
+        z->running++;
+        z->lastStartS = nowS;
+        z->started = true;
+        actions[n++] = (zone_action_t){.zone = index, .relay = zone->config->relay, .on = true};
+    }
+
+    return n;
+}
+
+// == when zonesStep() has something to do without a new reading ==
+
+uint32_t zonesNextDue(const zones_t *z, uint32_t nowS)
+{
+    uint32_t due = ZONES_NOT_DUE;
+
+    for (int k = 0; k < z->zoneCount; k++)
+    {
+        const zone_t *zone = &z->zones[k];
+        uint32_t endS = zone->sinceS + zone->pulseS;
+        uint32_t restedS = zone->stopS + zone->config->minOffS;
+
+        if (zone->state == ZONE_PUMPING && endS < due)
+            due = endS;
+
+        // above the threshold, only held back by minOffS
+        if (zone->state == ZONE_IDLE && zone->hasReading && zone->humidity > zone->config->highDeci &&
+            !restedAt(zone, nowS) && restedS < due)
+            due = restedS;
+    }
+
+    if (z->queued && z->running < z->maxPumps)
+    {
+        uint32_t startS = z->started ? z->lastStartS + z->staggerS : nowS;
+        if (startS < due)
+            due = startS;
+    }
+
+    return due < nowS ? nowS : due;
+}
+
+// == across a reset ===============================================
+
+// snapshots needs room for ZONES_MAX entries, returns how many were taken
+int zonesSave(const zones_t *z, uint32_t nowS, zone_snapshot_t *snapshots)
+{
+    for (int k = 0; k < z->zoneCount; k++)
+    {
+        const zone_t *zone = &z->zones[k];
+
+        snapshots[k] = (zone_snapshot_t){
+            .state = zone->state,
+            .pulseS = zone->pulseS,
+            .ranS = zone->state == ZONE_PUMPING ? nowS - zone->sinceS : 0,
+            .gainQ8 = zone->gainQ8,
+            .offS = zone->stopped ? nowS - zone->stopS : ZONES_NOT_DUE,
+            .pumpCycles = zone->pumpCycles,
+            .pumpSeconds = zone->pumpSeconds,
+            .maxWaitS = zone->maxWaitS,
+        };
+    }
+    return z->zoneCount;
+}
+
+/*----------------------------------------------------------------------------
+;
+;	restore zones saved downS seconds ago, right after zonesInit()
+;
+;	With resume, a run that still has time left goes on (the down time
+;	counts as run time) and its relay switches on again; otherwise it
+;	ended with the reset and the zone cools down. Returns the number of
+;	actions, -1 when the snapshots do not fit the zone table.
+;
+;----------------------------------------------------------------------------*/
+
+int zonesRestore(zones_t *z, uint32_t nowS, const zone_snapshot_t *snapshots, int count, uint32_t downS, bool resume,
+                 zone_action_t *actions)
+{
+    int n = 0;
+
+    if (count != z->zoneCount)
+        return -1;
+
+    for (int k = 0; k < count; k++)
+    {
+        const zone_snapshot_t *s = &snapshots[k];
+        zone_t *zone = &z->zones[k];
+        uint32_t offS = s->offS;
+        int state = s->state == ZONE_COOLDOWN ? ZONE_COOLDOWN : ZONE_IDLE;
+
+        zone->pulseS = s->pulseS;
+        zone->gainQ8 = s->gainQ8;
+        zone->pumpCycles = s->pumpCycles;
+        zone->pumpSeconds = s->pumpSeconds;
+        zone->maxWaitS = s->maxWaitS;
+
+        if (s->state == ZONE_PUMPING)
+        {
+            uint32_t ranS = s->ranS + downS;
+
+            if (resume && ranS < s->pulseS && z->running < z->maxPumps)
+            {
+                // times since boot, sinceS may lie before 0 and wrap, all differences still hold
+                enter(zone, ZONE_PUMPING, nowS - ranS);
+                zone->measurable = false;
+                z->running++;
+                z->lastStartS = nowS;
+                z->started = true;
+                actions[n++] = (zone_action_t){.zone = k, .relay = zone->config->relay, .on = true};
+                continue;
+            }
+
+            zone->pumpSeconds += s->ranS;
+            offS = 0;
+            state = ZONE_COOLDOWN;
+        }
+
+        // only a pause that is still running matters
+        if (offS != ZONES_NOT_DUE && offS + downS < zone->config->minOffS)
+        {
+            zone->stopS = nowS - (offS + downS);
+            zone->stopped = true;
+        }
+        enter(zone, state, nowS);
+    }
+
+    return n;
+}
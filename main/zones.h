@@ -0,0 +1,148 @@
+/*
+	Irrigation zones sharing a limited pump supply
+
+	Every zone has its own sensors, relay, humidity band and pump duration.
+	One zones_t runs them all from the control loop: sensor readings come in
+	with zonesSensor(), zonesStep() moves the zones along and returns the
+	relay changes, and zonesNextDue() tells when it has to run again. At
+	most maxPumps relays are on at once and two starts are at least
+	staggerS apart (supply power, water pressure). Zones that want water
+	wait in one FIFO, so every zone is served in the order it asked.
+
+	Adaptive zones size every pulse from what the previous ones did: after
+	a run the drop in humidity over ZONE_SETTLE_S gives the zone's gain in
+	deci-percent per pump second (Q8 fixed point, averaged), and the next
+	pulse is what that gain needs to get from the current humidity to the
+	lower threshold. maxOnS caps every run, minOffS keeps a zone from
+	asking again too soon after its last one, whatever was learned.
+
+	zonesSave() takes what a zone has to keep across a reset: its latch,
+	the run in progress, the learned gain and the counters. zonesRestore()
+	puts it back into freshly initialised zones, with the time the
+	controller was down; a run can go on for what is left of it. Queue
+	order and readings are not kept, a waiting zone asks again with its
+	next reading.
+
+	Pure C with the time passed in, no IDF calls. RAM and CPU are fixed
+	per zone: zonesStep() is one pass over the zones and the queue.
+*/
+
+#ifndef ZONES_H_
+#define ZONES_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ZONES_MAX 32
+#define ZONES_MAX_SENSORS 32   // sensor channels shared by all zones
+#define ZONE_MAX_SENSORS 2     // per zone, their valid readings are averaged
+#define ZONES_STALE_S 60       // older readings do not count, a zone without any does not start
+#define ZONES_NOT_DUE UINT32_MAX
+#define ZONE_SETTLE_S 120   // a run's effect is measured over this long after it, the filter takes ~50 s
+#define ZONE_GAIN_SHIFT 2   // each measured gain moves the estimate by 1/4
+#define ZONE_MIN_PULSE_S 2  // shorter runs are not worth a relay actuation
+
+// zone states, in the order of STATUS_* in status.h
+#define ZONE_IDLE 0     // below the upper threshold
+#define ZONE_PUMPING 1  // relay on for the pump duration, or until back in the band
+#define ZONE_COOLDOWN 2 // done, waits for humidity to fall below the lower threshold
+#define ZONE_WAITING 3  // above the upper threshold, queued for a pump slot
+
+typedef struct
+{
+    const char *name;
+    uint8_t sensors[ZONE_MAX_SENSORS];
+    uint8_t sensorCount;
+    uint8_t relay;         // index of the relay output
+    int16_t highDeci;      // start watering above this filtered humidity, deci-percent
+    int16_t lowDeci;       // stop / release the latch at or below this
+    uint16_t pumpDurationS; // every run, or the first ones of an adaptive zone
+    bool adaptive;          // size the runs from the learned gain
+    uint16_t maxOnS;        // safety limit of a single run, 0: pumpDurationS
+    uint16_t minOffS;       // shortest pause between the end of a run and the next request
+} zone_config_t;
+
+typedef struct
+{
+    const zone_config_t *config;
+    uint8_t state;
+    uint32_t sinceS;      // time the state was entered
+    int16_t humidity;     // last averaged reading, deci-percent
+    bool hasReading;      // a reading newer than ZONES_STALE_S went into humidity
+    uint32_t pumpCycles;
+    uint32_t pumpSeconds; // total relay on-time
+    uint32_t maxWaitS;    // longest time spent in the queue
+
+    uint16_t pulseS;       // length of the current or last run
+    uint32_t stopS;        // end of the last run
+    bool stopped;          // stopS is valid
+    uint16_t gainQ8;       // deci-percent per pump second, 8 fraction bits, 0 until learned
+    int16_t startHumidity; // at the start of the run being measured
+    bool measurable;       // startHumidity was read before the run, not after a resume
+    int16_t settleMin;     // lowest humidity since its end
+    uint16_t ranS;         // its actual length
+    bool settling;         // a run is being measured
+} zone_t;
+
+// the part of a zone that survives a reset
+typedef struct
+{
+    uint8_t state;
+    uint16_t pulseS;
+    uint16_t ranS; // of the run in progress
+    uint16_t gainQ8;
+    uint32_t offS; // since the end of the last run, ZONES_NOT_DUE before the first
+    uint32_t pumpCycles;
+    uint32_t pumpSeconds;
+    uint32_t maxWaitS;
+} zone_snapshot_t;
+
+typedef struct
+{
+    int16_t humidity; // filtered, deci-percent
+    uint32_t timeS;
+    bool valid;
+} zone_sensor_t;
+
+// relay change for the caller to apply
+typedef struct
+{
+    uint8_t zone;
+    uint8_t relay;
+    bool on;
+} zone_action_t;
+
+typedef struct
+{
+    zone_t zones[ZONES_MAX];
+    uint8_t zoneCount;
+    zone_sensor_t sensors[ZONES_MAX_SENSORS];
+
+    uint8_t queue[ZONES_MAX]; // waiting zones, oldest request first
+    uint8_t queueHead;
+    uint8_t queued;
+
+    uint8_t maxPumps;
+    uint8_t running;
+    uint16_t staggerS;
+    uint32_t lastStartS;
+    bool started; // lastStartS is valid
+} zones_t;
+
+int zonesInit(zones_t *z, const zone_config_t *configs, int count, int maxPumps, int staggerS);
+void zonesSensor(zones_t *z, int sensor, uint32_t timeS, int16_t humidity);
+int zonesStep(zones_t *z, uint32_t nowS, zone_action_t *actions);
+uint32_t zonesNextDue(const zones_t *z, uint32_t nowS);
+int zonesSave(const zones_t *z, uint32_t nowS, zone_snapshot_t *snapshots);
+int zonesRestore(zones_t *z, uint32_t nowS, const zone_snapshot_t *snapshots, int count, uint32_t downS, bool resume,
+                 zone_action_t *actions);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
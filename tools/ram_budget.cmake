@@ -0,0 +1,48 @@
+# Post-build check of the DRAM the linked image takes before the heap starts
+#
+#   cmake -DELF=ibaum.elf -DOBJDUMP=xtensa-esp32-elf-objdump -DBUDGET_KB=128 -P ram_budget.cmake
+#
+# Sums the sizes of SECTIONS (default .dram0.data and .dram0.bss) from
+# objdump -h and fails the build when they pass BUDGET_KB. Whatever the
+# sections take is missing from the internal heap at run time.
+
+cmake_minimum_required(VERSION 3.16)
+
+foreach(var ELF OBJDUMP BUDGET_KB)
+    if(NOT DEFINED ${var})
+        message(FATAL_ERROR "ram_budget.cmake: ${var} not set")
+    endif()
+endforeach()
+
+if(NOT DEFINED SECTIONS)
+    set(SECTIONS ".dram0.data;.dram0.bss")
+endif()
+
+execute_process(COMMAND ${OBJDUMP} -h ${ELF}
+                OUTPUT_VARIABLE headers
+                RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "ram_budget.cmake: ${OBJDUMP} -h ${ELF} failed")
+endif()
+
+# "  Idx Name  Size  VMA  LMA  File off  Algn", sizes in hex
+string(REPLACE "\n" ";" lines "${headers}")
+set(total 0)
+set(details "")
+foreach(line IN LISTS lines)
+    if(line MATCHES "^ *[0-9]+ +([^ ]+) +([0-9a-fA-F]+) ")
+        set(name ${CMAKE_MATCH_1})
+        if(name IN_LIST SECTIONS)
+            math(EXPR size "0x${CMAKE_MATCH_2}")
+            math(EXPR total "${total} + ${size}")
+            string(APPEND details " ${name} ${size}")
+        endif()
+    endif()
+endforeach()
+
+math(EXPR budget "${BUDGET_KB} * 1024")
+if(total GREATER budget)
+    message(FATAL_ERROR "DRAM budget exceeded: ${total} of ${budget} bytes (${details} )")
+endif()
+math(EXPR percent "${total} * 100 / ${budget}")
+message(STATUS "DRAM budget: ${total} of ${budget} bytes, ${percent}% (${details} )")